@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <memory>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+namespace MILI::Database::details
+{
+
+	// writes data at offset and syncs it. Fragments are only written from the flusher and the IoService threads, never from
+	// the event loop, so blocking here holds up nobody else. pwrite + fdatasync are safe to repeat
+	inline bool write_synced(int fd, std::span<const std::byte> data, off_t offset) noexcept
+	{
+		std::size_t written = 0;
+
+		while (written < data.size())
+		{
+			const ssize_t count = pwrite(fd, data.data() + written, data.size() - written, offset + written);
+
+			if (count < 0 and errno != EINTR)
+				return false;
+
+			if (count > 0)
+				written += count;
+		}
+
+		return fdatasync(fd) == 0;
+	}
+
+	// writes data to <path>.tmp, syncs it and atomically moves it over path
+	inline bool commit_file(const std::string& path, std::span<const std::byte> data) noexcept
+	{
+		const std::string tmp_path = path + ".tmp";
+		const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+		if (fd < 0)
+			return false;
+
+		const bool synced = write_synced(fd, data, 0);
+
+		if (close(fd) != 0 or not synced)
+			return false;
+
+		return rename(tmp_path.c_str(), path.c_str()) == 0;
+	}
+
+	// Runs blocking disk work off the event loop.
+	// Jobs are picked up by a small pool of threads, their completions are queued until the owner of the event loop
+	// calls poll(), so callbacks never race with the loop. completion_fd() becomes readable whenever some are waiting.
+	class IoService
+	{
+	public:
+
+		explicit IoService(std::size_t threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 2, 8))
+			: event_fd{eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)}
+		{
+			for (std::size_t i = 0; i < threads; ++i)
+				workers.emplace_back([this] { run(); });
+		}
+
+		IoService(const IoService&) = delete;
+		IoService& operator=(const IoService&) = delete;
+
+		// runs work on one of the pool threads, nothing is reported back
+		void post(std::function<void()> work)
+		{
+			{
+				std::lock_guard lock{mutex};
+				jobs.push_back(std::move(work));
+			}
+
+			wake.notify_one();
+		}
+
+		// runs work on a pool thread, then done with its result on the thread that calls poll()
+		template <typename Work, typename Done>
+		void submit(Work work, Done done)
+		{
+			in_flight.fetch_add(1, std::memory_order_relaxed);
+
+			post([this, work = std::move(work), done = std::move(done)]() mutable
+			{
+				if constexpr (std::is_void_v<std::invoke_result_t<Work&>>)
+				{
+					work();
+					complete(std::move(done));
+				}
+
+				else
+					complete([done = std::move(done), result = work()]() mutable { done(std::move(result)); });
+			});
+		}
+
+		// runs every completion that is ready, returns how many ran
+		std::size_t poll()
+		{
+			std::uint64_t signalled{};
+			[[maybe_unused]] const auto drained = read(event_fd, &signalled, sizeof(signalled));
+
+			std::vector<std::function<void()>> ready;
+
+			{
+				std::lock_guard lock{completions_mutex};
+				ready.swap(completions);
+			}
+
+			for (auto& completion : ready)
+			{
+				completion();
+				in_flight.fetch_sub(1, std::memory_order_relaxed);
+			}
+
+			return ready.size();
+		}
+
+		// submitted jobs whose completion has not run yet
+		[[nodiscard]]
+		std::size_t pending() const noexcept
+		{
+			return in_flight.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]]
+		int completion_fd() const noexcept
+		{
+			return event_fd;
+		}
+
+		[[nodiscard]]
+		std::size_t size() const noexcept
+		{
+			return workers.size();
+		}
+
+		// queued jobs still run, completions that were never polled are dropped
+		~IoService()
+		{
+			{
+				std::lock_guard lock{mutex};
+				stopping = true;
+			}
+
+			wake.notify_all();
+
+			for (auto& worker : workers)
+				worker.join();
+
+			if (event_fd >= 0)
+				close(event_fd);
+		}
+
+	private:
+
+		void run()
+		{
+			while (true)
+			{
+				std::function<void()> job;
+
+				{
+					std::unique_lock lock{mutex};
+					wake.wait(lock, [this] { return stopping or not jobs.empty(); });
+
+					if (jobs.empty())
+						return;
+
+					job = std::move(jobs.front());
+					jobs.pop_front();
+				}
+
+				job();
+			}
+		}
+
+		void complete(std::function<void()> completion)
+		{
+			{
+				std::lock_guard lock{completions_mutex};
+				completions.push_back(std::move(completion));
+			}
+
+			const std::uint64_t one = 1;
+			[[maybe_unused]] const auto signalled = write(event_fd, &one, sizeof(one));
+		}
+
+		int event_fd;
+
+		std::mutex mutex; // guards jobs and stopping
+		std::condition_variable wake;
+		std::deque<std::function<void()>> jobs;
+		bool stopping = false;
+
+		std::mutex completions_mutex;
+		std::vector<std::function<void()>> completions;
+		std::atomic<std::size_t> in_flight{0};
+
+		std::vector<std::thread> workers;
+	};
+
+	// runs body(i) for every i below count on the pool threads and the calling thread together, returns once all are done.
+	// the caller works through the indices as well, so this finishes even when every pool thread is busy or waiting on it.
+	// helpers that start late find nothing left to claim and never touch body
+	template <typename F>
+	void parallel_for(IoService& pool, std::size_t count, F&& body)
+	{
+		struct Progress
+		{
+			std::atomic<std::size_t> next{0};
+			std::atomic<std::size_t> done{0};
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+
+		auto progress = std::make_shared<Progress>();
+
+		auto work = [progress, count, function = &body]
+		{
+			for (std::size_t i = progress->next.fetch_add(1); i < count; i = progress->next.fetch_add(1))
+			{
+				(*function)(i);
+
+				if (progress->done.fetch_add(1) + 1 == count)
+				{
+					std::lock_guard lock{progress->mutex};
+					progress->finished.notify_all();
+				}
+			}
+		};
+
+		for (std::size_t helper = 1; helper < std::min(count, pool.size() + 1); ++helper)
+			pool.post(work);
+
+		work();
+
+		std::unique_lock lock{progress->mutex};
+		progress->finished.wait(lock, [&] { return progress->done.load() == count; });
+	}
+
+}
@@ -0,0 +1,503 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "AsyncIO.hpp"
+#include "Serializer.hpp"
+
+namespace MILI::Database::details
+{
+
+// Blocked bloom filter: every key sets all of its bits inside a single 64 byte block,
+// so a membership check touches exactly one cache line. Bits are set and tested atomically,
+// concurrent insert() and contains() calls are safe as long as nobody resizes the filter.
+// The blocks are either owned or used in place where they were serialized, see view().
+class BloomFilter
+{
+public:
+
+	constexpr static std::size_t block_bits = 512;
+	constexpr static std::size_t block_words = block_bits / 64;
+
+	BloomFilter() noexcept = default;
+	BloomFilter(BloomFilter&&) noexcept = default;
+	BloomFilter& operator=(BloomFilter&&) noexcept = default;
+
+	explicit BloomFilter(std::size_t expected_keys, double false_positive_rate = 0.01)
+	{
+		const double bits_per_key = std::max(1.0, -std::log(false_positive_rate) / (std::log(2.0) * std::log(2.0)));
+		const auto bits = static_cast<std::size_t>(std::ceil(bits_per_key * static_cast<double>(std::max<std::size_t>(expected_keys, 1))));
+
+		probes = static_cast<std::uint8_t>(std::clamp(std::lround(bits_per_key * std::log(2.0)), 1l, 16l));
+		storage.assign(std::max<std::size_t>((bits + block_bits - 1) / block_bits, 1) * block_words, 0);
+		words = storage;
+	}
+
+	// returns the index of the block that was touched
+	std::size_t insert(std::size_t hash) noexcept
+	{
+		const auto [block, h1, h2] = locate(hash);
+
+		for (std::uint32_t i = 0; i < probes; ++i)
+		{
+			const std::uint32_t bit = (h1 + i * h2) % block_bits;
+			std::atomic_ref{words[block + bit / 64]}.fetch_or(std::uint64_t{1} << (bit % 64), std::memory_order_relaxed);
+		}
+
+		return block / block_words;
+	}
+
+	[[nodiscard]]
+	bool contains(std::size_t hash) const noexcept
+	{
+		if (words.empty())
+			return true;
+
+		const auto [block, h1, h2] = locate(hash);
+
+		for (std::uint32_t i = 0; i < probes; ++i)
+		{
+			const std::uint32_t bit = (h1 + i * h2) % block_bits;
+
+			if (not (word(block + bit / 64) & (std::uint64_t{1} << (bit % 64))))
+				return false;
+		}
+
+		return true;
+	}
+
+	[[nodiscard]]
+	bool empty() const noexcept
+	{
+		return words.empty();
+	}
+
+	[[nodiscard]]
+	std::size_t blocks() const noexcept
+	{
+		return words.size() / block_words;
+	}
+
+	[[nodiscard]]
+	std::span<const std::byte> block(std::size_t index) const noexcept
+	{
+		return std::as_bytes(std::span{words}.subspan(index * block_words, block_words));
+	}
+
+	[[nodiscard]]
+	std::size_t memory_usage() const noexcept
+	{
+		return words.size() * sizeof(std::uint64_t);
+	}
+
+	// [u32 block count][u8 probes][3 bytes padding][blocks]
+	[[nodiscard]]
+	std::vector<std::byte> serialize() const
+	{
+		std::vector<std::byte> ret;
+		ret.reserve(header_size + words.size() * sizeof(std::uint64_t));
+
+		auto&& header = MILI::serialize(static_cast<std::uint32_t>(words.size() / block_words), probes, std::array<std::byte, 3>{});
+		ret.insert(ret.end(), header.begin(), header.end());
+
+		const auto data = std::as_bytes(words);
+		ret.insert(ret.end(), data.begin(), data.end());
+
+		return ret;
+	}
+
+	[[nodiscard]]
+	static BloomFilter deserialize(std::span<const std::byte> buffer)
+	{
+		BloomFilter ret;
+
+		const std::size_t blocks = serialized_blocks(buffer);
+
+		if (not blocks)
+			return ret;
+
+		ret.probes = static_cast<std::uint8_t>(buffer[sizeof(std::uint32_t)]);
+		ret.storage.resize(blocks * block_words);
+		std::copy_n(buffer.data() + header_size, ret.storage.size() * sizeof(std::uint64_t), reinterpret_cast<std::byte*>(ret.storage.data()));
+		ret.words = ret.storage;
+
+		return ret;
+	}
+
+	// like deserialize, but the blocks stay where they are and inserts write to them there.
+	// the buffer has to be 8 byte aligned and outlive the filter
+	[[nodiscard]]
+	static BloomFilter view(std::span<std::byte> buffer) noexcept
+	{
+		BloomFilter ret;
+
+		const std::size_t blocks = serialized_blocks(buffer);
+
+		if (not blocks or reinterpret_cast<std::uintptr_t>(buffer.data() + header_size) % alignof(std::uint64_t))
+			return ret;
+
+		ret.probes = static_cast<std::uint8_t>(buffer[sizeof(std::uint32_t)]);
+		ret.words = std::span{reinterpret_cast<std::uint64_t*>(buffer.data() + header_size), blocks * block_words};
+
+		return ret;
+	}
+
+	constexpr static std::size_t header_size = 8;
+
+private:
+
+	struct Location
+	{
+		std::size_t block;
+		std::uint32_t h1;
+		std::uint32_t h2;
+	};
+
+	// the number of blocks a serialized filter has, 0 if the buffer can't hold them
+	[[nodiscard]]
+	static std::size_t serialized_blocks(std::span<const std::byte> buffer) noexcept
+	{
+		if (buffer.size() < header_size)
+			return 0;
+
+		const std::size_t blocks = MILI::deserialize<std::uint32_t>(std::span<const std::byte, sizeof(std::uint32_t)>{buffer.data(), sizeof(std::uint32_t)});
+
+		return buffer.size() < header_size + blocks * block_words * sizeof(std::uint64_t) ? 0 : blocks;
+	}
+
+	[[nodiscard]]
+	std::uint64_t word(std::size_t index) const noexcept
+	{
+		return std::atomic_ref{const_cast<std::uint64_t&>(words[index])}.load(std::memory_order_relaxed);
+	}
+
+	[[nodiscard]]
+	Location locate(std::size_t hash) const noexcept
+	{
+		// std::hash is the identity for integers, scramble it before deriving the probes
+		std::uint64_t h = hash;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ull;
+		h ^= h >> 33;
+
+		const std::size_t blocks = words.size() / block_words;
+		const auto block = static_cast<std::size_t>((static_cast<unsigned __int128>(h) * blocks) >> 64);
+
+		return {block * block_words, static_cast<std::uint32_t>(h), static_cast<std::uint32_t>(h >> 32) | 1u};
+	}
+
+	std::vector<std::uint64_t> storage; // empty when the blocks are viewed in place
+	std::span<std::uint64_t> words;
+	std::uint8_t probes = 0;
+};
+
+
+// Per-table membership filter made of bloom filter layers. Once a layer reaches its capacity a new one twice as large
+// with half the false positive rate is added, which keeps the overall rate near the target however large the table grows.
+// Only the blocks touched since the last persist() are written back.
+// A loaded filter is used in place from a private mapping of its file, so opening a table costs nothing until its
+// lookups fault in the pages they touch. Inserts dirty private copies of those pages, persist() writes them back.
+// Inserts and lookups only share the lock, adding a layer takes it exclusively.
+// A file that exists but can't be read back leaves the filter damaged: it answers maybe for every key and is never
+// persisted over, an empty filter in its place would hide every key written before.
+// File layout: [magic "MILF"][u32 layer count] then per layer [u64 capacity][u64 inserted][serialized BloomFilter]
+class MembershipFilter
+{
+public:
+
+	constexpr static std::size_t initial_capacity = 1 << 16;
+	constexpr static double false_positive_rate = 0.01;
+
+	MembershipFilter()
+	{
+		add_layer(initial_capacity, false_positive_rate / 2);
+	}
+
+	MembershipFilter(MembershipFilter&& rhs) noexcept : mapping{std::move(rhs.mapping)}, layers{std::move(rhs.layers)}, damaged{rhs.damaged}
+	{}
+
+	[[nodiscard]]
+	static MembershipFilter load(const std::string& path)
+	{
+		const int fd = open(path.c_str(), O_RDONLY);
+
+		if (fd < 0 and errno == ENOENT)
+			return MembershipFilter{};
+
+		MembershipFilter ret;
+		ret.damaged = true;
+
+		if (fd < 0)
+			return ret;
+
+		struct stat info{};
+		void* addr = fstat(fd, &info) == 0 and info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+		close(fd);
+
+		if (addr == MAP_FAILED)
+			return ret;
+
+		// lookups land on random blocks, reading ahead would only fault in pages nobody asked for
+		madvise(addr, info.st_size, MADV_RANDOM);
+
+		std::shared_ptr<std::byte> mapped{static_cast<std::byte*>(addr), [length = info.st_size](std::byte* data) { munmap(data, length); }};
+		const std::span<std::byte> buffer{mapped.get(), static_cast<std::size_t>(info.st_size)};
+
+		if (buffer.size() < file_header_size or not std::equal(magic.begin(), magic.end(), reinterpret_cast<const char*>(buffer.data())))
+			return ret;
+
+		const auto layer_count = integral_at<std::uint32_t>(buffer, magic.size());
+		std::vector<Layer> layers;
+
+		for (std::size_t i = 0, offset = file_header_size; i < layer_count; ++i)
+		{
+			if (offset + layer_header_size > buffer.size())
+				return ret;
+
+			Layer layer;
+			layer.capacity = integral_at<std::uint64_t>(buffer, offset);
+			layer.inserted = integral_at<std::uint64_t>(buffer, offset + sizeof(std::uint64_t));
+			layer.filter = BloomFilter::view(buffer.subspan(offset + layer_header_size));
+			layer.dirty.assign((layer.filter.blocks() + 63) / 64, 0);
+			layer.persisted = true;
+
+			if (layer.filter.empty())
+				return ret;
+
+			offset += layer_size(layer);
+			layers.push_back(std::move(layer));
+		}
+
+		if (layers.empty())
+			return ret;
+
+		ret.layers = std::move(layers);
+		ret.mapping = std::move(mapped);
+		ret.damaged = false;
+
+		return ret;
+	}
+
+	void insert(std::size_t hash)
+	{
+		{
+			std::shared_lock lock{mutex};
+
+			if (contains_locked(hash))
+				return;
+
+			// the common case, the newest layer still has room
+			if (std::atomic_ref{layers.back().inserted}.load(std::memory_order_relaxed) < layers.back().capacity)
+			{
+				insert_locked(hash);
+				return;
+			}
+		}
+
+		std::unique_lock lock{mutex};
+
+		if (contains_locked(hash))
+			return;
+
+		if (layers.back().inserted >= layers.back().capacity)
+			add_layer(layers.back().capacity * 2, false_positive_rate / std::pow(2.0, static_cast<double>(layers.size() + 1)));
+
+		insert_locked(hash);
+	}
+
+	[[nodiscard]]
+	bool contains(std::size_t hash) const noexcept
+	{
+		std::shared_lock lock{mutex};
+		return damaged or contains_locked(hash);
+	}
+
+	[[nodiscard]]
+	std::size_t memory_usage() const noexcept
+	{
+		std::shared_lock lock{mutex};
+
+		std::size_t total = 0;
+
+		for (const auto& layer : layers)
+			total += layer.filter.memory_usage();
+
+		return total;
+	}
+
+	[[nodiscard]]
+	bool is_dirty() const noexcept
+	{
+		std::shared_lock lock{mutex};
+		return is_dirty_locked();
+	}
+
+	// a new file is written whole and moved in place. Into one already on disk go new layers in full and only the dirty
+	// blocks of the others, all synced before the layer count that makes them part of the file
+	bool persist(const std::string& path) noexcept
+	{
+		std::unique_lock lock{mutex};
+
+		if (not is_dirty_locked())
+			return true;
+
+		if (std::ranges::none_of(layers, &Layer::persisted))
+			return persist_whole(path);
+
+		const int fd = open(path.c_str(), O_RDWR);
+
+		if (fd < 0)
+			return false;
+
+		auto write_at = [fd](const std::ranges::range auto& bytes, std::size_t offset) -> bool
+		{
+			return pwrite(fd, std::ranges::data(bytes), std::ranges::size(bytes), offset) == static_cast<ssize_t>(std::ranges::size(bytes));
+		};
+
+		bool ret = true;
+
+		for (std::size_t offset = file_header_size; auto& layer : layers)
+		{
+			ret = write_at(MILI::serialize(static_cast<std::uint64_t>(layer.capacity), layer.inserted), offset) and ret;
+
+			if (not layer.persisted)
+				ret = write_at(layer.filter.serialize(), offset + layer_header_size) and ret;
+
+			else
+			{
+				for (std::size_t block = 0; block < layer.filter.blocks(); ++block)
+					if (layer.dirty[block / 64] & (std::uint64_t{1} << (block % 64)))
+						ret = write_at(layer.filter.block(block), offset + layer_header_size + BloomFilter::header_size + block * BloomFilter::block_bits / 8) and ret;
+			}
+
+			offset += layer_size(layer);
+		}
+
+		ret = ret and fdatasync(fd) == 0 and write_at(MILI::serialize(magic, static_cast<std::uint32_t>(layers.size())), 0) and fdatasync(fd) == 0;
+		close(fd);
+
+		// blocks that failed to reach the disk are retried by the next persist
+		if (ret)
+			mark_persisted();
+
+		return ret;
+	}
+
+private:
+
+	constexpr static std::array<char, 4> magic{'M', 'I', 'L', 'F'};
+	constexpr static std::size_t file_header_size = magic.size() + sizeof(std::uint32_t);
+	constexpr static std::size_t layer_header_size = 2 * sizeof(std::uint64_t);
+
+	struct Layer
+	{
+		BloomFilter filter;
+		std::size_t capacity{};
+		std::uint64_t inserted{};
+		std::vector<std::uint64_t> dirty; // one bit per block
+		bool persisted = false;
+	};
+
+	[[nodiscard]]
+	bool contains_locked(std::size_t hash) const noexcept
+	{
+		return std::ranges::any_of(layers, [hash](const Layer& layer) { return layer.filter.contains(hash); });
+	}
+
+	void insert_locked(std::size_t hash) noexcept
+	{
+		auto& layer = layers.back();
+		const std::size_t block = layer.filter.insert(hash);
+
+		std::atomic_ref{layer.dirty[block / 64]}.fetch_or(std::uint64_t{1} << (block % 64), std::memory_order_relaxed);
+		std::atomic_ref{layer.inserted}.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool persist_whole(const std::string& path) noexcept
+	{
+		auto&& header = MILI::serialize(magic, static_cast<std::uint32_t>(layers.size()));
+		std::vector<std::byte> buffer{header.begin(), header.end()};
+
+		for (const auto& layer : layers)
+		{
+			auto&& layer_header = MILI::serialize(static_cast<std::uint64_t>(layer.capacity), layer.inserted);
+			const auto filter = layer.filter.serialize();
+
+			buffer.insert(buffer.end(), layer_header.begin(), layer_header.end());
+			buffer.insert(buffer.end(), filter.begin(), filter.end());
+		}
+
+		if (not commit_file(path, buffer))
+			return false;
+
+		mark_persisted();
+		return true;
+	}
+
+	void mark_persisted() noexcept
+	{
+		for (auto& layer : layers)
+		{
+			layer.persisted = true;
+			std::fill(layer.dirty.begin(), layer.dirty.end(), 0);
+		}
+	}
+
+	// a damaged filter has nothing to write that wouldn't lose the keys of the file it stands in for
+	[[nodiscard]]
+	bool is_dirty_locked() const noexcept
+	{
+		return not damaged and std::ranges::any_of(layers, [](const Layer& layer)
+		{
+			return layer.inserted and (not layer.persisted or std::ranges::any_of(layer.dirty, [](std::uint64_t bits) { return bits != 0; }));
+		});
+	}
+
+	void add_layer(std::size_t capacity, double rate)
+	{
+		Layer layer;
+		layer.filter = BloomFilter{capacity, rate};
+		layer.capacity = capacity;
+		layer.dirty.assign((layer.filter.blocks() + 63) / 64, 0);
+
+		layers.push_back(std::move(layer));
+	}
+
+	[[nodiscard]]
+	static std::size_t layer_size(const Layer& layer) noexcept
+	{
+		return layer_header_size + BloomFilter::header_size + layer.filter.memory_usage();
+	}
+
+	template <std::integral T>
+	[[nodiscard]]
+	static T integral_at(std::span<const std::byte> buffer, std::size_t offset) noexcept
+	{
+		return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{buffer.data() + offset, sizeof(T)});
+	}
+
+	mutable std::shared_mutex mutex;
+	std::shared_ptr<std::byte> mapping; // of the file the loaded layers are viewed in, outlives them
+	std::vector<Layer> layers;
+	bool damaged = false;
+};
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+
+namespace MILI
+{
+
+namespace details
+{
+	// lookup table for the reflected CRC32C (Castagnoli) polynomial
+	constexpr auto crc32c_table = []
+	{
+		std::array<std::uint32_t, 256> table{};
+
+		for (std::uint32_t i = 0; i < table.size(); ++i)
+		{
+			std::uint32_t crc = i;
+
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+
+			table[i] = crc;
+		}
+
+		return table;
+	}();
+}
+
+// pass the previous result as crc to checksum data that arrives in pieces
+[[nodiscard]]
+constexpr std::uint32_t crc32c(std::span<const std::byte> data, std::uint32_t crc = 0) noexcept
+{
+	crc = ~crc;
+
+	for (auto byte : data)
+		crc = details::crc32c_table[(crc ^ static_cast<std::uint8_t>(byte)) & 0xFFu] ^ (crc >> 8);
+
+	return ~crc;
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <algorithm>
+
+// the build defines MILI_HAS_LZ4 and MILI_HAS_ZSTD for the codecs it found and links, see CMakeLists.txt
+#ifndef MILI_HAS_LZ4
+#define MILI_HAS_LZ4 0
+#endif
+
+#ifndef MILI_HAS_ZSTD
+#define MILI_HAS_ZSTD 0
+#endif
+
+#if MILI_HAS_LZ4
+#include <lz4.h>
+#endif
+
+#if MILI_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace MILI::Database
+{
+
+// How the blocks of a table's fragments are stored. Lz4 is fast enough to stay off the read path, Zstd packs tighter.
+// A codec that wasn't available at build time leaves the blocks uncompressed.
+enum class Compression : std::uint8_t
+{
+	None,
+	Lz4,
+	Zstd
+};
+
+namespace details
+{
+	constexpr int zstd_level = 3;
+	constexpr std::size_t min_saving = 8; // a block is only stored compressed if that saves at least 1/min_saving of it
+
+	// appends the compressed block to out, false if it shouldn't be stored compressed
+	inline bool compress(Compression codec, std::span<const std::byte> block, std::vector<std::byte>& out)
+	{
+		const std::size_t begin = out.size();
+
+		switch (codec)
+		{
+#if MILI_HAS_LZ4
+			case Compression::Lz4:
+			{
+				out.resize(begin + LZ4_compressBound(static_cast<int>(block.size())));
+
+				const int written = LZ4_compress_default(reinterpret_cast<const char*>(block.data()), reinterpret_cast<char*>(out.data() + begin),
+					static_cast<int>(block.size()), static_cast<int>(out.size() - begin));
+
+				out.resize(begin + std::max(written, 0));
+				break;
+			}
+#endif
+#if MILI_HAS_ZSTD
+			case Compression::Zstd:
+			{
+				out.resize(begin + ZSTD_compressBound(block.size()));
+
+				const std::size_t written = ZSTD_compress(out.data() + begin, out.size() - begin, block.data(), block.size(), zstd_level);
+
+				out.resize(begin + (ZSTD_isError(written) ? 0 : written));
+				break;
+			}
+#endif
+			default:
+				return false;
+		}
+
+		// a block that barely shrinks is cheaper to keep as it is than to inflate on every read
+		if (out.size() == begin or out.size() - begin > block.size() - block.size() / min_saving)
+		{
+			out.resize(begin);
+			return false;
+		}
+
+		return true;
+	}
+
+	// block must inflate to exactly out.size() bytes
+	inline bool decompress(Compression codec, [[maybe_unused]] std::span<const std::byte> block, [[maybe_unused]] std::span<std::byte> out) noexcept
+	{
+		switch (codec)
+		{
+#if MILI_HAS_LZ4
+			case Compression::Lz4:
+				return LZ4_decompress_safe(reinterpret_cast<const char*>(block.data()), reinterpret_cast<char*>(out.data()),
+					static_cast<int>(block.size()), static_cast<int>(out.size())) == static_cast<int>(out.size());
+#endif
+#if MILI_HAS_ZSTD
+			case Compression::Zstd:
+				return ZSTD_decompress(out.data(), out.size(), block.data(), block.size()) == out.size();
+#endif
+			default:
+				return false;
+		}
+	}
+}
+
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <memory_resource>
+
+namespace MILI::Database::details
+{
+
+// Ordered map over a sorted vector, the default container of a Bucket. Entries sit next to each other so loading a
+// fragment, which comes sorted, is a run of appends and a lookup is a binary search over contiguous memory.
+// Inserting in the middle moves the entries after it, which a bucket only does while a checkpoint applies its batch.
+template <typename Key, typename Value, typename Allocator = std::allocator<std::pair<Key, Value>>>
+class FlatMap
+{
+	using storage_t = std::vector<std::pair<Key, Value>, Allocator>;
+
+public:
+
+	using key_type = Key;
+	using mapped_type = Value;
+	using value_type = std::pair<Key, Value>;
+	using allocator_type = Allocator;
+	using iterator = typename storage_t::iterator;
+	using const_iterator = typename storage_t::const_iterator;
+
+	FlatMap() = default;
+
+	explicit FlatMap(const Allocator& allocator) : entries{allocator}
+	{}
+
+	[[nodiscard]]
+	iterator begin() noexcept { return entries.begin(); }
+	[[nodiscard]]
+	iterator end() noexcept { return entries.end(); }
+	[[nodiscard]]
+	const_iterator begin() const noexcept { return entries.begin(); }
+	[[nodiscard]]
+	const_iterator end() const noexcept { return entries.end(); }
+
+	[[nodiscard]]
+	std::size_t size() const noexcept
+	{
+		return entries.size();
+	}
+
+	[[nodiscard]]
+	std::size_t capacity() const noexcept
+	{
+		return entries.capacity();
+	}
+
+	void reserve(std::size_t count)
+	{
+		entries.reserve(count);
+	}
+
+	[[nodiscard]]
+	iterator lower_bound(const Key& key) noexcept
+	{
+		return std::ranges::lower_bound(entries, key, {}, &value_type::first);
+	}
+
+	[[nodiscard]]
+	const_iterator lower_bound(const Key& key) const noexcept
+	{
+		return std::ranges::lower_bound(entries, key, {}, &value_type::first);
+	}
+
+	[[nodiscard]]
+	iterator upper_bound(const Key& key) noexcept
+	{
+		return std::ranges::upper_bound(entries, key, {}, &value_type::first);
+	}
+
+	[[nodiscard]]
+	const_iterator upper_bound(const Key& key) const noexcept
+	{
+		return std::ranges::upper_bound(entries, key, {}, &value_type::first);
+	}
+
+	[[nodiscard]]
+	iterator find(const Key& key) noexcept
+	{
+		auto itr = lower_bound(key);
+		return itr != entries.end() and not (key < itr->first) ? itr : entries.end();
+	}
+
+	[[nodiscard]]
+	const_iterator find(const Key& key) const noexcept
+	{
+		auto itr = lower_bound(key);
+		return itr != entries.end() and not (key < itr->first) ? itr : entries.end();
+	}
+
+	// appends in O(1) when the key goes last, which is how a fragment is read in
+	template <typename K, typename V>
+	iterator emplace_hint(const_iterator hint, K&& key, V&& value)
+	{
+		if (hint == entries.end() and (entries.empty() or entries.back().first < key))
+		{
+			entries.emplace_back(std::forward<K>(key), std::forward<V>(value));
+			return std::prev(entries.end());
+		}
+
+		return insert_or_assign(std::forward<K>(key), std::forward<V>(value)).first;
+	}
+
+	template <typename V>
+	std::pair<iterator, bool> insert_or_assign(const Key& key, V&& value)
+	{
+		auto itr = lower_bound(key);
+
+		if (itr != entries.end() and not (key < itr->first))
+		{
+			itr->second = std::forward<V>(value);
+			return {itr, false};
+		}
+
+		return {entries.emplace(itr, key, std::forward<V>(value)), true};
+	}
+
+	Value& operator[](const Key& key)
+	{
+		auto itr = lower_bound(key);
+
+		if (itr == entries.end() or key < itr->first)
+			itr = entries.emplace(itr, key, Value{});
+
+		return itr->second;
+	}
+
+	iterator erase(const_iterator position)
+	{
+		return entries.erase(position);
+	}
+
+	std::size_t erase(const Key& key)
+	{
+		auto itr = find(key);
+
+		if (itr == entries.end())
+			return 0;
+
+		entries.erase(itr);
+		return 1;
+	}
+
+	// erases the entries erases(entry) picks in one pass
+	template <typename F>
+	std::size_t erase_if(F&& erases)
+	{
+		return std::erase_if(entries, std::forward<F>(erases));
+	}
+
+	// applies changes sorted by key in linear time, a null value erases the key. Works in place so the storage is only
+	// reallocated when it runs out of capacity
+	void merge(std::span<const std::pair<const Key*, const Value*>> changes)
+	{
+		std::size_t inserted = 0;
+		auto change = changes.begin();
+
+		// erased entries are dropped moving forward, counting the keys that are new along the way
+		auto kept = entries.begin();
+
+		for (auto itr = entries.begin(); itr != entries.end(); ++itr)
+		{
+			for (; change != changes.end() and *change->first < itr->first; ++change)
+				inserted += change->second != nullptr;
+
+			const bool matches = change != changes.end() and not (itr->first < *change->first);
+
+			if (matches and not (change++)->second)
+				continue;
+
+			if (kept != itr)
+				*kept = std::move(*itr);
+
+			++kept;
+		}
+
+		for (; change != changes.end(); ++change)
+			inserted += change->second != nullptr;
+
+		entries.erase(kept, entries.end());
+
+		// then the values are written moving backward, shifting the entries into their final place once
+		std::size_t read = entries.size();
+		std::size_t write = entries.size() + inserted;
+		entries.resize(write);
+
+		for (auto itr = changes.rbegin(); itr != changes.rend(); ++itr)
+		{
+			const auto& [key, value] = *itr;
+
+			if (not value)
+				continue;
+
+			for (; read > 0 and *key < entries[read - 1].first; --read, --write)
+				if (read != write)
+					entries[write - 1] = std::move(entries[read - 1]);
+
+			if (read > 0 and not (entries[read - 1].first < *key))
+			{
+				entries[read - 1].second = *value;
+
+				if (read != write)
+					entries[write - 1] = std::move(entries[read - 1]);
+
+				--read;
+			}
+			else
+				entries[write - 1] = value_type{*key, *value};
+
+			--write;
+		}
+	}
+
+private:
+
+	storage_t entries;
+};
+
+// the default bucket container, its storage comes from the arena of the bucket
+template <typename Key, typename Value>
+using ArenaFlatMap = FlatMap<Key, Value, std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+
+}
@@ -0,0 +1,937 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <optional>
+#include <array>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <span>
+#include <algorithm>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Serializer.hpp"
+#include "Checksum.hpp"
+#include "AsyncIO.hpp"
+#include "Compression.hpp"
+#include "Metrics.hpp"
+
+namespace MILI::Database::details
+{
+
+	// Every fragment starts with this header.
+	// Version 1 (version field 0): the header is followed by [u16 key size][key][u16 value size][value] records until the end of the file.
+	// Version 2: the records are packed into blocks that never split a record, followed by the index and the trailer
+	//     index:   per block [u32 offset][u32 size][u32 crc32c of the block][u32 entries][u16 key size][first key]
+	//     trailer: [u64 index offset][u64 entries][u32 blocks][u32 crc32c of the index]
+	// Version 3: like version 2, but each block may be stored compressed on its own
+	//     index:   per block [u32 offset][u32 size][u32 crc32c of the stored block][u32 entries][u32 records size][u8 codec][u16 key size][first key]
+	// Version 4: like version 3, but the checksum of the trailer covers the index and the other fields of the trailer.
+	// size is the byte size of the records, len only counted the records of version 1 files.
+	// Changes made after a version 2 or 3 fragment was written are appended to <fragment>.delta, see DeltaWriter.
+	// generation ties the two together, a delta left over from an older fragment is ignored.
+	struct Header
+	{
+		std::array<char, 4> magic{'M', 'I', 'L', 'I'};
+		std::uint32_t size{};
+		std::uint16_t len{};
+		std::uint16_t version{};
+		std::uint32_t generation{};
+
+		Header() noexcept = default;
+
+		bool construct(const std::array<std::byte, 16>& raw_data) noexcept
+		{
+			magic = MILI::deserialize<char, 4>(std::span<const std::byte, 4>{raw_data.begin(), raw_data.begin() + sizeof(magic)});
+
+			// check if magic is correct
+			if (magic != std::array<char, 4>{'M', 'I', 'L', 'I'})
+				return false;
+
+			size = MILI::deserialize<std::uint32_t>(std::span<const std::byte, sizeof(size)>{raw_data.begin() + sizeof(magic), raw_data.begin() + sizeof(magic) + sizeof(size)});
+			len = MILI::deserialize<std::uint16_t>(std::span<const std::byte, sizeof(len)>{raw_data.begin() + sizeof(magic) + sizeof(size), raw_data.begin() + sizeof(magic) + sizeof(size) + sizeof(len)});
+			version = MILI::deserialize<std::uint16_t>(std::span<const std::byte, sizeof(version)>{raw_data.begin() + 10, raw_data.begin() + 12});
+			generation = MILI::deserialize<std::uint32_t>(std::span<const std::byte, sizeof(generation)>{raw_data.begin() + 12, raw_data.begin() + 16});
+
+			return true;
+		}
+
+		[[nodiscard]]
+		std::array<std::byte, 16> serialize() const noexcept
+		{
+			using namespace MILI::Database;
+
+			auto&& serialized_vec = MILI::serialize(magic, size, len, version, generation);
+			std::array<std::byte, 16> serialized_array{};
+			std::copy(serialized_vec.begin(), serialized_vec.end(), serialized_array.begin());
+
+			return serialized_array;
+		}
+	};
+
+	constexpr std::uint16_t fragment_version = 4;
+	constexpr std::size_t fragment_header_size = 16;
+	constexpr std::size_t fragment_trailer_size = 2 * sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+	constexpr std::size_t delta_header_size = 2 * sizeof(std::uint32_t);
+	constexpr std::size_t delta_frame_size = 2 * sizeof(std::uint32_t);
+
+	// Builds a version 4 fragment in memory, the records must be added in key order.
+	template <typename Key, typename Value, typename Serializer>
+	class FragmentWriter
+	{
+	public:
+
+		constexpr static std::size_t block_size = 4096;
+
+		// arenas above this are released instead of being kept for the next writer
+		constexpr static std::size_t max_arena_size = 16 * 1024 * 1024;
+
+		// the whole fragment is encoded into an arena that is reused by the next writer on this thread
+		explicit FragmentWriter(std::uint32_t fragment_generation = 0, Compression compression = Compression::None)
+			: generation{fragment_generation}, codec{compression}
+		{
+			if (auto* reused = arena())
+				buffer.swap(*reused);
+
+			buffer.resize(fragment_header_size);
+		}
+
+		FragmentWriter(const FragmentWriter&) = delete;
+		FragmentWriter& operator=(const FragmentWriter&) = delete;
+
+		void add(const Key& key, const Value& value)
+		{
+			// the record is encoded in place, if it overflows the block it is moved into the next one by sealing in front of it
+			std::size_t record = buffer.size();
+
+			MILI::serialize_sized_into<Serializer>(buffer, key);
+			const std::size_t key_size = buffer.size() - record - sizeof(std::uint16_t);
+			MILI::serialize_sized_into<Serializer>(buffer, value);
+
+			if (block_entries and buffer.size() - block_offset > block_size)
+				record = seal_block(record);
+
+			if (not block_entries)
+			{
+				block_offset = record;
+				first_key.assign(buffer.begin() + record + sizeof(std::uint16_t), buffer.begin() + record + sizeof(std::uint16_t) + key_size);
+			}
+
+			++block_entries;
+			++entries;
+		}
+
+		bool finish(const std::string& path)
+		{
+			if (block_entries)
+				seal_block(buffer.size());
+
+			// the offsets and sizes of the index and Header::size are u32, a fragment past that can't be addressed
+			if (buffer.size() > std::numeric_limits<std::uint32_t>::max())
+				return false;
+
+			Header header;
+			header.size = static_cast<std::uint32_t>(buffer.size() - fragment_header_size);
+			header.version = fragment_version;
+			header.generation = generation;
+
+			const auto serialized_header = header.serialize();
+			std::copy(serialized_header.begin(), serialized_header.end(), buffer.begin());
+
+			const auto index_offset = static_cast<std::uint64_t>(buffer.size());
+			put(index);
+			put(MILI::serialize(index_offset, static_cast<std::uint64_t>(entries), static_cast<std::uint32_t>(blocks)));
+			put(MILI::serialize(MILI::crc32c(std::span<const std::byte>{buffer.data() + index_offset, buffer.size() - index_offset})));
+
+			return commit_file(path, buffer);
+		}
+
+		~FragmentWriter()
+		{
+			if (buffer.capacity() > max_arena_size)
+				return;
+
+			buffer.clear();
+
+			if (auto* reused = arena())
+				reused->swap(buffer);
+		}
+
+	private:
+
+		// null once the thread's arena is destroyed, writers run by static destructors at exit go without one
+		[[nodiscard]]
+		static std::vector<std::byte>* arena() noexcept
+		{
+			thread_local bool destroyed = false;
+
+			struct Arena
+			{
+				std::vector<std::byte> buffer;
+
+				~Arena()
+				{
+					destroyed = true;
+				}
+			};
+
+			thread_local Arena owner;
+			return destroyed ? nullptr : &owner.buffer;
+		}
+
+		// the block runs from block_offset up to end, returns where the bytes past end moved to
+		std::size_t seal_block(std::size_t end)
+		{
+			const std::size_t records_size = end - block_offset;
+			Compression stored_codec = Compression::None;
+
+			// the block is swapped for its compressed form, the record that overflowed it is carried over
+			if (codec != Compression::None)
+			{
+				scratch.clear();
+
+				if (compress(codec, std::span<const std::byte>{buffer.data() + block_offset, records_size}, scratch))
+				{
+					const std::size_t compressed_size = scratch.size();
+
+					scratch.insert(scratch.end(), buffer.begin() + end, buffer.end());
+					buffer.resize(block_offset);
+					put(scratch);
+
+					end = block_offset + compressed_size;
+					stored_codec = codec;
+				}
+			}
+
+			const std::span<const std::byte> block{buffer.data() + block_offset, end - block_offset};
+
+			const auto entry = MILI::serialize(static_cast<std::uint32_t>(block_offset), static_cast<std::uint32_t>(block.size()),
+				MILI::crc32c(block), static_cast<std::uint32_t>(block_entries), static_cast<std::uint32_t>(records_size),
+				static_cast<std::uint8_t>(stored_codec), static_cast<std::uint16_t>(first_key.size()));
+
+			index.insert(index.end(), entry.begin(), entry.end());
+			index.insert(index.end(), first_key.begin(), first_key.end());
+
+			block_entries = 0;
+			++blocks;
+
+			return end;
+		}
+
+		void put(const std::ranges::range auto& bytes)
+		{
+			buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		}
+
+		std::vector<std::byte> buffer;
+		std::vector<std::byte> index;
+		std::vector<std::byte> first_key;
+		std::vector<std::byte> scratch; // the block being compressed
+		std::uint32_t generation;
+		Compression codec;
+		std::size_t block_offset = 0;
+		std::size_t block_entries = 0;
+		std::size_t blocks = 0;
+		std::size_t entries = 0;
+	};
+
+	// Appends changed records to the delta file of a fragment.
+	// Layout: [magic "MILD"][u32 generation] followed by [u32 payload size][u32 crc32c of payload][payload] records,
+	// the payload being [u8 live][u16 key size][key][u16 value size][value]. A record that is not live is a tombstone.
+	template <typename Key, typename Value, typename Serializer>
+	class DeltaWriter
+	{
+	public:
+
+		// value is nullptr for a tombstone
+		void add(const Key& key, const Value* value)
+		{
+			const std::size_t frame_begin = buffer.size();
+			buffer.resize(frame_begin + delta_frame_size);
+
+			MILI::serialize_into(buffer, static_cast<std::uint8_t>(value != nullptr));
+			MILI::serialize_sized_into<Serializer>(buffer, key);
+
+			if (value)
+				MILI::serialize_sized_into<Serializer>(buffer, *value);
+			else
+				MILI::serialize_into(buffer, std::uint16_t{});
+
+			const std::span<const std::byte> payload{buffer.data() + frame_begin + delta_frame_size, buffer.size() - frame_begin - delta_frame_size};
+			const auto frame = MILI::serialize(static_cast<std::uint32_t>(payload.size()), MILI::crc32c(payload));
+			std::copy(frame.begin(), frame.end(), buffer.begin() + frame_begin);
+		}
+
+		[[nodiscard]]
+		std::size_t size() const noexcept
+		{
+			return buffer.size();
+		}
+
+		// writes the records at offset, anything past it is a torn write and gets cut off. offset 0 starts a new delta file
+		bool append(const std::string& fragment_path, std::uint32_t generation, std::size_t offset) noexcept
+		{
+			const int fd = open((fragment_path + ".delta").c_str(), O_WRONLY | O_CREAT, 0644);
+
+			if (fd < 0)
+				return false;
+
+			if (offset == 0)
+			{
+				const std::array<char, 4> magic{'M', 'I', 'L', 'D'};
+				const auto header = MILI::serialize(magic, generation);
+				buffer.insert(buffer.begin(), header.begin(), header.end());
+			}
+
+			bool ret = ftruncate(fd, offset) == 0 and write_synced(fd, buffer, offset);
+
+			return close(fd) == 0 and ret;
+		}
+
+	private:
+
+		std::vector<std::byte> buffer;
+	};
+
+	// Read-only view of a fragment served straight out of a memory mapping.
+	// Opening a version 2 or 3 fragment only decodes its index, a lookup binary searches the first keys of the blocks and
+	// decodes the one block the key can be in. A block's checksum is verified the first time it is read, a compressed block
+	// is inflated then too and the copy is kept for as long as the fragment stays mapped.
+	// A damaged block reads as missing, it is counted in metrics::corrupt_blocks and by damaged(), and the engine refuses
+	// to load the fragment into a bucket so it is never written back without those records.
+	// Version 1 fragments get an index built by walking their records once, they are rewritten in the current version on their next flush.
+	// The delta of the fragment is read into memory and shadows the mapped records.
+	template <typename Key, typename Value, typename Serializer>
+	class MappedBucket
+	{
+	public:
+
+		// a record is addressed by its block and its byte offset in the records of the block, which are the file itself
+		// unless the block is compressed
+		struct Position
+		{
+			std::size_t block;
+			std::size_t offset;
+
+			friend bool operator<(const Position& lhs, const Position& rhs) noexcept
+			{
+				return std::tie(lhs.block, lhs.offset) < std::tie(rhs.block, rhs.offset);
+			}
+		};
+
+		MappedBucket(const MappedBucket&) = delete;
+		MappedBucket& operator=(const MappedBucket&) = delete;
+
+		explicit MappedBucket(const std::string& path) noexcept
+		{
+			const int fd = open(path.c_str(), O_RDONLY);
+
+			if (fd < 0)
+				return;
+
+			struct stat info{};
+
+			if (fstat(fd, &info) == 0 and static_cast<std::size_t>(info.st_size) > fragment_header_size)
+			{
+				void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+				if (addr != MAP_FAILED)
+				{
+					mapping = static_cast<const std::byte*>(addr);
+					length = info.st_size;
+				}
+			}
+
+			// the mapping keeps the file alive
+			close(fd);
+
+			if (not mapping)
+				return;
+
+			Header header{};
+			std::array<std::byte, fragment_header_size> raw_header{};
+			std::copy_n(mapping, raw_header.size(), raw_header.begin());
+
+			bool opened = header.construct(raw_header);
+
+			if (opened and header.version == 0)
+				opened = index_records();
+			else
+				opened = opened and header.version >= 2 and header.version <= fragment_version and read_index(header.version);
+
+			if (not opened)
+			{
+				corrupt = true;
+				unmap();
+				return;
+			}
+
+			version = header.version;
+			generation = header.generation;
+
+			if (version >= 2)
+				read_delta(path + ".delta");
+		}
+
+		// records appended after the fragment was written, nullopt marks a removal
+		[[nodiscard]]
+		const std::map<Key, std::optional<Value>>& changes() const noexcept
+		{
+			return delta;
+		}
+
+		// the size of the intact part of the delta file, 0 if there is none for this fragment
+		[[nodiscard]]
+		std::size_t delta_bytes() const noexcept
+		{
+			return delta_length;
+		}
+
+		[[nodiscard]]
+		std::size_t bytes() const noexcept
+		{
+			return length;
+		}
+
+		// the mapping, the index and the decoded delta, compressed blocks count as if they were inflated
+		[[nodiscard]]
+		std::size_t memory_usage() const noexcept
+		{
+			constexpr std::size_t node_overhead = 4 * sizeof(void*);
+			std::size_t total = sizeof(*this) + length + delta.size() * (sizeof(typename decltype(delta)::value_type) + node_overhead);
+
+			for (const auto& block : blocks)
+				total += sizeof(Block) + (block.codec == Compression::None ? 0 : block.records_size);
+
+			return total;
+		}
+
+		[[nodiscard]]
+		std::uint32_t get_generation() const noexcept
+		{
+			return generation;
+		}
+
+		// version 1 fragments and missing ones can't take a delta, they have to be written in full first
+		[[nodiscard]]
+		bool takes_delta() const noexcept
+		{
+			return mapping and version >= 2;
+		}
+
+		// false if the fragment exists but could not be decoded, a missing fragment is simply empty
+		[[nodiscard]]
+		bool valid() const noexcept
+		{
+			return not corrupt;
+		}
+
+		// blocks read so far that failed their checksum or didn't inflate, their records read as missing
+		[[nodiscard]]
+		std::size_t damaged() const noexcept
+		{
+			return damaged_blocks.load(std::memory_order_relaxed);
+		}
+
+		[[nodiscard]]
+		std::optional<Value> read(const Key& key) const noexcept
+		{
+			if (auto itr = delta.find(key); itr != delta.end())
+				return itr->second;
+
+			// decoding a key that owns memory allocates, for those the records are compared as bytes
+			if constexpr (not std::is_trivially_copyable_v<Key>)
+				return find_serialized(key);
+
+			const Position position = lower_bound(key);
+
+			if (position.block == blocks.size() or key_at(position) != key)
+				return std::nullopt;
+
+			return Serializer::template deserialize<Value>(value_at(position));
+		}
+
+		// the first record whose key is not less than key
+		[[nodiscard]]
+		Position lower_bound(const Key& key) const noexcept
+		{
+			return search(key, [&](const Key& current) { return current < key; });
+		}
+
+		// the first record whose key is greater than key
+		[[nodiscard]]
+		Position upper_bound(const Key& key) const noexcept
+		{
+			return search(key, [&](const Key& current) { return not (key < current); });
+		}
+
+		[[nodiscard]]
+		Position begin() const noexcept
+		{
+			return enter(0);
+		}
+
+		[[nodiscard]]
+		Position end() const noexcept
+		{
+			return Position{blocks.size(), records_end};
+		}
+
+		// a block that fails its checksum ends the walk
+		[[nodiscard]]
+		Position next(Position position) const noexcept
+		{
+			const std::byte* records = records_of(position.block);
+			const std::size_t value_offset = position.offset + 2 + size_at(records, position.offset);
+			position.offset = value_offset + 2 + size_at(records, value_offset);
+
+			if (position.offset < records_begin(position.block) + blocks[position.block].records_size)
+				return position;
+
+			return enter(position.block + 1);
+		}
+
+		[[nodiscard]]
+		Key key_at(Position position) const noexcept
+		{
+			return decode_key(records_of(position.block), position.offset);
+		}
+
+		// valid while the fragment is mapped
+		[[nodiscard]]
+		std::span<const std::byte> value_at(Position position) const noexcept
+		{
+			const std::byte* records = records_of(position.block);
+			const std::size_t value_offset = position.offset + 2 + size_at(records, position.offset);
+			return std::span<const std::byte>{records + value_offset + 2, size_at(records, value_offset)};
+		}
+
+		// asks the kernel to start reading the whole fragment in, so later lookups don't fault on the disk one page at a time
+		void prefetch() const noexcept
+		{
+			if (mapping)
+				madvise(const_cast<std::byte*>(mapping), length, MADV_WILLNEED);
+		}
+
+		// verifies every block, used before the whole fragment is loaded into a bucket
+		[[nodiscard]]
+		bool verify() const noexcept
+		{
+			for (std::size_t block = 0; block < blocks.size(); ++block)
+				if (not verified(block))
+					return false;
+
+			return true;
+		}
+
+		[[nodiscard]]
+		std::size_t size() const noexcept
+		{
+			return entries;
+		}
+
+		~MappedBucket() noexcept
+		{
+			unmap();
+		}
+
+	private:
+
+		// a block is sealed once it outgrows the block size, so it ends with at most one record past it
+		constexpr static std::size_t max_block_records = FragmentWriter<Key, Value, Serializer>::block_size + 2 * (sizeof(std::uint16_t) + max_sized_bytes);
+
+		enum class BlockState : std::uint8_t
+		{
+			Unchecked,
+			Intact, // its checksum matched and it inflated, if it is compressed
+			Damaged
+		};
+
+		struct Block
+		{
+			std::size_t offset;
+			std::size_t size; // as stored
+			std::uint32_t crc;
+			std::size_t records_size; // once inflated
+			Compression codec;
+			Key first;
+		};
+
+		template <typename F>
+		[[nodiscard]]
+		Position search(const Key& key, F&& before) const noexcept
+		{
+			if (blocks.empty())
+				return end();
+
+			const std::size_t block = block_of(key);
+
+			for (Position position = enter(block); position.block == block; position = next(position))
+				if (not before(key_at(position)))
+					return position;
+
+			return enter(block + 1);
+		}
+
+		// the last block starting at or before the key is the only one that can hold it
+		[[nodiscard]]
+		std::size_t block_of(const Key& key) const noexcept
+		{
+			auto itr = std::partition_point(blocks.begin(), blocks.end(), [&](const Block& block) { return not (key < block.first); });
+			return itr == blocks.begin() ? 0 : itr - blocks.begin() - 1;
+		}
+
+		// the key is serialized once and the records of its block are matched against it, equal keys serialize to equal bytes
+		[[nodiscard]]
+		std::optional<Value> find_serialized(const Key& key) const noexcept
+		{
+			thread_local std::vector<std::byte> serialized;
+			serialized.clear();
+
+			if (blocks.empty() or not MILI::serialize_sized_into<Serializer>(serialized, key))
+				return std::nullopt;
+
+			const std::size_t block = block_of(key);
+			const std::span<const std::byte> wanted{serialized.begin() + sizeof(std::uint16_t), serialized.end()};
+
+			for (Position position = enter(block); position.block == block; position = next(position))
+			{
+				const std::byte* records = records_of(block);
+
+				if (size_at(records, position.offset) == wanted.size() and std::ranges::equal(wanted, std::span{records + position.offset + sizeof(std::uint16_t), wanted.size()}))
+					return Serializer::template deserialize<Value>(value_at(position));
+			}
+
+			return std::nullopt;
+		}
+
+		// the position of the first record of block, or end() if there is no such block or it is corrupt
+		[[nodiscard]]
+		Position enter(std::size_t block) const noexcept
+		{
+			if (block >= blocks.size() or not verified(block))
+				return end();
+
+			return Position{block, records_begin(block)};
+		}
+
+		[[nodiscard]]
+		std::size_t records_begin(std::size_t block) const noexcept
+		{
+			return blocks[block].codec == Compression::None ? blocks[block].offset : 0;
+		}
+
+		// a block must have been verified, which inflates it if it is compressed
+		[[nodiscard]]
+		const std::byte* records_of(std::size_t block) const noexcept
+		{
+			return blocks[block].codec == Compression::None ? mapping : inflated[block].load(std::memory_order_acquire);
+		}
+
+		[[nodiscard]]
+		bool verified(std::size_t block) const noexcept
+		{
+			switch (checked[block].load(std::memory_order_acquire))
+			{
+				case BlockState::Intact:
+					return true;
+				case BlockState::Damaged:
+					return false;
+				default:
+					break;
+			}
+
+			const auto& info = blocks[block];
+
+			const std::span<const std::byte> stored{mapping + info.offset, info.size};
+
+			if (MILI::crc32c(stored) != info.crc)
+				return damage(block);
+
+			if (info.codec != Compression::None)
+			{
+				auto records = std::make_unique_for_overwrite<std::byte[]>(info.records_size);
+
+				if (not decompress(info.codec, stored, std::span<std::byte>{records.get(), info.records_size}))
+					return damage(block);
+
+				// readers racing on the same block keep whichever copy got in first
+				std::byte* expected = nullptr;
+
+				if (inflated[block].compare_exchange_strong(expected, records.get(), std::memory_order_acq_rel))
+					records.release();
+			}
+
+			checked[block].store(BlockState::Intact, std::memory_order_release);
+			return true;
+		}
+
+		// the block reads as missing from now on, it is counted once however many readers run into it
+		bool damage(std::size_t block) const noexcept
+		{
+			auto unchecked = BlockState::Unchecked;
+
+			if (checked[block].compare_exchange_strong(unchecked, BlockState::Damaged, std::memory_order_acq_rel))
+			{
+				metrics::corrupt_blocks.add();
+				damaged_blocks.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			return false;
+		}
+
+		bool read_index(std::uint16_t fragment_format) noexcept
+		{
+			if (length < fragment_header_size + fragment_trailer_size)
+				return false;
+
+			const std::size_t trailer = length - fragment_trailer_size;
+			const auto index_offset = integral_at<std::uint64_t>(trailer);
+			entries = integral_at<std::uint64_t>(trailer + sizeof(std::uint64_t));
+			const auto count = integral_at<std::uint32_t>(trailer + 2 * sizeof(std::uint64_t));
+			const std::size_t crc_offset = trailer + 2 * sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+			if (index_offset < fragment_header_size or index_offset > trailer)
+				return false;
+
+			// before version 4 only the index is covered, the sizes below keep its damaged counts from being trusted
+			const std::size_t covered = (fragment_format >= 4 ? crc_offset : trailer) - index_offset;
+
+			if (MILI::crc32c(std::span<const std::byte>{mapping + index_offset, covered}) != integral_at<std::uint32_t>(crc_offset))
+				return false;
+
+			// version 3 adds the size of the records and the codec in front of the first key
+			const bool compressible = fragment_format >= 3;
+			const std::size_t fixed = 4 * sizeof(std::uint32_t) + sizeof(std::uint16_t) + (compressible ? sizeof(std::uint32_t) + sizeof(std::uint8_t) : 0);
+
+			if (count > (trailer - index_offset) / fixed)
+				return false;
+
+			blocks.reserve(count);
+			records_end = index_offset;
+
+			std::size_t indexed = 0;
+
+			for (std::size_t offset = index_offset; blocks.size() < count;)
+			{
+				if (offset + fixed > trailer)
+					return false;
+
+				Block block{integral_at<std::uint32_t>(offset), integral_at<std::uint32_t>(offset + 4), integral_at<std::uint32_t>(offset + 8), 0,
+					Compression::None, Key{}};
+				block.records_size = compressible ? integral_at<std::uint32_t>(offset + 16) : block.size;
+
+				if (compressible)
+					block.codec = static_cast<Compression>(integral_at<std::uint8_t>(offset + 20));
+
+				const std::size_t key_size = size_at(offset + fixed - sizeof(std::uint16_t));
+				const std::size_t block_entries = integral_at<std::uint32_t>(offset + 12);
+
+				if (offset + fixed + key_size > trailer or block.offset < fragment_header_size or block.offset + block.size > index_offset)
+					return false;
+
+				if (block.codec > Compression::Zstd or (block.codec == Compression::None and block.records_size != block.size))
+					return false;
+
+				// a compressed block is inflated into records_size bytes, no writer makes one larger than a block and a record
+				if (block.codec != Compression::None and block.records_size > max_block_records)
+					return false;
+
+				// every record takes at least its two sizes
+				if (not block_entries or block_entries > block.records_size / (2 * sizeof(std::uint16_t)))
+					return false;
+
+				block.first = Serializer::template deserialize<Key>(std::span<const std::byte>{mapping + offset + fixed, key_size});
+				blocks.push_back(std::move(block));
+
+				indexed += block_entries;
+				offset += fixed + key_size;
+			}
+
+			// the count is what buckets reserve for when they load the fragment
+			if (indexed != entries)
+				return false;
+
+			checked = std::make_unique<std::atomic<BlockState>[]>(blocks.size());
+			inflated = std::make_unique<std::atomic<std::byte*>[]>(blocks.size());
+
+			return true;
+		}
+
+		void read_delta(const std::string& delta_path) noexcept
+		{
+			const int fd = open(delta_path.c_str(), O_RDONLY);
+
+			if (fd < 0)
+				return;
+
+			struct stat info{};
+			std::vector<std::byte> file;
+
+			if (fstat(fd, &info) == 0)
+			{
+				file.resize(info.st_size);
+
+				if (pread(fd, file.data(), file.size(), 0) != static_cast<ssize_t>(file.size()))
+					file.clear();
+			}
+
+			close(fd);
+
+			auto integral = [&]<std::integral T>(std::size_t offset, T) -> T
+			{
+				return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{file.data() + offset, sizeof(T)});
+			};
+
+			const std::array<std::byte, 4> magic{std::byte{'M'}, std::byte{'I'}, std::byte{'L'}, std::byte{'D'}};
+
+			// a delta of an older generation was already folded into this fragment
+			if (file.size() < delta_header_size or not std::equal(magic.begin(), magic.end(), file.begin())
+				or integral(sizeof(std::uint32_t), std::uint32_t{}) != generation)
+				return;
+
+			std::size_t offset = delta_header_size;
+
+			while (offset + delta_frame_size <= file.size())
+			{
+				const std::size_t payload_size = integral(offset, std::uint32_t{});
+				const std::size_t payload = offset + delta_frame_size;
+
+				if (payload + payload_size > file.size() or payload_size < 5)
+					break;
+
+				if (MILI::crc32c(std::span<const std::byte>{file.data() + payload, payload_size}) != integral(offset + sizeof(std::uint32_t), std::uint32_t{}))
+					break;
+
+				const bool live = file[payload] != std::byte{0};
+				const std::size_t key_size = integral(payload + 1, std::uint16_t{});
+
+				if (3 + key_size + 2 > payload_size)
+					break;
+
+				const std::size_t value_size = integral(payload + 3 + key_size, std::uint16_t{});
+
+				if (3 + key_size + 2 + value_size != payload_size)
+					break;
+
+				Key key = Serializer::template deserialize<Key>(std::span<const std::byte>{file.data() + payload + 3, key_size});
+
+				if (live)
+					delta.insert_or_assign(std::move(key), Serializer::template deserialize<Value>(std::span<const std::byte>{file.data() + payload + 5 + key_size, value_size}));
+				else
+					delta.insert_or_assign(std::move(key), std::nullopt);
+
+				offset = payload + payload_size;
+			}
+
+			delta_length = offset;
+		}
+
+		// version 1 has no index, one is made by cutting the records into blocks of about the same size as version 2 uses
+		bool index_records() noexcept
+		{
+			constexpr std::size_t block_size = FragmentWriter<Key, Value, Serializer>::block_size;
+
+			std::size_t offset = fragment_header_size;
+
+			while (offset + 2 <= length)
+			{
+				const std::size_t key_size = size_at(offset);
+				const std::size_t value_offset = offset + 2 + key_size;
+
+				if (not key_size or value_offset + 2 > length)
+					break;
+
+				const std::size_t next = value_offset + 2 + size_at(value_offset);
+
+				if (next > length)
+					break;
+
+				// buckets flush their ordered container, so version 1 records are already sorted
+				if (blocks.empty() or offset - blocks.back().offset >= block_size)
+					blocks.push_back(Block{offset, 0, 0, 0, Compression::None, decode_key(mapping, offset)});
+
+				blocks.back().size = next - blocks.back().offset;
+				blocks.back().records_size = blocks.back().size;
+				++entries;
+				offset = next;
+			}
+
+			records_end = offset;
+			checked = std::make_unique<std::atomic<BlockState>[]>(blocks.size());
+
+			// there is no checksum to verify
+			for (std::size_t block = 0; block < blocks.size(); ++block)
+				checked[block].store(BlockState::Intact, std::memory_order_relaxed);
+
+			return true;
+		}
+
+		[[nodiscard]]
+		Key decode_key(const std::byte* records, std::size_t offset) const noexcept
+		{
+			return Serializer::template deserialize<Key>(std::span<const std::byte>{records + offset + 2, size_at(records, offset)});
+		}
+
+		template <std::integral T>
+		[[nodiscard]]
+		T integral_at(std::size_t offset) const noexcept
+		{
+			return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{mapping + offset, sizeof(T)});
+		}
+
+		[[nodiscard]]
+		std::uint16_t size_at(std::size_t offset) const noexcept
+		{
+			return integral_at<std::uint16_t>(offset);
+		}
+
+		[[nodiscard]]
+		static std::uint16_t size_at(const std::byte* records, std::size_t offset) noexcept
+		{
+			return MILI::deserialize<std::uint16_t>(std::span<const std::byte, sizeof(std::uint16_t)>{records + offset, sizeof(std::uint16_t)});
+		}
+
+		void unmap() noexcept
+		{
+			if (mapping)
+				munmap(const_cast<std::byte*>(mapping), length);
+
+			if (inflated)
+				for (std::size_t block = 0; block < blocks.size(); ++block)
+					delete[] inflated[block].load(std::memory_order_relaxed);
+
+			mapping = nullptr;
+			length = 0;
+			inflated.reset();
+			blocks.clear();
+			records_end = 0;
+			entries = 0;
+		}
+
+		const std::byte* mapping = nullptr;
+		std::size_t length = 0;
+		std::size_t records_end = 0;
+		std::size_t entries = 0;
+		std::uint16_t version = 0;
+		std::uint32_t generation = 0;
+		std::map<Key, std::optional<Value>> delta;
+		std::size_t delta_length = 0;
+		std::vector<Block> blocks;
+		std::unique_ptr<std::atomic<BlockState>[]> checked;
+		mutable std::atomic<std::size_t> damaged_blocks{0};
+		std::unique_ptr<std::atomic<std::byte*>[]> inflated; // the records of the compressed blocks read so far
+		bool corrupt = false;
+	};
+
+}
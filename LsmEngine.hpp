@@ -0,0 +1,1190 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#include "Vault.hpp"
+#include "BloomFilter.hpp"
+
+namespace MILI::Database::details
+{
+
+// Immutable sorted run of an LSM tree, served out of a read-only mapping.
+// Layout: [magic "MILS"][u32 reserved][records][u64 offset per record][u32 crc32c per block][bloom filter]
+//     trailer: [u64 count][u64 index offset][u64 checksums offset][u64 bloom offset][u32 crc32c of everything from the index on]
+// Record: [u8 live][u16 key size][key][u16 value size][value], a record that is not live is a tombstone.
+// Every block_records records form a block whose checksum is verified the first time one of them is read, the records
+// of a damaged block read as missing and are counted in metrics::corrupt_blocks.
+// Runs written before the checksums ("MILR": [u32 count] after the magic, u32 offsets, [u64 index offset][u64 bloom offset]
+// as the trailer) stay readable until compaction rewrites them.
+template <typename Key, typename Value, typename Serializer>
+class SortedRun
+{
+public:
+
+	constexpr static std::size_t block_records = 64;
+	constexpr static std::size_t trailer_size = 4 * sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+	// Streams the records into <path>.tmp as they are added, only the index, the checksums and the filter are kept in
+	// memory until finish() appends them and moves the file over path. A writer that isn't finished removes its file.
+	class Writer
+	{
+	public:
+
+		constexpr static std::size_t spill_bytes = 256 * 1024; // the records are written out in pieces of about this size
+
+		Writer(std::string run_path, std::size_t expected_records)
+			: path{std::move(run_path)}, filter{expected_records}, fd{::open((path + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)}
+		{
+			const std::array<char, 4> magic{'M', 'I', 'L', 'S'};
+			put(MILI::serialize(magic, std::uint32_t{}));
+		}
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		void add(const Key& key, const std::optional<Value>& value)
+		{
+			if (offsets.size() % block_records == 0 and not offsets.empty())
+			{
+				checksums.push_back(block_crc);
+				block_crc = 0;
+			}
+
+			const std::size_t record = buffer.size();
+			offsets.push_back(static_cast<std::uint64_t>(written + record));
+			filter.insert(std::hash<Key>{}(key));
+
+			MILI::serialize_into(buffer, static_cast<std::uint8_t>(value.has_value()));
+			MILI::serialize_sized_into<Serializer>(buffer, key);
+
+			if (value)
+				MILI::serialize_sized_into<Serializer>(buffer, *value);
+			else
+				MILI::serialize_into(buffer, std::uint16_t{});
+
+			block_crc = MILI::crc32c(std::span<const std::byte>{buffer.data() + record, buffer.size() - record}, block_crc);
+
+			if (buffer.size() >= spill_bytes)
+				spill();
+		}
+
+		[[nodiscard]]
+		std::size_t size() const noexcept
+		{
+			return offsets.size();
+		}
+
+		bool finish()
+		{
+			if (not offsets.empty())
+				checksums.push_back(block_crc);
+
+			// the tail is checksummed as it is put, the trailer covers it
+			std::uint32_t tail_crc = 0;
+			auto put_tail = [&](const std::ranges::range auto& bytes)
+			{
+				const std::size_t begin = buffer.size();
+				put(bytes);
+				tail_crc = MILI::crc32c(std::span<const std::byte>{buffer.data() + begin, buffer.size() - begin}, tail_crc);
+			};
+
+			const auto index_offset = static_cast<std::uint64_t>(written + buffer.size());
+			put_tail(MILI::serialize(offsets));
+
+			const auto checksums_offset = static_cast<std::uint64_t>(written + buffer.size());
+			put_tail(MILI::serialize(checksums));
+
+			const auto bloom_offset = static_cast<std::uint64_t>(written + buffer.size());
+			put_tail(filter.serialize());
+
+			put(MILI::serialize(static_cast<std::uint64_t>(offsets.size()), index_offset, checksums_offset, bloom_offset, tail_crc));
+			spill();
+
+			const bool synced = healthy and fdatasync(fd) == 0;
+			const bool closed = close(fd) == 0;
+			fd = -1;
+
+			return synced and closed and rename((path + ".tmp").c_str(), path.c_str()) == 0;
+		}
+
+		~Writer() noexcept
+		{
+			if (fd < 0)
+				return;
+
+			close(fd);
+			unlink((path + ".tmp").c_str());
+		}
+
+	private:
+
+		void put(const std::ranges::range auto& bytes)
+		{
+			buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		}
+
+		// writes the buffer at the end of the file, a failure is reported by finish()
+		void spill() noexcept
+		{
+			healthy = healthy and fd >= 0;
+
+			for (std::size_t done = 0; healthy and done < buffer.size();)
+			{
+				const ssize_t count = pwrite(fd, buffer.data() + done, buffer.size() - done, written + done);
+
+				if (count < 0 and errno != EINTR)
+					healthy = false;
+				else if (count > 0)
+					done += count;
+			}
+
+			written += buffer.size();
+			buffer.clear();
+		}
+
+		std::string path;
+		std::vector<std::byte> buffer; // not written yet
+		std::vector<std::uint64_t> offsets;
+		std::vector<std::uint32_t> checksums; // of the blocks sealed so far
+		std::uint32_t block_crc = 0; // of the records of the block being written
+		BloomFilter filter;
+		int fd;
+		std::size_t written = 0; // bytes already in the file
+		bool healthy = true;
+	};
+
+	SortedRun(const SortedRun&) = delete;
+	SortedRun& operator=(const SortedRun&) = delete;
+
+	[[nodiscard]]
+	static std::shared_ptr<SortedRun> open(std::string path, std::uint64_t sequence)
+	{
+		std::shared_ptr<SortedRun> run{new SortedRun{std::move(path), sequence}};
+
+		if (not run->mapping)
+			return nullptr;
+
+		return run;
+	}
+
+	// outer optional: whether the run knows the key, inner optional: nullopt for a tombstone
+	[[nodiscard]]
+	std::optional<std::optional<Value>> find(const Key& key) const noexcept
+	{
+		if (not filter.contains(std::hash<Key>{}(key)))
+			return std::nullopt;
+
+		const std::size_t index = lower_bound(key);
+
+		if (index == count or not readable(index) or key_at(index) != key)
+			return std::nullopt;
+
+		return std::optional{value_at(index)};
+	}
+
+	// index of the first record whose key is not less than key
+	[[nodiscard]]
+	std::size_t lower_bound(const Key& key) const noexcept
+	{
+		return partition([&](const Key& current) { return current < key; });
+	}
+
+	// index of the first record whose key is greater than key
+	[[nodiscard]]
+	std::size_t upper_bound(const Key& key) const noexcept
+	{
+		return partition([&](const Key& current) { return not (key < current); });
+	}
+
+	// false if the block of the record failed its checksum, key_at and value_at may only be called on readable records
+	[[nodiscard]]
+	bool readable(std::size_t index) const noexcept
+	{
+		return verified(index / block_records);
+	}
+
+	[[nodiscard]]
+	Key key_at(std::size_t index) const noexcept
+	{
+		const std::size_t offset = offset_at(index);
+		return Serializer::template deserialize<Key>(std::span<const std::byte>{mapping + offset + 3, size_at(offset + 1)});
+	}
+
+	[[nodiscard]]
+	std::optional<Value> value_at(std::size_t index) const noexcept
+	{
+		const std::size_t offset = offset_at(index);
+
+		if (mapping[offset] == std::byte{0})
+			return std::nullopt;
+
+		const std::size_t value_offset = offset + 3 + size_at(offset + 1);
+		return Serializer::template deserialize<Value>(std::span<const std::byte>{mapping + value_offset + 2, size_at(value_offset)});
+	}
+
+	[[nodiscard]]
+	std::size_t size() const noexcept
+	{
+		return count;
+	}
+
+	[[nodiscard]]
+	std::size_t bytes() const noexcept
+	{
+		return length;
+	}
+
+	[[nodiscard]]
+	std::uint64_t get_sequence() const noexcept
+	{
+		return sequence;
+	}
+
+	// the file is removed once the last reader lets go of the run
+	void retire() noexcept
+	{
+		retired = true;
+	}
+
+	~SortedRun() noexcept
+	{
+		unmap();
+
+		if (retired)
+			unlink(path.c_str());
+	}
+
+private:
+
+	enum class BlockState : std::uint8_t
+	{
+		Unchecked,
+		Intact,
+		Damaged
+	};
+
+	SortedRun(std::string file_path, std::uint64_t seq) noexcept : path{std::move(file_path)}, sequence{seq}
+	{
+		const int fd = ::open(path.c_str(), O_RDONLY);
+
+		if (fd < 0)
+			return;
+
+		struct stat info{};
+
+		if (fstat(fd, &info) == 0 and static_cast<std::size_t>(info.st_size) >= 8 + 2 * sizeof(std::uint64_t))
+		{
+			void* addr = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (addr != MAP_FAILED)
+			{
+				mapping = static_cast<const std::byte*>(addr);
+				length = info.st_size;
+			}
+		}
+
+		close(fd);
+
+		if (not mapping)
+			return;
+
+		const auto magic = MILI::deserialize<char, 4>(std::span<const std::byte, 4>{mapping, 4});
+		const bool opened = magic == std::array<char, 4>{'M', 'I', 'L', 'S'} ? read_tail()
+			: magic == std::array<char, 4>{'M', 'I', 'L', 'R'} and read_legacy_tail();
+
+		if (not opened)
+			unmap();
+	}
+
+	bool read_tail() noexcept
+	{
+		if (length < 8 + trailer_size)
+			return false;
+
+		const std::size_t trailer = length - trailer_size;
+
+		count = integral_at<std::uint64_t>(trailer);
+		index_offset = integral_at<std::uint64_t>(trailer + sizeof(std::uint64_t));
+		checksums_offset = integral_at<std::uint64_t>(trailer + 2 * sizeof(std::uint64_t));
+		const auto bloom_offset = integral_at<std::uint64_t>(trailer + 3 * sizeof(std::uint64_t));
+
+		const std::size_t blocks = (count + block_records - 1) / block_records;
+
+		if (index_offset > trailer or count > (trailer - index_offset) / sizeof(std::uint64_t)
+			or checksums_offset != index_offset + count * sizeof(std::uint64_t)
+			or bloom_offset != checksums_offset + blocks * sizeof(std::uint32_t) or bloom_offset > trailer)
+			return false;
+
+		if (MILI::crc32c(std::span<const std::byte>{mapping + index_offset, trailer - index_offset}) != integral_at<std::uint32_t>(trailer + 4 * sizeof(std::uint64_t)))
+			return false;
+
+		offset_width = sizeof(std::uint64_t);
+		checked = std::make_unique<std::atomic<BlockState>[]>(blocks);
+		filter = BloomFilter::deserialize(std::span<const std::byte>{mapping + bloom_offset, trailer - bloom_offset});
+
+		return true;
+	}
+
+	bool read_legacy_tail() noexcept
+	{
+		count = integral_at<std::uint32_t>(4);
+		index_offset = integral_at<std::uint64_t>(length - 2 * sizeof(std::uint64_t));
+		const auto bloom_offset = integral_at<std::uint64_t>(length - sizeof(std::uint64_t));
+
+		if (bloom_offset > length or index_offset + count * sizeof(std::uint32_t) > bloom_offset)
+			return false;
+
+		offset_width = sizeof(std::uint32_t);
+		filter = BloomFilter::deserialize(std::span<const std::byte>{mapping + bloom_offset, length - 2 * sizeof(std::uint64_t) - bloom_offset});
+
+		// there is no checksum to verify
+		const std::size_t blocks = (count + block_records - 1) / block_records;
+		checked = std::make_unique<std::atomic<BlockState>[]>(blocks);
+
+		for (std::size_t block = 0; block < blocks; ++block)
+			checked[block].store(BlockState::Intact, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	void unmap() noexcept
+	{
+		if (mapping)
+			munmap(const_cast<std::byte*>(mapping), length);
+
+		mapping = nullptr;
+	}
+
+	[[nodiscard]]
+	bool verified(std::size_t block) const noexcept
+	{
+		switch (checked[block].load(std::memory_order_acquire))
+		{
+			case BlockState::Intact:
+				return true;
+			case BlockState::Damaged:
+				return false;
+			default:
+				break;
+		}
+
+		const std::size_t begin = offset_at(block * block_records);
+		const std::size_t end = (block + 1) * block_records < count ? offset_at((block + 1) * block_records) : index_offset;
+		const bool intact = begin <= end and end <= index_offset
+			and MILI::crc32c(std::span<const std::byte>{mapping + begin, end - begin}) == integral_at<std::uint32_t>(checksums_offset + block * sizeof(std::uint32_t));
+
+		// counted once however many readers run into it
+		auto unchecked = BlockState::Unchecked;
+
+		if (checked[block].compare_exchange_strong(unchecked, intact ? BlockState::Intact : BlockState::Damaged, std::memory_order_acq_rel) and not intact)
+			metrics::corrupt_blocks.add();
+
+		return intact;
+	}
+
+	// the records of a damaged block count as coming before any key, the caller checks the record it lands on
+	template <typename F>
+	[[nodiscard]]
+	std::size_t partition(F&& before) const noexcept
+	{
+		std::size_t low = 0, high = count;
+
+		while (low < high)
+		{
+			const std::size_t mid = low + (high - low) / 2;
+
+			if (not readable(mid) or before(key_at(mid)))
+				low = mid + 1;
+			else
+				high = mid;
+		}
+
+		return low;
+	}
+
+	template <std::integral T>
+	[[nodiscard]]
+	T integral_at(std::size_t offset) const noexcept
+	{
+		return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{mapping + offset, sizeof(T)});
+	}
+
+	[[nodiscard]]
+	std::size_t offset_at(std::size_t index) const noexcept
+	{
+		if (offset_width == sizeof(std::uint32_t))
+			return integral_at<std::uint32_t>(index_offset + index * sizeof(std::uint32_t));
+
+		return integral_at<std::uint64_t>(index_offset + index * sizeof(std::uint64_t));
+	}
+
+	[[nodiscard]]
+	std::uint16_t size_at(std::size_t offset) const noexcept
+	{
+		return integral_at<std::uint16_t>(offset);
+	}
+
+	std::string path;
+	std::uint64_t sequence;
+	const std::byte* mapping = nullptr;
+	std::size_t length = 0;
+	std::size_t count = 0;
+	std::size_t index_offset = 0;
+	std::size_t checksums_offset = 0;
+	std::size_t offset_width = sizeof(std::uint64_t);
+	std::unique_ptr<std::atomic<BlockState>[]> checked;
+	BloomFilter filter;
+	bool retired = false;
+};
+
+
+// One log-structured merge tree per table: a memtable in front of leveled sorted runs.
+// Level 0 holds whole memtables in flush order, every deeper level is a single run about ten times larger than the one above.
+// Writes are blind, insert/update/remove only touch the memtable.
+template <typename Key, typename Value, typename Serializer>
+class LsmTree
+{
+	using run_t = SortedRun<Key, Value, Serializer>;
+
+public:
+
+	constexpr static std::size_t level0_runs = 4;
+	constexpr static std::size_t level1_bytes = 8 * 1024 * 1024;
+	constexpr static std::size_t level_ratio = 10;
+
+	// Ordered walk over a key range of the tree as it was when the cursor was made.
+	// The memtable range is copied, the runs are held on to so compaction can't delete them underneath.
+	class Cursor
+	{
+	public:
+
+		[[nodiscard]]
+		bool valid() const noexcept
+		{
+			return current.has_value();
+		}
+
+		[[nodiscard]]
+		const Key& key() const noexcept
+		{
+			return current->first;
+		}
+
+		[[nodiscard]]
+		Value value() const noexcept
+		{
+			return current->second;
+		}
+
+		void next() noexcept
+		{
+			advance();
+		}
+
+	private:
+
+		friend class LsmTree;
+
+		struct Source
+		{
+			std::shared_ptr<run_t> run;
+			std::size_t position;
+			std::size_t end;
+			Key key{};
+
+			// the records of a damaged block are skipped
+			void decode() noexcept
+			{
+				while (position < end and not run->readable(position))
+					++position;
+
+				if (position < end)
+					key = run->key_at(position);
+			}
+		};
+
+		// the smallest key among the sources wins, the newest source holding it decides between a value and a tombstone
+		void advance() noexcept
+		{
+			while (true)
+			{
+				const Key* smallest = nullptr;
+
+				if (memtable_position < memtable.size())
+					smallest = &memtable[memtable_position].first;
+
+				for (const auto& source : runs)
+					if (source.position < source.end and (not smallest or source.key < *smallest))
+						smallest = &source.key;
+
+				if (not smallest)
+				{
+					current.reset();
+					return;
+				}
+
+				const Key key = *smallest;
+				std::optional<std::optional<Value>> newest;
+
+				if (memtable_position < memtable.size() and memtable[memtable_position].first == key)
+					newest = memtable[memtable_position++].second;
+
+				// runs are ordered newest first, like in read()
+				for (auto& source : runs)
+				{
+					if (source.position < source.end and source.key == key)
+					{
+						if (not newest)
+							newest = source.run->value_at(source.position);
+
+						++source.position;
+						source.decode();
+					}
+				}
+
+				if (*newest)
+				{
+					current.emplace(key, **newest);
+					return;
+				}
+			}
+		}
+
+		std::vector<std::pair<Key, std::optional<Value>>> memtable;
+		std::size_t memtable_position = 0;
+		std::vector<Source> runs;
+		std::optional<std::pair<Key, Value>> current;
+	};
+
+	bool insert(const Key& key, Value value)
+	{
+		std::unique_lock lock{mutex};
+		memtable.insert_or_assign(key, std::optional{std::move(value)});
+		return true;
+	}
+
+	bool update(const Key& key, Value value)
+	{
+		std::unique_lock lock{mutex};
+		memtable.insert_or_assign(key, std::optional{std::move(value)});
+		return true;
+	}
+
+	bool remove(const Key& key)
+	{
+		std::unique_lock lock{mutex};
+		memtable.insert_or_assign(key, std::nullopt);
+		return true;
+	}
+
+	[[nodiscard]]
+	std::optional<Value> read(const Key& key) const noexcept
+	{
+		bool from_memtable = false;
+		return read(key, from_memtable);
+	}
+
+	// from_memtable tells whether the memtable answered, the key isn't looked up a second time to find out
+	[[nodiscard]]
+	std::optional<Value> read(const Key& key, bool& from_memtable) const noexcept
+	{
+		std::shared_lock lock{mutex};
+
+		from_memtable = false;
+
+		if (auto itr = memtable.find(key); itr != memtable.end())
+		{
+			from_memtable = true;
+			return itr->second;
+		}
+
+		// newer levels shadow older ones, inside level 0 the newest run comes first
+		for (const auto& level : levels)
+			for (const auto& run : level)
+				if (auto found = run->find(key))
+					return *found;
+
+		return std::nullopt;
+	}
+
+	[[nodiscard]]
+	Cursor scan(const Key& low, const Key& high) const
+	{
+		Cursor cursor;
+
+		if (high < low)
+			return cursor;
+
+		{
+			std::shared_lock lock{mutex};
+
+			cursor.memtable.assign(memtable.lower_bound(low), memtable.upper_bound(high));
+
+			for (const auto& level : levels)
+				for (const auto& run : level)
+					cursor.runs.push_back(typename Cursor::Source{run, run->lower_bound(low), run->upper_bound(high)});
+		}
+
+		for (auto& source : cursor.runs)
+			source.decode();
+
+		cursor.advance();
+
+		return cursor;
+	}
+
+	// writes the memtable out as the newest level 0 run
+	bool flush() noexcept
+	{
+		// only the checkpointing thread writes to the memtable, readers may go on while it is written out
+		std::shared_lock shared{mutex};
+
+		if (memtable.empty())
+			return true;
+
+		// a tree that was only read has no directory, it appears with the first run. The table's own is made by the checkpoint
+		mkdir(directory.c_str(), 0777);
+
+		const std::uint64_t sequence = next_sequence++;
+		typename run_t::Writer writer{run_path(sequence), memtable.size()};
+
+		for (const auto& [key, value] : memtable)
+			writer.add(key, value);
+
+		shared.unlock();
+
+		if (not writer.finish())
+			return false;
+
+		auto run = run_t::open(run_path(sequence), sequence);
+
+		if (not run)
+			return false;
+
+		std::lock_guard lock{mutex};
+
+		levels[0].insert(levels[0].begin(), std::move(run));
+		memtable.clear();
+		stalled = false;
+
+		return write_manifest();
+	}
+
+	[[nodiscard]]
+	std::size_t get_id() const noexcept
+	{
+		return id;
+	}
+
+	[[nodiscard]]
+	std::string_view get_name() const noexcept
+	{
+		return table_name;
+	}
+
+	[[nodiscard]]
+	bool is_dirty() const noexcept
+	{
+		std::shared_lock lock{mutex};
+		return not memtable.empty();
+	}
+
+	[[nodiscard]]
+	std::size_t memory_usage() const noexcept
+	{
+		constexpr std::size_t node_overhead = 4 * sizeof(void*);
+		std::shared_lock lock{mutex};
+		return sizeof(*this) + memtable.size() * (sizeof(typename decltype(memtable)::value_type) + node_overhead);
+	}
+
+	~LsmTree() noexcept
+	{
+		flush();
+	}
+
+private:
+
+	template <typename K, typename V, typename Serializer_, std::size_t BucketSize>
+	friend class LsmEngine;
+
+	LsmTree(std::string_view db, std::string_view tbl_name, std::size_t tree_id) : table_name{tbl_name}, id{tree_id}
+	{
+		directory = database_path + std::string{db} + "/" + table_name + "/lsm" + std::to_string(id);
+
+		levels.resize(1);
+		read_manifest();
+	}
+
+	[[nodiscard]]
+	bool needs_compaction() const noexcept
+	{
+		std::shared_lock lock{mutex};
+		return not stalled and pick_level().has_value();
+	}
+
+	// runs on the engine's compaction thread. A merge that failed would fail the same way on the same inputs,
+	// the tree isn't picked again until a flush changes its levels
+	bool compact() noexcept
+	{
+		if (merge())
+			return true;
+
+		std::lock_guard lock{mutex};
+		stalled = true;
+
+		return false;
+	}
+
+	// merges one level into the next
+	bool merge() noexcept
+	{
+		std::vector<std::shared_ptr<run_t>> inputs;
+		std::size_t level = 0;
+		bool bottom = false;
+
+		{
+			std::lock_guard lock{mutex};
+
+			const auto picked = pick_level();
+
+			if (not picked)
+				return true;
+
+			level = *picked;
+
+			// newest first so the first run holding a key wins
+			inputs = levels[level];
+			if (level + 1 < levels.size())
+				inputs.insert(inputs.end(), levels[level + 1].begin(), levels[level + 1].end());
+
+			bottom = level + 2 >= levels.size();
+		}
+
+		std::size_t expected = 0;
+		for (const auto& run : inputs)
+			expected += run->size();
+
+		// the output goes to the file as it is merged, only its index and filter are held in memory
+		const std::uint64_t sequence = next_sequence++;
+		typename run_t::Writer writer{run_path(sequence), expected};
+		std::vector<std::size_t> cursors(inputs.size(), 0);
+
+		while (true)
+		{
+			std::optional<Key> smallest;
+			std::size_t winner = 0;
+
+			for (std::size_t i = 0; i < inputs.size(); ++i)
+			{
+				if (cursors[i] == inputs[i]->size())
+					continue;
+
+				// the inputs stay in place rather than being merged without the records of a damaged block
+				if (not inputs[i]->readable(cursors[i]))
+					return false;
+
+				auto key = inputs[i]->key_at(cursors[i]);
+
+				if (not smallest or key < *smallest)
+				{
+					smallest = std::move(key);
+					winner = i;
+				}
+			}
+
+			if (not smallest)
+				break;
+
+			auto value = inputs[winner]->value_at(cursors[winner]);
+
+			// tombstones only need to survive while an older level could still hold the key
+			if (value or not bottom)
+				writer.add(*smallest, value);
+
+			for (std::size_t i = 0; i < inputs.size(); ++i)
+				if (cursors[i] != inputs[i]->size() and inputs[i]->key_at(cursors[i]) == *smallest)
+					++cursors[i];
+		}
+
+		std::shared_ptr<run_t> output;
+
+		if (writer.size())
+		{
+			if (not writer.finish())
+				return false;
+
+			output = run_t::open(run_path(sequence), sequence);
+
+			if (not output)
+				return false;
+		}
+
+		std::lock_guard lock{mutex};
+
+		if (levels.size() < level + 2)
+			levels.resize(level + 2);
+
+		// level 0 may have received new runs while merging, only the merged ones go away
+		std::erase_if(levels[level], [&](const auto& run) { return std::ranges::find(inputs, run) != inputs.end(); });
+		levels[level + 1].clear();
+
+		if (output)
+			levels[level + 1].push_back(std::move(output));
+
+		for (auto& run : inputs)
+			run->retire();
+
+		return write_manifest();
+	}
+
+	[[nodiscard]]
+	std::optional<std::size_t> pick_level() const noexcept
+	{
+		if (levels[0].size() >= level0_runs)
+			return 0;
+
+		std::size_t budget = level1_bytes;
+
+		for (std::size_t level = 1; level < levels.size(); ++level, budget *= level_ratio)
+		{
+			std::size_t bytes = 0;
+			for (const auto& run : levels[level])
+				bytes += run->bytes();
+
+			if (bytes > budget)
+				return level;
+		}
+
+		return std::nullopt;
+	}
+
+	[[nodiscard]]
+	std::string run_path(std::uint64_t sequence) const
+	{
+		return directory + "/" + std::to_string(sequence) + ".run";
+	}
+
+	// [u64 next sequence][u32 level count] then per level [u32 run count][u64 sequence per run]
+	bool write_manifest() noexcept
+	{
+		std::vector<std::byte> buffer;
+		auto put = [&](const std::ranges::range auto& bytes) { buffer.insert(buffer.end(), bytes.begin(), bytes.end()); };
+
+		put(MILI::serialize(next_sequence.load(), static_cast<std::uint32_t>(levels.size())));
+
+		for (const auto& level : levels)
+		{
+			put(MILI::serialize(static_cast<std::uint32_t>(level.size())));
+
+			for (const auto& run : level)
+				put(MILI::serialize(run->get_sequence()));
+		}
+
+		const std::string path = directory + "/MANIFEST";
+		return commit_file(path, buffer);
+	}
+
+	void read_manifest() noexcept
+	{
+		FILE* file = fopen((directory + "/MANIFEST").c_str(), "rb");
+
+		if (not file)
+			return;
+
+		auto read_integral = [&]<std::integral T>(T& out) -> bool
+		{
+			std::array<std::byte, sizeof(T)> raw{};
+
+			if (fread(raw.data(), sizeof(std::byte), raw.size(), file) != raw.size())
+				return false;
+
+			out = MILI::deserialize<T>(raw);
+			return true;
+		};
+
+		std::uint64_t sequence = 0;
+		std::uint32_t level_count = 0;
+
+		if (read_integral(sequence) and read_integral(level_count))
+		{
+			next_sequence = sequence;
+			levels.resize(std::max<std::size_t>(level_count, 1));
+
+			for (std::uint32_t level = 0; level < level_count; ++level)
+			{
+				std::uint32_t run_count = 0;
+
+				if (not read_integral(run_count))
+					break;
+
+				for (std::uint32_t i = 0; i < run_count; ++i)
+				{
+					std::uint64_t run_sequence = 0;
+
+					if (not read_integral(run_sequence))
+						break;
+
+					if (auto run = run_t::open(run_path(run_sequence), run_sequence))
+						levels[level].push_back(std::move(run));
+				}
+			}
+		}
+
+		fclose(file);
+	}
+
+	std::string table_name;
+	std::size_t id;
+	std::string directory;
+
+	std::map<Key, std::optional<Value>> memtable;
+
+	mutable std::shared_mutex mutex; // guards the memtable and levels, readers only share it
+	std::vector<std::vector<std::shared_ptr<run_t>>> levels;
+	std::atomic<std::uint64_t> next_sequence = 0;
+	bool stalled = false; // the last compaction of these levels failed
+};
+
+
+// Storage engine keeping every table in a single LSM tree, selected with Vault<Key, Value, Serializer, details::LsmEngine>.
+// Flushing a tree writes only its memtable, the runs are merged by a background compaction thread.
+template <typename Key, typename Value, typename Serializer, std::size_t BucketSize = 1>
+class LsmEngine
+{
+	using tree_t = LsmTree<Key, Value, Serializer>;
+	using bucket_id = std::pair<std::string, std::size_t>;
+
+	struct State
+	{
+		std::mutex mutex; // guards the compactor and stopping
+		std::condition_variable wake;
+		std::shared_mutex trees_mutex;
+		std::map<bucket_id, std::unique_ptr<tree_t>> trees;
+		std::thread compactor;
+		bool stopping = false;
+	};
+
+	std::string db_name;
+	std::unique_ptr<State> state = std::make_unique<State>();
+	std::atomic<std::size_t> memory_budget;
+	std::atomic<std::size_t> hits = 0;
+	std::atomic<std::size_t> misses = 0;
+
+public:
+
+	// the runs are sorted and bloom filtered, so there is nothing to gain from partitioning a table
+	constexpr static std::size_t bucket_size = 1;
+	constexpr static bool splits_buckets = false;
+	constexpr static std::size_t default_memory_budget = 64 * 1024 * 1024;
+
+	explicit LsmEngine(std::string_view name, std::size_t budget = default_memory_budget) noexcept : db_name{name}, memory_budget{budget}
+	{}
+
+	bool integrity_check() noexcept
+	{
+		// check if a folder named /MILI/Vault/ exists
+		DIR* dir = opendir(database_path);
+
+		if (not dir)
+			return false;
+
+		closedir(dir);
+
+		return true;
+	}
+
+	void construct() noexcept
+	{
+		for (auto dir : {"/MILI", "/MILI/Vault"})
+			mkdir(dir, 0777);
+	}
+
+	// the tree is owned by the engine for its whole lifetime, nullptr is never returned
+	// checkpoint workers write to different trees at the same time, so only the tree being handed out is flushed here
+	auto get_bucket(std::string_view table_name, std::size_t bucket_number) noexcept -> tree_t*
+	{
+		auto& found = tree(table_name, bucket_number);
+
+		// write-heavy tables must not grow their memtables past the budget before the next flush
+		if (memory_usage() > memory_budget)
+			found.flush();
+
+		return &found;
+	}
+
+	[[nodiscard]]
+	std::optional<Value> read(std::string_view table_name, std::size_t bucket_number, const Key& key) noexcept
+	{
+		bool from_memtable = false;
+		auto ret = tree(table_name, bucket_number).read(key, from_memtable);
+
+		++(from_memtable ? hits : misses);
+
+		return ret;
+	}
+
+	// the tree is found once for a batch of point reads, reads is called with a function answering a single key
+	template <typename F>
+	void read_batch(std::string_view table_name, std::size_t bucket_number, F&& reads) noexcept
+	{
+		auto& found = tree(table_name, bucket_number);
+
+		reads([&](const Key& key)
+		{
+			bool from_memtable = false;
+			auto ret = found.read(key, from_memtable);
+			++(from_memtable ? hits : misses);
+
+			return ret;
+		});
+	}
+
+	// opens the tree and its runs ahead of the reads that will need them
+	void prefetch(std::string_view table_name, std::size_t bucket_number) noexcept
+	{
+		tree(table_name, bucket_number);
+	}
+
+	[[nodiscard]]
+	auto scan(std::string_view table_name, std::size_t bucket_number, const Key& low, const Key& high) -> typename tree_t::Cursor
+	{
+		return tree(table_name, bucket_number).scan(low, high);
+	}
+
+	// writes every memtable out as a level 0 run and lets the compactor catch up in the background
+	bool flush() noexcept
+	{
+		bool ret = true;
+
+		{
+			std::shared_lock lock{state->trees_mutex};
+
+			for (auto& [id, tree] : state->trees)
+				ret = tree->flush() and ret;
+		}
+
+		{
+			std::lock_guard lock{state->mutex};
+
+			if (not state->compactor.joinable())
+				state->compactor = std::thread{[shared = state.get()] { compaction_loop(*shared); }};
+		}
+
+		state->wake.notify_one();
+
+		return ret;
+	}
+
+	void set_memory_budget(std::size_t budget) noexcept
+	{
+		memory_budget = budget;
+	}
+
+	// sorted runs are stored uncompressed
+	void set_compression(std::string_view, Compression) noexcept
+	{}
+
+	[[nodiscard]]
+	BufferPoolStats stats() const noexcept
+	{
+		BufferPoolStats ret;
+		ret.hits = hits;
+		ret.misses = misses;
+		ret.memory = memory_usage();
+
+		std::shared_lock lock{state->trees_mutex};
+		ret.resident = state->trees.size();
+
+		return ret;
+	}
+
+	~LsmEngine() noexcept
+	{
+		if (not state)
+			return;
+
+		{
+			std::lock_guard lock{state->mutex};
+			state->stopping = true;
+		}
+
+		state->wake.notify_one();
+
+		if (state->compactor.joinable())
+			state->compactor.join();
+	}
+
+private:
+
+	tree_t& tree(std::string_view table_name, std::size_t bucket_number)
+	{
+		bucket_id id{table_name, bucket_number};
+
+		{
+			std::shared_lock lock{state->trees_mutex};
+
+			if (auto itr = state->trees.find(id); itr != state->trees.end())
+				return *itr->second;
+		}
+
+		std::unique_lock lock{state->trees_mutex};
+		auto itr = state->trees.find(id);
+
+		if (itr == state->trees.end())
+			itr = state->trees.emplace(std::move(id), std::unique_ptr<tree_t>{new tree_t{db_name, table_name, bucket_number}}).first;
+
+		return *itr->second;
+	}
+
+	[[nodiscard]]
+	std::size_t memory_usage() const noexcept
+	{
+		std::shared_lock lock{state->trees_mutex};
+
+		std::size_t total = 0;
+		for (const auto& [id, tree] : state->trees)
+			total += tree->memory_usage();
+
+		return total;
+	}
+
+	static void compaction_loop(State& shared) noexcept
+	{
+		std::unique_lock lock{shared.mutex};
+
+		while (not shared.stopping)
+		{
+			std::vector<tree_t*> pending;
+
+			{
+				std::shared_lock trees_lock{shared.trees_mutex};
+
+				for (auto& [id, tree] : shared.trees)
+					if (tree->needs_compaction())
+						pending.push_back(tree.get());
+			}
+
+			if (pending.empty())
+			{
+				shared.wake.wait_for(lock, std::chrono::seconds{1});
+				continue;
+			}
+
+			// trees are never dropped while the engine is alive, the merge itself runs without the engine lock
+			lock.unlock();
+
+			for (auto* tree : pending)
+				tree->compact();
+
+			lock.lock();
+		}
+	}
+};
+
+}
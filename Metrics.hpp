@@ -0,0 +1,373 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+// Set MILI_METRICS to 0 to compile every recording call down to nothing
+#ifndef MILI_METRICS
+#define MILI_METRICS 1
+#endif
+
+// Counters and latency histograms for the hot paths, rendered in the Prometheus text format by render().
+// Every thread records into its own cache line with a relaxed add. Only a scrape reads all of them,
+// so leaving metrics on costs an increment per counter and two clock reads per timed operation.
+namespace MILI::Database::metrics
+{
+
+	constexpr std::size_t shard_count = 16;
+
+	// threads are spread over the shards in the order they first record something
+	inline std::size_t shard() noexcept
+	{
+		static std::atomic<std::size_t> next{0};
+		thread_local const std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % shard_count;
+
+		return index;
+	}
+
+	class Counter;
+	class Histogram;
+
+	// every metric registers itself on construction, in order of definition, and lives until the program exits
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<const Counter*> counters;
+		std::vector<const Histogram*> histograms;
+	};
+
+	inline Registry& registry()
+	{
+		static Registry instance;
+		return instance;
+	}
+
+	class Counter
+	{
+	public:
+
+		// labels are written as they appear between the braces, e.g. operation="read"
+		Counter(std::string_view metric_name, std::string_view metric_help, std::string_view metric_labels = {})
+			: name{metric_name}, help{metric_help}, labels{metric_labels}
+		{
+			std::lock_guard lock{registry().mutex};
+			registry().counters.push_back(this);
+		}
+
+		Counter(const Counter&) = delete;
+		Counter& operator=(const Counter&) = delete;
+
+		void add([[maybe_unused]] std::uint64_t count = 1) noexcept
+		{
+#if MILI_METRICS
+			shards[shard()].value.fetch_add(count, std::memory_order_relaxed);
+#endif
+		}
+
+		[[nodiscard]]
+		std::uint64_t value() const noexcept
+		{
+			std::uint64_t total = 0;
+
+			for (const auto& shard : shards)
+				total += shard.value.load(std::memory_order_relaxed);
+
+			return total;
+		}
+
+		std::string_view name;
+		std::string_view help;
+		std::string_view labels;
+
+	private:
+
+		struct alignas(64) Shard
+		{
+			std::atomic<std::uint64_t> value{0};
+		};
+
+		std::array<Shard, shard_count> shards;
+	};
+
+	// Latencies in nanoseconds, bucketed like an HDR histogram.
+	// Values below 2^sub_bits are counted exactly. Above that, every power of two is split into 2^sub_bits
+	// equal buckets, which keeps the error of a quantile under 1 / 2^sub_bits of its value.
+	class Histogram
+	{
+	public:
+
+		constexpr static unsigned sub_bits = 3;
+		constexpr static std::uint64_t sub_count = 1 << sub_bits;
+		constexpr static unsigned max_exponent = 40; // about 18 minutes, longer values land in the last bucket
+		constexpr static std::size_t bucket_count = (max_exponent - sub_bits + 2) * sub_count;
+
+		// the bounds exported to Prometheus, powers of two from about a microsecond to 17 seconds
+		constexpr static unsigned min_exported_exponent = 10;
+		constexpr static unsigned max_exported_exponent = 34;
+
+		Histogram(std::string_view metric_name, std::string_view metric_help, std::string_view metric_labels = {})
+			: name{metric_name}, help{metric_help}, labels{metric_labels}
+		{
+			std::lock_guard lock{registry().mutex};
+			registry().histograms.push_back(this);
+		}
+
+		Histogram(const Histogram&) = delete;
+		Histogram& operator=(const Histogram&) = delete;
+
+		void record([[maybe_unused]] std::chrono::nanoseconds duration) noexcept
+		{
+#if MILI_METRICS
+			const std::uint64_t value = std::max<std::int64_t>(duration.count(), 0);
+			auto& shard = shards[metrics::shard()];
+
+			shard.counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+			shard.sum.fetch_add(value, std::memory_order_relaxed);
+#endif
+		}
+
+		[[nodiscard]]
+		constexpr static std::size_t index(std::uint64_t value) noexcept
+		{
+			if (value < sub_count)
+				return value;
+
+			const unsigned exponent = std::bit_width(value) - 1;
+
+			if (exponent > max_exponent)
+				return bucket_count - 1;
+
+			return (exponent - sub_bits + 1) * sub_count + ((value >> (exponent - sub_bits)) & (sub_count - 1));
+		}
+
+		// the smallest value that falls into the bucket
+		[[nodiscard]]
+		constexpr static std::uint64_t lower_bound(std::size_t bucket) noexcept
+		{
+			if (bucket < sub_count)
+				return bucket;
+
+			const unsigned exponent = bucket / sub_count + sub_bits - 1;
+			return (sub_count + bucket % sub_count) << (exponent - sub_bits);
+		}
+
+		[[nodiscard]]
+		std::array<std::uint64_t, bucket_count> counts() const noexcept
+		{
+			std::array<std::uint64_t, bucket_count> total{};
+
+			for (const auto& shard : shards)
+				for (std::size_t i = 0; i < bucket_count; ++i)
+					total[i] += shard.counts[i].load(std::memory_order_relaxed);
+
+			return total;
+		}
+
+		[[nodiscard]]
+		std::chrono::nanoseconds sum() const noexcept
+		{
+			std::uint64_t total = 0;
+
+			for (const auto& shard : shards)
+				total += shard.sum.load(std::memory_order_relaxed);
+
+			return std::chrono::nanoseconds{total};
+		}
+
+		// the upper bound of the bucket holding the q-th quantile, q in [0, 1]
+		[[nodiscard]]
+		std::chrono::nanoseconds quantile(double q) const noexcept
+		{
+			const auto buckets = counts();
+			std::uint64_t total = 0;
+
+			for (auto count : buckets)
+				total += count;
+
+			if (total == 0)
+				return {};
+
+			const auto rank = static_cast<std::uint64_t>(q * static_cast<double>(total - 1));
+			std::uint64_t seen = 0;
+
+			for (std::size_t i = 0; i + 1 < bucket_count; ++i)
+			{
+				seen += buckets[i];
+
+				if (seen > rank)
+					return std::chrono::nanoseconds{lower_bound(i + 1) - 1};
+			}
+
+			return std::chrono::nanoseconds{lower_bound(bucket_count - 1)};
+		}
+
+		std::string_view name;
+		std::string_view help;
+		std::string_view labels;
+
+	private:
+
+		struct alignas(64) Shard
+		{
+			std::array<std::atomic<std::uint64_t>, bucket_count> counts{};
+			std::atomic<std::uint64_t> sum{0};
+		};
+
+		std::array<Shard, shard_count> shards;
+	};
+
+	// records the time from its construction to its destruction
+	class Timer
+	{
+		using clock = std::chrono::steady_clock;
+
+	public:
+
+		explicit Timer(Histogram& target) noexcept : histogram{target}
+		{
+#if MILI_METRICS
+			start = clock::now();
+#endif
+		}
+
+		Timer(const Timer&) = delete;
+		Timer& operator=(const Timer&) = delete;
+
+		~Timer() noexcept
+		{
+#if MILI_METRICS
+			histogram.record(clock::now() - start);
+#endif
+		}
+
+	private:
+
+		Histogram& histogram;
+		clock::time_point start{};
+	};
+
+	namespace details
+	{
+		// metrics sharing a name form one family, its HELP and TYPE lines are written before the first of them
+		inline void family_header(std::string& out, std::string_view& last, std::string_view name, std::string_view help, std::string_view type)
+		{
+			if (name == last)
+				return;
+
+			last = name;
+			((((out += "# HELP ") += name) += ' ') += help) += '\n';
+			((((out += "# TYPE ") += name) += ' ') += type) += '\n';
+		}
+
+		inline void sample(std::string& out, std::string_view name, std::string_view suffix, std::string_view labels, std::string_view extra_label, std::string_view value)
+		{
+			(out += name) += suffix;
+
+			if (not labels.empty() or not extra_label.empty())
+			{
+				out += '{';
+				out += labels;
+
+				if (not labels.empty() and not extra_label.empty())
+					out += ',';
+
+				(out += extra_label) += '}';
+			}
+
+			((out += ' ') += value) += '\n';
+		}
+
+		inline std::string seconds(std::uint64_t nanoseconds)
+		{
+			char buffer[32];
+			std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(nanoseconds) / 1e9);
+
+			return buffer;
+		}
+	}
+
+	// every registered metric in the Prometheus text exposition format, latencies in seconds
+	inline std::string render()
+	{
+		std::lock_guard lock{registry().mutex};
+
+		std::string out;
+		std::string_view last;
+
+		for (const Counter* counter : registry().counters)
+		{
+			details::family_header(out, last, counter->name, counter->help, "counter");
+			details::sample(out, counter->name, "", counter->labels, "", std::to_string(counter->value()));
+		}
+
+		for (const Histogram* histogram : registry().histograms)
+		{
+			details::family_header(out, last, histogram->name, histogram->help, "histogram");
+
+			const auto buckets = histogram->counts();
+			std::uint64_t cumulative = 0;
+			std::size_t bucket = 0;
+
+			for (unsigned exponent = Histogram::min_exported_exponent; exponent <= Histogram::max_exported_exponent; ++exponent)
+			{
+				const std::uint64_t bound = std::uint64_t{1} << exponent;
+
+				for (; bucket < Histogram::bucket_count and Histogram::lower_bound(bucket) < bound; ++bucket)
+					cumulative += buckets[bucket];
+
+				details::sample(out, histogram->name, "_bucket", histogram->labels, "le=\"" + details::seconds(bound) + "\"", std::to_string(cumulative));
+			}
+
+			for (; bucket < Histogram::bucket_count; ++bucket)
+				cumulative += buckets[bucket];
+
+			details::sample(out, histogram->name, "_bucket", histogram->labels, "le=\"+Inf\"", std::to_string(cumulative));
+			details::sample(out, histogram->name, "_sum", histogram->labels, "", details::seconds(histogram->sum().count()));
+			details::sample(out, histogram->name, "_count", histogram->labels, "", std::to_string(cumulative));
+		}
+
+		return out;
+	}
+
+
+	// what the store records about itself
+
+	inline Histogram table_operations_read{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"read\""};
+	inline Histogram table_operations_insert{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"insert\""};
+	inline Histogram table_operations_update{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"update\""};
+	inline Histogram table_operations_remove{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"remove\""};
+	inline Histogram table_operations_scan{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"scan\""};
+	inline Histogram table_operations_multi_read{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"multi_read\""};
+	inline Histogram table_operations_multi_insert{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"multi_insert\""};
+	inline Histogram table_operations_multi_update{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"multi_update\""};
+	inline Histogram table_operations_multi_remove{"vault_table_operation_seconds", "Time spent in Table operations", "operation=\"multi_remove\""};
+
+	inline Counter buffer_pool_hits{"vault_buffer_pool_hits_total", "Bucket lookups served by a resident bucket"};
+	inline Counter buffer_pool_misses{"vault_buffer_pool_misses_total", "Bucket lookups that went to the fragment"};
+	inline Histogram bucket_loads{"vault_bucket_load_seconds", "Time to read a bucket into the buffer pool"};
+
+	inline Histogram bucket_flushes{"vault_bucket_flush_seconds", "Time to write a dirty bucket to its fragment"};
+	inline Counter fragment_bytes{"vault_fragment_bytes_written_total", "Bytes written to fragments and their deltas"};
+	inline Histogram checkpoints{"vault_checkpoint_seconds", "Time to apply the cache to the fragments"};
+	inline Counter bucket_splits{"vault_bucket_splits_total", "Buckets split to grow their table"};
+	inline Counter corrupt_blocks{"vault_corrupt_blocks_total", "Fragment blocks that failed their checksum, their records read as missing"};
+
+	inline Histogram wal_commits{"vault_wal_commit_seconds", "Time to write and sync a group of log records"};
+	inline Counter wal_bytes{"vault_wal_bytes_written_total", "Bytes written to the write-ahead log"};
+	inline Counter wal_rejected{"vault_wal_rejected_records_total", "Mutations refused because a key or value didn't fit in a record"};
+
+	inline Histogram websocket_messages{"vault_websocket_message_seconds", "Time to execute a WebSocket message"};
+	inline Counter websocket_bytes_received{"vault_websocket_bytes_total", "Bytes of WebSocket messages", "direction=\"received\""};
+	inline Counter websocket_bytes_sent{"vault_websocket_bytes_total", "Bytes of WebSocket messages", "direction=\"sent\""};
+
+}
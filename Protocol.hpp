@@ -0,0 +1,453 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <span>
+#include <algorithm>
+
+#include "Serializer.hpp"
+
+namespace MILI::Database::Protocol
+{
+
+// Binary framing for the WebSocket server, sent as WEBSOCKET_OP_BINARY messages.
+// Request frame:  [u8 version][u32 count] followed by count requests
+//     request:    [u32 id][u8 opcode][u16 table size][table][u16 key size][key][u16 value size][value]
+//     scan:       [u32 id][u8 opcode][u16 table size][table][u16 key size][low][u16 key size][high][u32 limit]
+// Response frame: [u8 version][u8 status][u32 count] followed by count responses, in request order
+//     response:   [u32 id][u8 status][u8 has key]([u16 key size][key])[u8 has value]([u16 value size][value])
+// Values are only carried by inserts, updates and reads that found their key, otherwise their size is 0. In a response
+// the key and the value are only there when their flag is set, so an empty one is told apart from a missing one.
+// A scan answers with one response per row carrying its key and value, then one without a key that ends it:
+// Ok once the range is exhausted, Truncated if limit rows were sent before that. The server sends at most max_scan_rows
+// rows per scan, which is also what a limit of 0 asks for. A client pages through a longer range by scanning again from
+// just past the last key it got.
+
+constexpr std::uint8_t version = 2;
+
+// the whole response frame is built in memory, so a single scan can't make it grow with the size of the table
+constexpr std::uint32_t max_scan_rows = 4096;
+
+enum class Opcode : std::uint8_t
+{
+	Insert,
+	Update,
+	Remove,
+	Read,
+	Scan
+};
+
+enum class Status : std::uint8_t
+{
+	Failed,    // the operation returned false or the key was not found
+	Ok,
+	Malformed, // the frame could not be decoded, no request in it was executed
+	Truncated  // the scan stopped at its limit, or at max_scan_rows, before the end of its range
+};
+
+template <typename Key, typename Value>
+struct Request
+{
+	std::uint32_t id{};
+	Opcode opcode{};
+	std::string table;
+	Key key{};
+	Value value{};
+	Key high{};              // scans only
+	std::uint32_t limit{};   // scans only, 0 for as many rows as the server sends at once
+};
+
+template <typename Key, typename Value>
+struct Response
+{
+	std::uint32_t id{};
+	Status status{};
+	std::optional<Value> value;
+	std::optional<Key> key;  // scan rows only
+};
+
+template <typename Key, typename Value, typename Serializer>
+class Codec
+{
+public:
+
+	[[nodiscard]]
+	static std::vector<std::byte> encode(std::span<const Request<Key, Value>> requests)
+	{
+		Writer writer;
+		writer.put(MILI::serialize(version, static_cast<std::uint32_t>(requests.size())));
+
+		for (const auto& request : requests)
+		{
+			writer.put(MILI::serialize(request.id, static_cast<std::uint8_t>(request.opcode)));
+			writer.put_sized(std::span{reinterpret_cast<const std::byte*>(request.table.data()), request.table.size()});
+			writer.put_sized(Serializer::serialize(request.key));
+
+			if (request.opcode == Opcode::Scan)
+			{
+				writer.put_sized(Serializer::serialize(request.high));
+				writer.put(MILI::serialize(request.limit));
+			}
+
+			else if (request.opcode == Opcode::Insert or request.opcode == Opcode::Update)
+				writer.put_sized(Serializer::serialize(request.value));
+
+			else
+				writer.put_sized(std::span<const std::byte>{});
+		}
+
+		return std::move(writer.buffer);
+	}
+
+	[[nodiscard]]
+	static std::vector<std::byte> encode(std::span<const Response<Key, Value>> responses, Status status = Status::Ok)
+	{
+		Writer writer;
+		writer.put(MILI::serialize(version, static_cast<std::uint8_t>(status), static_cast<std::uint32_t>(responses.size())));
+
+		for (const auto& response : responses)
+		{
+			writer.put(MILI::serialize(response.id, static_cast<std::uint8_t>(response.status)));
+			writer.put_optional(response.key);
+			writer.put_optional(response.value);
+		}
+
+		return std::move(writer.buffer);
+	}
+
+	[[nodiscard]]
+	static std::optional<std::vector<Request<Key, Value>>> decode_requests(std::span<const std::byte> frame)
+	{
+		Reader reader{frame};
+		std::uint32_t count{};
+
+		if (reader.template take<std::uint8_t>() != version or not reader.take(count))
+			return std::nullopt;
+
+		// every request takes at least 11 bytes, a count that can't fit in the frame is not trusted with an allocation
+		if (count > frame.size() / 11)
+			return std::nullopt;
+
+		std::vector<Request<Key, Value>> requests(count);
+
+		for (auto& request : requests)
+		{
+			std::uint8_t opcode{};
+			std::span<const std::byte> table, key, value;
+
+			if (not reader.take(request.id) or not reader.take(opcode) or opcode > static_cast<std::uint8_t>(Opcode::Scan))
+				return std::nullopt;
+
+			// a scan carries its upper key in place of the value
+			if (not reader.take_sized(table) or not reader.take_sized(key) or not reader.take_sized(value))
+				return std::nullopt;
+
+			request.opcode = static_cast<Opcode>(opcode);
+			const bool has_value = request.opcode == Opcode::Insert or request.opcode == Opcode::Update;
+
+			if (not fits<Key>(key) or (has_value and not fits<Value>(value)))
+				return std::nullopt;
+
+			if (request.opcode == Opcode::Scan)
+			{
+				if (not fits<Key>(value) or not reader.take(request.limit))
+					return std::nullopt;
+
+				request.high = Serializer::template deserialize<Key>(value);
+			}
+
+			request.table.assign(reinterpret_cast<const char*>(table.data()), table.size());
+			request.key = Serializer::template deserialize<Key>(key);
+
+			if (has_value)
+				request.value = Serializer::template deserialize<Value>(value);
+		}
+
+		return requests;
+	}
+
+	// returns the frame status along with the responses
+	[[nodiscard]]
+	static std::optional<std::pair<Status, std::vector<Response<Key, Value>>>> decode_responses(std::span<const std::byte> frame)
+	{
+		Reader reader{frame};
+		std::uint8_t status{};
+		std::uint32_t count{};
+
+		if (reader.template take<std::uint8_t>() != version or not reader.take(status) or not reader.take(count))
+			return std::nullopt;
+
+		// every response takes at least 7 bytes
+		if (count > frame.size() / 7)
+			return std::nullopt;
+
+		std::vector<Response<Key, Value>> responses(count);
+
+		for (auto& response : responses)
+		{
+			std::uint8_t response_status{};
+			std::optional<std::span<const std::byte>> key, value;
+
+			if (not reader.take(response.id) or not reader.take(response_status) or not reader.take_optional(key) or not reader.take_optional(value))
+				return std::nullopt;
+
+			response.status = static_cast<Status>(response_status);
+
+			if ((key and not fits<Key>(*key)) or (value and not fits<Value>(*value)))
+				return std::nullopt;
+
+			if (key)
+				response.key = Serializer::template deserialize<Key>(*key);
+
+			if (value)
+				response.value = Serializer::template deserialize<Value>(*value);
+		}
+
+		return std::pair{static_cast<Status>(status), std::move(responses)};
+	}
+
+private:
+
+	// primitives are copied straight out of the frame, their size must match exactly
+	template <typename T>
+	[[nodiscard]]
+	static bool fits(std::span<const std::byte> bytes) noexcept
+	{
+		if constexpr (Primitive<T>)
+			return bytes.size() == sizeof(T);
+		else
+			return true;
+	}
+
+	struct Writer
+	{
+		std::vector<std::byte> buffer;
+
+		void put(const std::ranges::range auto& bytes)
+		{
+			buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+		}
+
+		void put_sized(const std::ranges::range auto& bytes)
+		{
+			put(MILI::serialize(static_cast<std::uint16_t>(std::ranges::size(bytes))));
+			put(bytes);
+		}
+
+		template <typename T>
+		void put_optional(const std::optional<T>& value)
+		{
+			put(MILI::serialize(static_cast<std::uint8_t>(value.has_value())));
+
+			if (value)
+				put_sized(Serializer::serialize(*value));
+		}
+	};
+
+	struct Reader
+	{
+		std::span<const std::byte> frame;
+		std::size_t offset = 0;
+
+		template <std::integral T>
+		bool take(T& out) noexcept
+		{
+			if (offset + sizeof(T) > frame.size())
+				return false;
+
+			out = MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{frame.data() + offset, sizeof(T)});
+			offset += sizeof(T);
+
+			return true;
+		}
+
+		template <std::integral T>
+		std::optional<T> take() noexcept
+		{
+			T out{};
+
+			if (not take(out))
+				return std::nullopt;
+
+			return out;
+		}
+
+		bool take_sized(std::span<const std::byte>& out) noexcept
+		{
+			std::uint16_t size{};
+
+			if (not take(size) or offset + size > frame.size())
+				return false;
+
+			out = frame.subspan(offset, size);
+			offset += size;
+
+			return true;
+		}
+
+		bool take_optional(std::optional<std::span<const std::byte>>& out) noexcept
+		{
+			std::uint8_t present{};
+
+			if (not take(present) or present > 1)
+				return false;
+
+			if (present)
+				return take_sized(out.emplace());
+
+			out.reset();
+			return true;
+		}
+	};
+};
+
+// answers a run of reads, inserts, updates or removes on one table through the table's batch call of that operation
+template <typename Table, typename Key, typename Value>
+void execute_run(Table& table, std::span<Request<Key, Value>> run, std::vector<Response<Key, Value>>& responses)
+{
+	std::vector<bool> done;
+
+	if (run.front().opcode == Opcode::Read or run.front().opcode == Opcode::Remove)
+	{
+		std::vector<Key> keys;
+		keys.reserve(run.size());
+
+		for (auto& request : run)
+			keys.push_back(std::move(request.key));
+
+		if (run.front().opcode == Opcode::Remove)
+			done = table.multi_remove(keys);
+
+		else
+		{
+			auto values = table.multi_read(keys);
+
+			for (std::size_t i = 0; i < run.size(); ++i)
+				responses.push_back(Response<Key, Value>{run[i].id, values[i] ? Status::Ok : Status::Failed, std::move(values[i]), std::nullopt});
+
+			return;
+		}
+	}
+
+	else
+	{
+		std::vector<std::pair<Key, Value>> entries;
+		entries.reserve(run.size());
+
+		for (auto& request : run)
+			entries.emplace_back(std::move(request.key), std::move(request.value));
+
+		done = run.front().opcode == Opcode::Insert ? table.multi_insert(entries) : table.multi_update(entries);
+	}
+
+	for (std::size_t i = 0; i < run.size(); ++i)
+		responses.push_back(Response<Key, Value>{run[i].id, done[i] ? Status::Ok : Status::Failed, std::nullopt, std::nullopt});
+}
+
+// decodes a request frame, runs every request in it against the vault and encodes the responses as a single frame
+template <typename Vault>
+[[nodiscard]]
+std::vector<std::byte> execute(Vault& vault, std::span<const std::byte> frame)
+{
+	using Key = typename Vault::key_type;
+	using Value = typename Vault::value_type;
+	using codec = Codec<Key, Value, typename Vault::serializer_type>;
+
+	auto requests = codec::decode_requests(frame);
+
+	if (not requests)
+		return codec::encode(std::span<const Response<Key, Value>>{}, Status::Malformed);
+
+	// every bucket the batch will touch starts loading at once instead of one after another as the requests reach them
+	std::map<std::string_view, std::vector<Key>> keys;
+
+	for (const auto& request : *requests)
+		if (request.opcode != Opcode::Scan)
+			keys[request.table].push_back(request.key);
+
+	for (const auto& [table, table_keys] : keys)
+		vault.table(table).prefetch(table_keys);
+
+	std::vector<Response<Key, Value>> responses;
+	responses.reserve(requests->size());
+
+	for (std::size_t i = 0; i < requests->size(); ++i)
+	{
+		auto& request = (*requests)[i];
+		auto table = vault.table(request.table);
+
+		// consecutive requests of the same kind on one table run as a batch, which visits each of their buckets once
+		std::size_t end = i + 1;
+
+		if (request.opcode != Opcode::Scan)
+			while (end < requests->size() and (*requests)[end].opcode == request.opcode and (*requests)[end].table == request.table)
+				++end;
+
+		if (end - i > 1)
+		{
+			execute_run(table, std::span{*requests}.subspan(i, end - i), responses);
+			i = end - 1;
+			continue;
+		}
+
+		Response<Key, Value> response{request.id, Status::Failed, std::nullopt, std::nullopt};
+
+		bool ok = false;
+
+		switch (request.opcode)
+		{
+			case Opcode::Insert: ok = table.insert(request.key, std::move(request.value));
+				break;
+
+			case Opcode::Update: ok = table.update(request.key, std::move(request.value));
+				break;
+
+			case Opcode::Remove: ok = table.remove(request.key);
+				break;
+
+			case Opcode::Read:
+				response.value = table.read(request.key);
+				ok = response.value.has_value();
+				break;
+
+			case Opcode::Scan:
+			{
+				auto rows = table.scan(request.key, request.high);
+				const std::uint32_t limit = request.limit == 0 ? max_scan_rows : std::min(request.limit, max_scan_rows);
+				std::uint32_t sent = 0;
+
+				for (auto row = rows.next(); row; row = rows.next())
+				{
+					if (sent == limit)
+					{
+						response.status = Status::Truncated;
+						break;
+					}
+
+					responses.push_back(Response<Key, Value>{request.id, Status::Ok, std::move(row->second), std::move(row->first)});
+					++sent;
+				}
+
+				if (response.status == Status::Truncated)
+				{
+					responses.push_back(std::move(response));
+					continue;
+				}
+
+				ok = true;
+				break;
+			}
+		}
+
+		response.status = ok ? Status::Ok : Status::Failed;
+		responses.push_back(std::move(response));
+	}
+
+	return codec::encode(std::span<const Response<Key, Value>>{responses});
+}
+
+}
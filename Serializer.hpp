@@ -1,6 +1,18 @@
+#pragma once
+
+#include <cstdint>
 #include <concepts>
+#include <algorithm>
 #include <array>
+#include <vector>
 #include <span>
+#include <optional>
+#include <bit>
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <limits>
+#include <type_traits>
 
 #include "range/v3/all.hpp"
 
@@ -14,17 +26,57 @@ concept Primitive = requires (std::remove_cvref_t<T> t)
 	requires std::integral<decltype(t)> or std::floating_point<decltype(t)> or std::same_as<decltype(t), std::byte>;
 };
 
+// primitives are stored little endian, big endian hosts swap their bytes on the way in and out
+constexpr bool swaps_bytes = std::endian::native != std::endian::little;
+
+namespace details
+{
+
+	// copies count elements into out in storage order, a single memcpy unless the bytes have to be swapped
+	template <Primitive T>
+	void copy_out(const T* data, std::size_t count, std::byte* out) noexcept
+	{
+		if constexpr (not swaps_bytes or sizeof(T) == 1)
+			std::memcpy(out, data, count * sizeof(T));
+
+		else
+		{
+			// fixed size inner loop without branches, the compiler turns it into vector shuffles
+			const auto* in = reinterpret_cast<const std::byte*>(data);
+
+			for (std::size_t i = 0; i < count * sizeof(T); i += sizeof(T))
+				for (std::size_t b = 0; b < sizeof(T); ++b)
+					out[i + b] = in[i + sizeof(T) - 1 - b];
+		}
+	}
+
+	template <Primitive T>
+	void copy_in(const std::byte* in, std::size_t count, T* data) noexcept
+	{
+		if constexpr (not swaps_bytes or sizeof(T) == 1)
+			std::memcpy(data, in, count * sizeof(T));
+
+		else
+		{
+			auto* out = reinterpret_cast<std::byte*>(data);
+
+			for (std::size_t i = 0; i < count * sizeof(T); i += sizeof(T))
+				for (std::size_t b = 0; b < sizeof(T); ++b)
+					out[i + b] = in[i + sizeof(T) - 1 - b];
+		}
+	}
+
+	template <typename R>
+	concept ContiguousPrimitiveRange = std::ranges::contiguous_range<R> and std::ranges::sized_range<R> and Primitive<std::ranges::range_value_t<R>>;
+
+}
+
 template <Primitive T>
 [[nodiscard]]
 constexpr auto serialize(T&& data) noexcept -> std::array<std::byte, sizeof(T)>
 {
-	constexpr std::size_t Size = sizeof(T);
-	std::array<std::byte, Size> buffer;
-
-	auto&& begin = reinterpret_cast<const std::byte*>(&data);
-	std::span<const std::byte, Size> view{begin, Size};
-
-	std::copy(view.begin(), view.end(), buffer.begin());
+	std::array<std::byte, sizeof(T)> buffer;
+	details::copy_out(&data, 1, buffer.data());
 
 	return buffer;
 }
@@ -34,14 +86,25 @@ constexpr auto serialize(T&& data) noexcept -> std::array<std::byte, sizeof(T)>
 constexpr auto serialize(const std::ranges::range auto& data) noexcept -> std::vector<std::byte>
 requires Primitive<std::ranges::range_value_t<decltype(data)>>
 {
+	using T = std::ranges::range_value_t<decltype(data)>;
 	std::vector<std::byte> buffer;
 
-	std::size_t offset = 0;
-	for (const auto& e : data)
+	if constexpr (details::ContiguousPrimitiveRange<decltype(data)>)
 	{
-		auto&& serialized_data = serialize(e);
-		buffer.insert(buffer.end(), serialized_data.begin(), serialized_data.end());
-		offset += sizeof(serialized_data);
+		buffer.resize(std::ranges::size(data) * sizeof(T));
+		details::copy_out(std::ranges::data(data), std::ranges::size(data), buffer.data());
+	}
+
+	else
+	{
+		if constexpr (std::ranges::sized_range<decltype(data)>)
+			buffer.reserve(std::ranges::size(data) * sizeof(T));
+
+		for (const auto& e : data)
+		{
+			auto&& serialized_data = serialize(e);
+			buffer.insert(buffer.end(), serialized_data.begin(), serialized_data.end());
+		}
 	}
 
 	return buffer;
@@ -52,16 +115,571 @@ template <Primitive T, std::size_t Size>
 constexpr auto serialize(std::span<T, Size> data) noexcept -> std::array<std::byte, sizeof(T) * Size>
 {
 	std::array<std::byte, sizeof(T) * Size> buffer;
+	details::copy_out(data.data(), Size, buffer.data());
+
+	return buffer;
+}
+
+// writes into a caller provided buffer instead of allocating, returns the number of bytes written
+// or nullopt without writing anything if the buffer is too small
+template <Primitive T>
+[[nodiscard]]
+constexpr std::optional<std::size_t> serialize_into(const T& data, std::span<std::byte> buffer) noexcept
+{
+	if (buffer.size() < sizeof(T))
+		return std::nullopt;
 
-	std::size_t offset = 0;
-	for (const auto& e : data)
+	details::copy_out(&data, 1, buffer.data());
+
+	return sizeof(T);
+}
+
+[[nodiscard]]
+constexpr std::optional<std::size_t> serialize_into(const std::ranges::range auto& data, std::span<std::byte> buffer) noexcept
+requires Primitive<std::ranges::range_value_t<decltype(data)>>
+{
+	using T = std::ranges::range_value_t<decltype(data)>;
+
+	if constexpr (details::ContiguousPrimitiveRange<decltype(data)>)
 	{
-		auto&& serialized_data = serialize(e);
-		std::copy(serialized_data.begin(), serialized_data.end(), buffer.begin() + offset);
-		offset += sizeof(serialized_data);
+		const std::size_t size = std::ranges::size(data) * sizeof(T);
+
+		if (buffer.size() < size)
+			return std::nullopt;
+
+		details::copy_out(std::ranges::data(data), std::ranges::size(data), buffer.data());
+
+		return size;
 	}
 
-	return buffer;
+	else
+	{
+		if constexpr (std::ranges::sized_range<decltype(data)>)
+			if (buffer.size() < std::ranges::size(data) * sizeof(T))
+				return std::nullopt;
+
+		std::size_t offset = 0;
+
+		for (const auto& e : data)
+		{
+			if (offset + sizeof(T) > buffer.size())
+				return std::nullopt;
+
+			details::copy_out(&e, 1, buffer.data() + offset);
+			offset += sizeof(T);
+		}
+
+		return offset;
+	}
+}
+
+// Aggregates are serialized field by field in declaration order, their layout is worked out at compile time.
+// Fields are encoded as:
+//     primitives:                 stored little endian like everywhere else
+//     std::array and aggregates:  their elements or fields back to back
+//     std::string, std::vector:   [u32 count] followed by the characters or elements
+// A string or vector serialized on its own has no count, the size of its buffer tells its length.
+// Aggregates whose fields are all fixed size and leave no padding are copied with a single memcpy.
+namespace details
+{
+
+	// converts to any field type, used to count the fields of an aggregate by brace initializing it
+	struct any_field
+	{
+		template <typename T>
+		constexpr operator T() const noexcept;
+	};
+
+	template <typename T, typename ... Fields>
+	consteval std::size_t count_fields() noexcept
+	{
+		if constexpr (requires { T{Fields{}..., any_field{}}; })
+			return count_fields<T, Fields..., any_field>();
+		else
+			return sizeof ... (Fields);
+	}
+
+	constexpr std::size_t max_fields = 16;
+
+	template <typename T>
+	concept Reflectable = std::is_aggregate_v<T> and std::is_class_v<T> and not std::ranges::range<T> and count_fields<T>() <= max_fields;
+
+	template <typename T>
+	concept String = std::same_as<T, std::string>;
+
+	template <typename T>
+	struct container_traits
+	{
+		constexpr static bool is_vector = false;
+		constexpr static bool is_array = false;
+	};
+
+	template <typename T, typename Allocator>
+	struct container_traits<std::vector<T, Allocator>>
+	{
+		using value_type = T;
+		constexpr static bool is_vector = true;
+		constexpr static bool is_array = false;
+	};
+
+	template <typename T, std::size_t Size>
+	struct container_traits<std::array<T, Size>>
+	{
+		using value_type = T;
+		constexpr static bool is_vector = false;
+		constexpr static bool is_array = true;
+		constexpr static std::size_t size = Size;
+	};
+
+	template <typename T>
+	concept Vector = container_traits<T>::is_vector;
+
+	template <typename T>
+	concept Array = container_traits<T>::is_array;
+
+	// references to every field of an aggregate, in declaration order
+	template <typename T>
+	constexpr auto fields(T& data) noexcept
+	{
+		constexpr std::size_t count = count_fields<std::remove_cv_t<T>>();
+
+		if constexpr (count == 0)
+			return std::tuple<>{};
+
+		if constexpr (count == 1)
+		{
+			auto& [f0] = data;
+			return std::tie(f0);
+		}
+
+		else if constexpr (count == 2)
+		{
+			auto& [f0, f1] = data;
+			return std::tie(f0, f1);
+		}
+
+		else if constexpr (count == 3)
+		{
+			auto& [f0, f1, f2] = data;
+			return std::tie(f0, f1, f2);
+		}
+
+		else if constexpr (count == 4)
+		{
+			auto& [f0, f1, f2, f3] = data;
+			return std::tie(f0, f1, f2, f3);
+		}
+
+		else if constexpr (count == 5)
+		{
+			auto& [f0, f1, f2, f3, f4] = data;
+			return std::tie(f0, f1, f2, f3, f4);
+		}
+
+		else if constexpr (count == 6)
+		{
+			auto& [f0, f1, f2, f3, f4, f5] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5);
+		}
+
+		else if constexpr (count == 7)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6);
+		}
+
+		else if constexpr (count == 8)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7);
+		}
+
+		else if constexpr (count == 9)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8);
+		}
+
+		else if constexpr (count == 10)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9);
+		}
+
+		else if constexpr (count == 11)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10);
+		}
+
+		else if constexpr (count == 12)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11);
+		}
+
+		else if constexpr (count == 13)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12);
+		}
+
+		else if constexpr (count == 14)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13);
+		}
+
+		else if constexpr (count == 15)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14);
+		}
+
+		else if constexpr (count == 16)
+		{
+			auto& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15] = data;
+			return std::tie(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15);
+		}
+	}
+
+	template <typename T>
+	using fields_t = decltype(fields(std::declval<T&>()));
+
+	template <typename T>
+	consteval bool supported() noexcept
+	{
+		if constexpr (Primitive<T> or String<T>)
+			return true;
+		else if constexpr (Vector<T> or Array<T>)
+			return supported<typename container_traits<T>::value_type>();
+		else if constexpr (Reflectable<T>)
+			return []<typename ... Fields>(std::type_identity<std::tuple<Fields...>>)
+			{
+				return (supported<std::remove_cvref_t<Fields>>() and ...);
+			}(std::type_identity<fields_t<T>>{});
+		else
+			return false;
+	}
+
+	constexpr std::size_t variable_size = std::numeric_limits<std::size_t>::max();
+
+	// the encoded size of T when it does not depend on the value, variable_size otherwise
+	template <typename T>
+	consteval std::size_t fixed_size() noexcept
+	{
+		if constexpr (Primitive<T>)
+			return sizeof(T);
+
+		else if constexpr (Array<T>)
+		{
+			constexpr std::size_t element = fixed_size<typename container_traits<T>::value_type>();
+			return element == variable_size ? variable_size : element * container_traits<T>::size;
+		}
+
+		else if constexpr (Reflectable<T>)
+		{
+			return []<typename ... Fields>(std::type_identity<std::tuple<Fields...>>)
+			{
+				constexpr std::array<std::size_t, sizeof ... (Fields)> sizes{fixed_size<std::remove_cvref_t<Fields>>()...};
+				std::size_t size = 0;
+
+				for (auto field : sizes)
+				{
+					if (field == variable_size)
+						return variable_size;
+
+					size += field;
+				}
+
+				return size;
+			}(std::type_identity<fields_t<T>>{});
+		}
+
+		else
+			return variable_size;
+	}
+
+	// the in memory representation is exactly the encoded one, no padding and nothing to swap
+	template <typename T>
+	concept TriviallyLaidOut = Reflectable<T> and std::is_trivially_copyable_v<T> and not swaps_bytes and fixed_size<T>() == sizeof(T);
+
+	template <typename T>
+	constexpr std::size_t field_size(const T& data) noexcept
+	{
+		if constexpr (fixed_size<T>() != variable_size)
+			return fixed_size<T>();
+
+		else if constexpr (String<T>)
+			return sizeof(std::uint32_t) + data.size();
+
+		else if constexpr (Vector<T> or Array<T>)
+		{
+			using element = typename container_traits<T>::value_type;
+			std::size_t size = Vector<T> ? sizeof(std::uint32_t) : 0;
+
+			if constexpr (fixed_size<element>() != variable_size)
+				return size + data.size() * fixed_size<element>();
+
+			for (const auto& e : data)
+				size += field_size(e);
+
+			return size;
+		}
+
+		else
+			return std::apply([](const auto& ... field) { return (std::size_t{} + ... + field_size(field)); }, fields(data));
+	}
+
+	// out must have room for field_size(data) bytes
+	template <typename T>
+	void write_field(std::byte*& out, const T& data) noexcept
+	{
+		if constexpr (Primitive<T>)
+		{
+			copy_out(&data, 1, out);
+			out += sizeof(T);
+		}
+
+		else if constexpr (TriviallyLaidOut<T>)
+		{
+			std::memcpy(out, &data, sizeof(T));
+			out += sizeof(T);
+		}
+
+		else if constexpr (String<T>)
+		{
+			write_field(out, static_cast<std::uint32_t>(data.size()));
+			std::memcpy(out, data.data(), data.size());
+			out += data.size();
+		}
+
+		else if constexpr (Vector<T> or Array<T>)
+		{
+			if constexpr (Vector<T>)
+				write_field(out, static_cast<std::uint32_t>(data.size()));
+
+			if constexpr (Primitive<typename container_traits<T>::value_type>)
+			{
+				copy_out(data.data(), data.size(), out);
+				out += data.size() * sizeof(typename container_traits<T>::value_type);
+			}
+
+			else
+				for (const auto& e : data)
+					write_field(out, e);
+		}
+
+		else
+			std::apply([&](const auto& ... field) { (write_field(out, field), ...); }, fields(data));
+	}
+
+	// reads a field written by write_field, false if it runs past end
+	template <typename T>
+	bool read_field(const std::byte*& in, const std::byte* end, T& data)
+	{
+		if constexpr (Primitive<T> or TriviallyLaidOut<T>)
+		{
+			if (static_cast<std::size_t>(end - in) < sizeof(T))
+				return false;
+
+			if constexpr (Primitive<T>)
+				copy_in(in, 1, &data);
+			else
+				std::memcpy(&data, in, sizeof(T));
+
+			in += sizeof(T);
+			return true;
+		}
+
+		else if constexpr (String<T> or Vector<T>)
+		{
+			std::uint32_t count{};
+
+			if (not read_field(in, end, count))
+				return false;
+
+			const auto remaining = static_cast<std::size_t>(end - in);
+
+			if constexpr (String<T>)
+			{
+				if (count > remaining)
+					return false;
+
+				data.assign(reinterpret_cast<const char*>(in), count);
+				in += count;
+
+				return true;
+			}
+
+			else
+			{
+				// a count that can't fit in what is left is not trusted with an allocation
+				constexpr std::size_t element = fixed_size<typename container_traits<T>::value_type>();
+
+				if (element != variable_size and element != 0 ? count > remaining / element : count > remaining)
+					return false;
+
+				data.resize(count);
+
+				if constexpr (Primitive<typename container_traits<T>::value_type>)
+				{
+					copy_in(in, count, data.data());
+					in += count * element;
+
+					return true;
+				}
+
+				else
+					return std::ranges::all_of(data, [&](auto& e) { return read_field(in, end, e); });
+			}
+		}
+
+		else if constexpr (Array<T>)
+			return std::ranges::all_of(data, [&](auto& e) { return read_field(in, end, e); });
+
+		else
+			return std::apply([&](auto& ... field) { return (read_field(in, end, field) and ...); }, fields(data));
+	}
+
+	template <typename T>
+	concept Structured = (Reflectable<T> or (Vector<T> and not Primitive<typename container_traits<T>::value_type>)) and supported<T>();
+
+}
+
+template <typename T>
+requires details::Structured<T>
+[[nodiscard]]
+constexpr std::size_t serialized_size(const T& data) noexcept
+{
+	if constexpr (details::Vector<T>)
+		return details::field_size(data) - sizeof(std::uint32_t);
+	else
+		return details::field_size(data);
+}
+
+template <typename T>
+requires details::Structured<T>
+[[nodiscard]]
+std::optional<std::size_t> serialize_into(const T& data, std::span<std::byte> buffer) noexcept
+{
+	const std::size_t size = serialized_size(data);
+
+	if (buffer.size() < size)
+		return std::nullopt;
+
+	std::byte* out = buffer.data();
+
+	// a vector on its own is sized by its buffer
+	if constexpr (details::Vector<T>)
+		for (const auto& e : data)
+			details::write_field(out, e);
+	else
+		details::write_field(out, data);
+
+	return size;
+}
+
+// aggregates of a fixed size come back as an array, everything else as a vector
+template <typename T>
+requires details::Structured<T>
+[[nodiscard]]
+auto serialize(const T& data) noexcept
+{
+	if constexpr (details::fixed_size<T>() != details::variable_size)
+	{
+		std::array<std::byte, details::fixed_size<T>()> buffer;
+		std::byte* out = buffer.data();
+		details::write_field(out, data);
+
+		return buffer;
+	}
+
+	else
+	{
+		std::vector<std::byte> buffer(serialized_size(data));
+		[[maybe_unused]] const auto written = serialize_into(data, buffer);
+
+		return buffer;
+	}
+}
+
+// anything serialize_into can append to, e.g. a std::vector<std::byte> reused as an arena
+template <typename T>
+concept ByteSink = requires (T sink, std::size_t size)
+{
+	sink.resize(size);
+	{ sink.size() } -> std::convertible_to<std::size_t>;
+	{ sink.data() } -> std::same_as<std::byte*>;
+};
+
+// serializers that can size a value up front and write it straight into a sink instead of returning a buffer
+template <typename Serializer, typename T>
+concept SinkSerializer = requires (const T& data, std::vector<std::byte>& sink)
+{
+	{ Serializer::serialized_size(data) } -> std::convertible_to<std::size_t>;
+	Serializer::serialize_into(sink, data);
+};
+
+template <Primitive T>
+[[nodiscard]]
+constexpr std::size_t serialized_size(const T&) noexcept
+{
+	return sizeof(T);
+}
+
+[[nodiscard]]
+constexpr std::size_t serialized_size(const std::ranges::sized_range auto& data) noexcept
+requires Primitive<std::ranges::range_value_t<decltype(data)>>
+{
+	return std::ranges::size(data) * sizeof(std::ranges::range_value_t<decltype(data)>);
+}
+
+// appends the serialized data to the end of sink
+template <ByteSink Sink>
+constexpr void serialize_into(Sink& sink, const auto& data)
+requires requires { serialized_size(data); } and (not std::convertible_to<decltype(data), std::span<std::byte>>)
+{
+	const std::size_t offset = sink.size();
+	sink.resize(offset + serialized_size(data));
+
+	[[maybe_unused]] const auto written = serialize_into(data, std::span<std::byte>{sink.data() + offset, sink.size() - offset});
+}
+
+// the most serialize_sized_into can frame behind its u16 size
+constexpr std::size_t max_sized_bytes = std::numeric_limits<std::uint16_t>::max();
+
+// appends [u16 size][data] with the given serializer, through its sink API when it has one.
+// data larger than max_sized_bytes is refused and the sink is left as it was
+template <typename Serializer, ByteSink Sink, typename T>
+bool serialize_sized_into(Sink& sink, const T& data)
+{
+	if constexpr (SinkSerializer<Serializer, T>)
+	{
+		const std::size_t size = Serializer::serialized_size(data);
+
+		if (size > max_sized_bytes)
+			return false;
+
+		serialize_into(sink, static_cast<std::uint16_t>(size));
+		Serializer::serialize_into(sink, data);
+	}
+
+	else
+	{
+		const auto serialized = Serializer::serialize(data);
+
+		if (std::ranges::size(serialized) > max_sized_bytes)
+			return false;
+
+		serialize_into(sink, static_cast<std::uint16_t>(std::ranges::size(serialized)));
+
+		const std::size_t offset = sink.size();
+		sink.resize(offset + std::ranges::size(serialized));
+		std::ranges::copy(serialized, sink.data() + offset);
+	}
+
+	return true;
 }
 
 template <typename ... Ts>
@@ -91,11 +709,48 @@ template <typename T>
 [[nodiscard]]
 constexpr T deserialize(const std::ranges::range auto& buffer) noexcept
 {
-	T t;
-	auto t_begin = reinterpret_cast<std::byte*>(&t);
-	std::ranges::range auto t_range = std::ranges::subrange(t_begin, t_begin + sizeof(T));
+	T t{};
+
+	if constexpr ((details::Structured<T> or details::String<T>) and std::ranges::contiguous_range<decltype(buffer)>)
+	{
+		const std::byte* in = std::ranges::data(buffer);
+		const std::byte* end = in + std::ranges::size(buffer);
+
+		// a string or vector on its own takes the whole buffer, a damaged buffer leaves the remaining fields defaulted
+		if constexpr (details::String<T>)
+			t.assign(reinterpret_cast<const char*>(in), end - in);
+
+		else if constexpr (details::Vector<T>)
+		{
+			typename T::value_type e{};
+
+			while (in < end and details::read_field(in, end, e))
+				t.push_back(std::move(e));
+		}
+
+		else
+			details::read_field(in, end, t);
+	}
+
+	else if constexpr (details::Vector<T> and std::ranges::contiguous_range<decltype(buffer)>)
+	{
+		t.resize(std::ranges::size(buffer) / sizeof(typename T::value_type));
+		details::copy_in(std::ranges::data(buffer), t.size(), t.data());
+	}
+
+	else if constexpr (Primitive<T> and std::ranges::contiguous_range<decltype(buffer)>)
+	{
+		if (std::ranges::size(buffer) >= sizeof(T))
+			details::copy_in(std::ranges::data(buffer), 1, &t);
+	}
 
-	std::copy(buffer.begin(), buffer.end(), t_range.begin());
+	else
+	{
+		auto t_begin = reinterpret_cast<std::byte*>(&t);
+		std::ranges::range auto t_range = std::ranges::subrange(t_begin, t_begin + sizeof(T));
+
+		std::copy(buffer.begin(), buffer.end(), t_range.begin());
+	}
 
 	return t;
 }
@@ -106,18 +761,34 @@ constexpr std::array<T, Size> deserialize(std::span<const std::byte, sizeof(T) *
 {
 	std::array<T, Size> ret;
 
-	auto beg = buffer.begin();
+	if constexpr (Primitive<T>)
+		details::copy_in(buffer.data(), Size, ret.data());
 
-	for (int i = 0; i < Size; ++i)
+	else
 	{
-		auto& e = ret[i];
-		e = deserialize<T>(std::span<const std::byte, sizeof(T)>{beg, beg + sizeof(T)});
-		std::advance(beg, sizeof(T));
+		auto beg = buffer.begin();
+
+		for (std::size_t i = 0; i < Size; ++i)
+		{
+			ret[i] = deserialize<T>(std::span<const std::byte, sizeof(T)>{beg, beg + sizeof(T)});
+			std::advance(beg, sizeof(T));
+		}
 	}
 
 	return ret;
 }
 
+// bulk counterpart of serialize for ranges, the buffer holds buffer.size() / sizeof(T) elements
+template <Primitive T>
+[[nodiscard]]
+std::vector<T> deserialize_range(std::span<const std::byte> buffer)
+{
+	std::vector<T> ret(buffer.size() / sizeof(T));
+	details::copy_in(buffer.data(), ret.size(), ret.data());
+
+	return ret;
+}
+
 template <std::integral T>
 [[nodiscard]]
 constexpr T deserialize(const std::array<std::byte, sizeof(T)>& buffer) noexcept
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <span>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <utility>
+
+#include "Serializer.hpp"
+#include "AsyncIO.hpp"
+
+namespace MILI::Database::details
+{
+
+// Linear hashing over the buckets of a table. A table starts out with `initial` buckets and grows by splitting the bucket
+// at the split pointer between itself and a new bucket at the end, the address space doubles once every bucket of a round
+// has been split. A split only moves keys from the bucket being split to the new one, and both are congruent to the same
+// root modulo `initial`, so hash % initial names the group a key stays in for the life of the table.
+// The count is read without a lock, the caller holds the stripe of the key's root which every split of that root takes too.
+// initial never changes once the layout is shared, so a reference to it may be used from any thread.
+// File layout: [magic "MILT"][u64 initial][u64 count][u8 cleaning]
+class TableLayout
+{
+public:
+
+	explicit TableLayout(std::size_t initial_buckets) noexcept : initial{std::max<std::size_t>(initial_buckets, 1)}, count{initial}
+	{}
+
+	TableLayout(TableLayout&& rhs) noexcept : cleaning{rhs.cleaning}, initial{rhs.initial}, count{rhs.count.load()}, persisted{rhs.persisted.load()}
+	{}
+
+	// tables without a layout file predate it and have the bucket count of the engine
+	[[nodiscard]]
+	static TableLayout load(const std::string& path, std::size_t default_buckets)
+	{
+		TableLayout ret{default_buckets};
+
+		FILE* file = fopen(path.c_str(), "rb");
+
+		if (not file)
+			return ret;
+
+		std::array<std::byte, file_size> buffer{};
+		const bool complete = fread(buffer.data(), sizeof(std::byte), buffer.size(), file) == buffer.size();
+		fclose(file);
+
+		if (not complete or not std::equal(magic.begin(), magic.end(), reinterpret_cast<const char*>(buffer.data())))
+			return ret;
+
+		const auto stored_initial = integral_at<std::uint64_t>(buffer, magic.size());
+		const auto stored_count = integral_at<std::uint64_t>(buffer, magic.size() + sizeof(std::uint64_t));
+
+		if (stored_initial == 0 or stored_count < stored_initial)
+			return ret;
+
+		ret.initial = stored_initial;
+		ret.count = stored_count;
+		ret.cleaning = buffer[file_size - 1] != std::byte{0};
+		ret.persisted = true;
+
+		return ret;
+	}
+
+	// the layout is swapped in whole, a crash leaves either the old or the new one
+	bool persist(const std::string& path) noexcept
+	{
+		const bool written = write(path, count.load());
+		persisted.store(written, std::memory_order_release);
+
+		return written;
+	}
+
+	// writes the layout as it is going to be once the next split is made, which has to reach the disk before the split does
+	bool persist_split(const std::string& path) noexcept
+	{
+		return write(path, count.load() + 1);
+	}
+
+	[[nodiscard]]
+	bool is_persisted() const noexcept
+	{
+		return persisted.load(std::memory_order_acquire);
+	}
+
+	// the stripe of a key is picked by its root, which works for bucket numbers as well as hashes
+	[[nodiscard]]
+	std::size_t root(std::size_t hash) const noexcept
+	{
+		return hash % initial;
+	}
+
+	[[nodiscard]]
+	std::size_t bucket(std::size_t hash) const noexcept
+	{
+		const std::size_t buckets = count.load(std::memory_order_acquire);
+		const std::size_t round = round_size(buckets);
+
+		// buckets before the split pointer were already split in this round and answer to the doubled address space
+		const std::size_t ret = hash % (2 * round);
+
+		return ret < buckets ? ret : hash % round;
+	}
+
+	[[nodiscard]]
+	std::size_t bucket_count() const noexcept
+	{
+		return count.load(std::memory_order_acquire);
+	}
+
+	[[nodiscard]]
+	std::size_t initial_buckets() const noexcept
+	{
+		return initial;
+	}
+
+	// the bucket the next split divides, and the new bucket it creates
+	[[nodiscard]]
+	std::pair<std::size_t, std::size_t> next_split() const noexcept
+	{
+		const std::size_t buckets = count.load(std::memory_order_acquire);
+		return {buckets - round_size(buckets), buckets};
+	}
+
+	// the last split that was made, only meaningful once the table has grown
+	[[nodiscard]]
+	std::pair<std::size_t, std::size_t> last_split() const noexcept
+	{
+		const std::size_t buckets = count.load(std::memory_order_acquire) - 1;
+		return {buckets - round_size(buckets), buckets};
+	}
+
+	// whether the next split moves the key to the new bucket
+	[[nodiscard]]
+	bool moves(std::size_t hash) const noexcept
+	{
+		const std::size_t buckets = count.load(std::memory_order_acquire);
+		return hash % (2 * round_size(buckets)) == buckets;
+	}
+
+	// makes the new bucket of the split addressable, the caller holds the stripe of the split bucket exclusively
+	void grow() noexcept
+	{
+		count.fetch_add(1, std::memory_order_release);
+	}
+
+	// set while the bucket that was split may still hold the entries that moved out of it. Only the checkpoint changes it
+	bool cleaning = false;
+
+private:
+
+	constexpr static std::array<char, 4> magic{'M', 'I', 'L', 'T'};
+	constexpr static std::size_t file_size = magic.size() + 2 * sizeof(std::uint64_t) + sizeof(std::uint8_t);
+
+	// the number of buckets at the start of the current round
+	[[nodiscard]]
+	std::size_t round_size(std::size_t buckets) const noexcept
+	{
+		return initial * std::bit_floor(buckets / initial);
+	}
+
+	bool write(const std::string& path, std::size_t buckets) const noexcept
+	{
+		const auto data = MILI::serialize(magic, static_cast<std::uint64_t>(initial), static_cast<std::uint64_t>(buckets),
+			static_cast<std::uint8_t>(cleaning));
+
+		return commit_file(path, data);
+	}
+
+	template <std::integral T>
+	[[nodiscard]]
+	static T integral_at(std::span<const std::byte> buffer, std::size_t offset) noexcept
+	{
+		return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{buffer.data() + offset, sizeof(T)});
+	}
+
+	std::size_t initial;
+	std::atomic<std::size_t> count;
+	std::atomic<bool> persisted = false; // only the checkpoint writes it, but the layout is shared with every open Table
+};
+
+}
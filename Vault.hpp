@@ -7,15 +7,35 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <memory>
+#include <memory_resource>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
 #include <span>
 #include <ranges>
+#include <algorithm>
+#include <utility>
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "nlohmann/json.hpp"
 #include "range/v3/all.hpp"
 
 #include "Serializer.hpp"
+#include "WriteAheadLog.hpp"
+#include "BloomFilter.hpp"
+#include "TableLayout.hpp"
+#include "FlatMap.hpp"
+#include "Fragment.hpp"
+#include "AsyncIO.hpp"
+#include "Metrics.hpp"
 
 namespace MILI::Database
 {
@@ -39,6 +59,20 @@ namespace MILI::Database
 			return MILI::serialize(value);
 		}
 
+		template <typename T>
+		static std::size_t serialized_size(const T& data) noexcept
+		requires requires { MILI::serialized_size(data); }
+		{
+			return MILI::serialized_size(data);
+		}
+
+		template <typename T>
+		static void serialize_into(std::vector<std::byte>& sink, const T& data)
+		requires requires { MILI::serialize_into(sink, data); }
+		{
+			MILI::serialize_into(sink, data);
+		}
+
 		template <typename T>
 		static auto deserialize(std::span<const std::byte> buffer) noexcept
 		{
@@ -46,46 +80,49 @@ namespace MILI::Database
 		}
 	};
 
-	struct Header
-	{
-		std::array<char, 4> magic{'M', 'I', 'L', 'I'};
-		std::uint32_t size{};
-		std::uint16_t len{};
+	template <typename Key, typename Value, typename Serializer, std::size_t BucketSize = 128>
+	class Engine;
 
-		Header() noexcept = default;
+	// The upstream of a bucket's arena, it counts what the arena holds on to
+	class CountingResource final : public std::pmr::memory_resource
+	{
+	public:
 
-		bool construct(const std::array<std::byte, 16>& raw_data) noexcept
+		[[nodiscard]]
+		std::size_t allocated() const noexcept
 		{
-			magic = MILI::deserialize<char, 4>(std::span<const std::byte, 4>{raw_data.begin(), raw_data.begin() + sizeof(magic)});
+			return bytes.load(std::memory_order_relaxed);
+		}
 
-			// check if magic is correct
-			if (magic != std::array<char, 4>{'M', 'I', 'L', 'I'})
-				return false;
+	private:
 
-			size = MILI::deserialize<std::uint32_t>(std::span<const std::byte, sizeof(size)>{raw_data.begin() + sizeof(magic), raw_data.begin() + sizeof(magic) + sizeof(size)});
-			len = MILI::deserialize<std::uint16_t>(std::span<const std::byte, sizeof(len)>{raw_data.begin() + sizeof(magic) + sizeof(size), raw_data.begin() + sizeof(magic) + sizeof(size) + sizeof(len)});
+		void* do_allocate(std::size_t size, std::size_t alignment) override
+		{
+			void* ret = std::pmr::new_delete_resource()->allocate(size, alignment);
+			bytes.fetch_add(size, std::memory_order_relaxed);
 
-			return true;
+			return ret;
 		}
 
-		[[nodiscard]]
-		std::array<std::byte, 16> serialize() const noexcept
+		void do_deallocate(void* pointer, std::size_t size, std::size_t alignment) override
 		{
-			using namespace MILI::Database;
-
-			auto&& serialized_vec = MILI::serialize(magic, size, len, std::array<std::byte, 6>{});
-			std::array<std::byte, 16> serialized_array{};
-			std::copy(serialized_vec.begin(), serialized_vec.end(), serialized_array.begin());
+			std::pmr::new_delete_resource()->deallocate(pointer, size, alignment);
+			bytes.fetch_sub(size, std::memory_order_relaxed);
+		}
 
-			return serialized_array;
+		[[nodiscard]]
+		bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+		{
+			return this == &other;
 		}
-	};
 
-	template <typename Key, typename Value, typename Serializer, std::size_t BucketSize = 128>
-	class Engine;
+		std::atomic<std::size_t> bytes{0};
+	};
 
-// todo: use static memory
-	template <typename Key, typename Value, typename Serializer, typename Container = std::map<Key, Value>>
+	// The storage of a bucket's container and change set comes from its own arena, which is given back in one go when the
+	// bucket is evicted. Containers that take a memory resource (FlatMap, std::pmr::map) use it, others the heap. What
+	// the keys and values allocate themselves, like the characters of a std::string, still comes from the heap.
+	template <typename Key, typename Value, typename Serializer, typename Container = ArenaFlatMap<Key, Value>>
 	class Bucket
 	{
 	public:
@@ -97,44 +134,50 @@ namespace MILI::Database
 //			rhs.is_moved = true;
 //		}
 
-		bool flush() noexcept
-		{
-			needs_flusing = false;
-			FILE* file = fopen((database_path + db_name + "/" + table_name + "/fragment" + std::to_string(id)).c_str(), "wb");
+		// the delta may grow to half of the fragment before both are folded into a new fragment
+		constexpr static std::size_t compaction_ratio = 2;
+		constexpr static std::size_t min_compaction_bytes = 64 * 1024;
 
-			if (!file)
-				return false;
+		// the arena may hold this many times what the entries need before the bucket moves into a fresh one
+		constexpr static std::size_t arena_slack = 3;
+		constexpr static std::size_t min_reclaim_bytes = 64 * 1024;
 
-			Header header;
-			header.len = static_cast<std::uint16_t>(data.size());
-			fwrite(header.serialize().data(), 16, 1, file);
+		bool flush() noexcept
+		{
+			if (not needs_flusing)
+				return true;
 
-			// TODO: fix serialization
+			metrics::Timer timer{metrics::bucket_flushes};
 
+			// only the entries changed since the last flush are appended, removed ones as tombstones
+			DeltaWriter<Key, Value, Serializer> delta;
 
-			for (const auto& e : data)
+			if (has_delta)
 			{
-				auto serialized_key = Serializer::serialize(e.first);
-				auto serialized_key_size = MILI::serialize<std::uint16_t>(serialized_key.size());
+				for (const auto& key : changed)
+				{
+					auto itr = data.find(key);
+					delta.add(key, itr == data.end() ? nullptr : &itr->second);
+				}
+			}
 
-				fwrite(serialized_key_size.data(), sizeof(serialized_key_size), 1, file);
-				fwrite(serialized_key.data(), serialized_key.size(), 1, file);
-				header.size += serialized_key_size.size() + sizeof(serialized_key_size);
+			// the bucket stays dirty until its changes are really on disk
+			if (has_delta and delta_bytes + delta.size() <= std::max(fragment_bytes / compaction_ratio, min_compaction_bytes))
+			{
+				const std::size_t appended = delta.size() + (delta_bytes == 0 ? delta_header_size : 0);
 
-				auto serialized_value = Serializer::serialize(e.second);
-				auto serialized_val_size = MILI::serialize<std::uint16_t>(serialized_value.size());
+				if (not delta.append(fragment_path(), generation, delta_bytes))
+					return false;
 
-				fwrite(serialized_val_size.data(), sizeof(serialized_val_size), 1, file);
-				fwrite(serialized_value.data(), serialized_value.size(), 1, file);
-				header.size += serialized_val_size.size() + serialized_value.size() + serialized_key_size.size() + serialized_key_size.size();
+				delta_bytes += appended;
+				metrics::fragment_bytes.add(appended);
 			}
 
-			// rewrite the header
-			fseek(file, 0, SEEK_SET);
-			fwrite(header.serialize().data(), 16, 1, file);
-
-			fclose(file);
+			else if (not compact())
+				return false;
 
+			changed.clear();
+			needs_flusing = false;
 			return true;
 		}
 
@@ -147,6 +190,7 @@ namespace MILI::Database
 
 			needs_flusing = true;
 			itr->second = value;
+			changed.insert(key);
 
 			return true;
 		}
@@ -160,6 +204,7 @@ namespace MILI::Database
 
 			needs_flusing = true;
 			data.erase(itr);
+			changed.insert(key);
 
 			return true;
 		}
@@ -172,7 +217,8 @@ namespace MILI::Database
 				return false;
 
 			needs_flusing = true;
-			data[key] = value;
+			changed.insert(key);
+			data[key] = std::move(value);
 
 			return true;
 		}
@@ -199,6 +245,96 @@ namespace MILI::Database
 			return table_name;
 		}
 
+		[[nodiscard]]
+		bool is_dirty() const noexcept
+		{
+			return needs_flusing;
+		}
+
+		// deltas are appended as they are, the codec applies from the next compaction on
+		void set_compression(Compression codec) noexcept
+		{
+			compression.store(codec, std::memory_order_relaxed);
+		}
+
+		// applies changes sorted by key in one pass where the container can, a null value removes the key
+		void merge(std::span<const std::pair<const Key*, const Value*>> changes)
+		{
+			if (changes.empty())
+				return;
+
+			needs_flusing = true;
+
+			for (const auto& change : changes)
+				changed.insert(*change.first);
+
+			if constexpr (requires { data.merge(changes); })
+				data.merge(changes);
+			else
+			{
+				for (const auto& [key, value] : changes)
+				{
+					if (value)
+						data.insert_or_assign(*key, *value);
+					else
+						data.erase(*key);
+				}
+			}
+
+			reclaim();
+		}
+
+		// removes the entries erases(key) picks, like remove() would one at a time
+		template <typename F>
+		void erase_if(F&& erases) noexcept
+		{
+			// a flat container would shift its tail once per entry erased one at a time
+			if constexpr (requires { data.erase_if([](const auto&) { return true; }); })
+			{
+				const std::size_t erased = data.erase_if([&](const auto& entry)
+				{
+					if (not erases(entry.first))
+						return false;
+
+					changed.insert(entry.first);
+					return true;
+				});
+
+				needs_flusing = needs_flusing or erased > 0;
+			}
+			else
+			{
+				for (auto itr = data.begin(); itr != data.end();)
+				{
+					if (not erases(itr->first))
+					{
+						++itr;
+						continue;
+					}
+
+					needs_flusing = true;
+					changed.insert(itr->first);
+					itr = data.erase(itr);
+				}
+			}
+
+			reclaim();
+		}
+
+		// the size of the fragment and its delta as of the last flush
+		[[nodiscard]]
+		std::size_t bytes() const noexcept
+		{
+			return fragment_bytes + delta_bytes;
+		}
+
+		// rough estimate of the heap held by the bucket, used to keep the buffer pool within its budget
+		[[nodiscard]]
+		std::size_t memory_usage() const noexcept
+		{
+			return sizeof(*this) + std::max(needed_bytes(), heap.allocated());
+		}
+
 
 		~Bucket() noexcept
 		{
@@ -213,366 +349,2109 @@ namespace MILI::Database
 
 		explicit Bucket(std::string_view db, std::string_view tbl_name, std::size_t bucket_idx) noexcept : db_name{db}, table_name{tbl_name}, id{bucket_idx}
 		{
-			Header header{};
-			FILE* file = fopen((database_path + db_name + "/" + table_name + "/fragment" + std::to_string(id)).c_str(), "rb");
+			MappedBucket<Key, Value, Serializer> fragment{fragment_path()};
 
-			if (not file)
+			// a bucket must never be written back without the entries of a damaged fragment, the engine refuses to load it
+			if (not fragment.valid() or not fragment.verify())
+			{
+				corrupt = true;
 				return;
+			}
+
+			if constexpr (requires { data.reserve(fragment.size()); })
+				data.reserve(fragment.size());
 
-			std::array<std::byte, 16> raw_header{};
+			for (auto position = fragment.begin(); position < fragment.end(); position = fragment.next(position))
+				data.emplace_hint(data.end(), fragment.key_at(position), Serializer::template deserialize<Value>(fragment.value_at(position)));
 
-			if (fread(raw_header.data(), sizeof(std::byte), raw_header.size(), file) != raw_header.size())
+			// the delta comes sorted, a container that merges takes it in one pass instead of a shift per change
+			if constexpr (requires (std::span<const std::pair<const Key*, const Value*>> changes) { data.merge(changes); })
 			{
-				fclose(file);
-				return;
+				std::vector<std::pair<const Key*, const Value*>> changes;
+				changes.reserve(fragment.changes().size());
+
+				for (const auto& [key, value] : fragment.changes())
+					changes.emplace_back(&key, value ? &*value : nullptr);
+
+				data.merge(changes);
+			}
+			else
+			{
+				for (const auto& [key, value] : fragment.changes())
+				{
+					if (value)
+						data.insert_or_assign(key, *value);
+					else
+						data.erase(key);
+				}
 			}
 
-			if (not header.construct(raw_header))
-				return;
+			has_delta = fragment.takes_delta();
+			generation = fragment.get_generation();
+			fragment_bytes = fragment.bytes();
+			delta_bytes = fragment.delta_bytes();
+		}
 
+		[[nodiscard]]
+		std::string fragment_path() const
+		{
+			return database_path + db_name + "/" + table_name + "/fragment" + std::to_string(id);
+		}
 
-			auto get_size = [&]() -> std::uint16_t
-			{
-				std::array<std::byte, 2> data_info{};
+		// writes every entry into a fragment of the next generation, which makes the current delta stale
+		bool compact() noexcept
+		{
+			// the fragment is written next to the old one and swapped in, a crash mid-write leaves the old fragment intact
+			FragmentWriter<Key, Value, Serializer> writer{generation + 1, compression.load(std::memory_order_relaxed)};
 
-				if (fread(data_info.data(), sizeof(std::byte), data_info.size(), file) != data_info.size())
-					return 0;
+			for (const auto& [key, value] : data)
+				writer.add(key, value);
 
-				return MILI::deserialize<std::uint16_t>(data_info);
-			};
+			if (not writer.finish(fragment_path()))
+				return false;
 
+			// a leftover delta is ignored because of its generation, removing it only saves the space
+			unlink((fragment_path() + ".delta").c_str());
 
-			std::vector<std::byte> buffer;
+			struct stat info{};
+			fragment_bytes = stat(fragment_path().c_str(), &info) == 0 ? info.st_size : 0;
+			metrics::fragment_bytes.add(fragment_bytes);
+			has_delta = true;
+			++generation;
+			delta_bytes = 0;
 
-			while (std::uint16_t size = get_size())
-			{
-				buffer.resize(size);
-				if (fread(buffer.data(), sizeof(std::byte), size, file) != size)
-					break;
+			return true;
+		}
+
+		// what the container and the change set need for their storage
+		[[nodiscard]]
+		std::size_t needed_bytes() const noexcept
+		{
+			constexpr std::size_t node_overhead = 4 * sizeof(void*);
+			std::size_t entries;
 
-				Key key = Serializer::template deserialize<Key>(std::span<const std::byte>(buffer.data(), buffer.size()));
-				buffer.clear();
+			if constexpr (requires { data.capacity(); })
+				entries = data.capacity() * sizeof(typename Container::value_type);
+			else
+				entries = data.size() * (sizeof(typename Container::value_type) + node_overhead);
 
-				size = get_size();
-				buffer.resize(size);
-				if (fread(buffer.data(), sizeof(std::byte), size, file) != size)
-					break;
+			return entries + changed.size() * (sizeof(Key) + node_overhead);
+		}
 
-				Value val = Serializer::template deserialize<Value>(std::span<const std::byte>(buffer.data(), buffer.size()));
+		// the pool passes blocks larger than its biggest pool straight to the arena, which only frees them with the bucket,
+		// so every time a flat container outgrows its storage the old one stays behind. Once that waste gets out of
+		// hand the entries and the change set are copied out and the arena starts over
+		void reclaim()
+		{
+			if (heap.allocated() <= std::max(arena_slack * needed_bytes(), min_reclaim_bytes))
+				return;
 
-				data[key] = val;
-				buffer.clear();
-			}
+			std::vector<std::pair<Key, Value>> entries;
+			entries.reserve(data.size());
+
+			for (auto& entry : data)
+				entries.emplace_back(entry.first, std::move(entry.second));
+
+			std::vector<Key> keys{changed.begin(), changed.end()};
+
+			// nothing may point into the arena when it is released
+			data = make_container();
+			changed.clear();
+			pool.release();
+			arena.release();
+
+			if constexpr (requires { data.reserve(entries.size()); })
+				data.reserve(entries.size());
 
-			fclose(file);
+			for (auto& [key, value] : entries)
+				data.emplace_hint(data.end(), std::move(key), std::move(value));
+
+			for (auto& key : keys)
+				changed.insert(changed.end(), std::move(key));
+		}
+
+		[[nodiscard]]
+		Container make_container() noexcept
+		{
+			if constexpr (std::is_constructible_v<Container, std::pmr::memory_resource*>)
+				return Container{&pool};
+			else
+				return Container{};
 		}
 
-		Container data;
+		// the arena grows by whole buffers and is freed with the bucket or by reclaim. The pool on top of it recycles the
+		// small blocks the change set and the container give back in between, larger ones bypass it (see reclaim)
+		CountingResource heap;
+		std::pmr::monotonic_buffer_resource arena{&heap};
+		std::pmr::unsynchronized_pool_resource pool{&arena};
+		Container data = make_container();
+		std::pmr::set<Key> changed{&pool}; // entries written or removed since the last flush
+		std::atomic<Compression> compression = Compression::None; // of the blocks of the next fragment written
 		std::string db_name;
 		std::string table_name;
 		std::size_t id = 0;
 		bool is_moved = false;
 		bool needs_flusing = false;
+		bool corrupt = false;
+		bool has_delta = false;
+		std::uint32_t generation = 0;
+		std::size_t fragment_bytes = 0;
+		std::size_t delta_bytes = 0;
 	};
 
-	template <typename Key, typename Value, typename Serializer, std::size_t BucketSize>
-	class Engine
+	// Ordered walk over the entries of one bucket within a key range.
+	// Resident buckets are copied out since they keep changing, cold ones are decoded on demand from their mapping
+	// with the changes from their delta merged in.
+	template <typename Key, typename Value, typename Serializer>
+	class BucketCursor
 	{
-		std::string_view db_name;
-		std::set<std::string_view> data;
-	public:
+		using mapped_t = MappedBucket<Key, Value, Serializer>;
 
-		constexpr static std::size_t bucket_size = BucketSize;
+	public:
 
-		explicit Engine(std::string_view name) noexcept : db_name{name}
+		explicit BucketCursor(std::vector<std::pair<Key, Value>> copied) noexcept : entries{std::move(copied)}
 		{}
 
-		bool integrity_check() noexcept
+		BucketCursor(std::shared_ptr<const mapped_t> mapped, const Key& low, const Key& high) noexcept
+			: view{std::move(mapped)}, position{view->lower_bound(low)}, end{std::max(position, view->upper_bound(high))},
+			  change{view->changes().lower_bound(low)}, changes_end{high < low ? change : view->changes().upper_bound(high)}
 		{
-			// check if a folder named /MILI/Vault/ exists
-			DIR* dir = opendir(database_path);
+			decode();
+		}
 
-			if (not dir)
-				return false;
+		[[nodiscard]]
+		bool valid() const noexcept
+		{
+			return view ? in_range : index < entries.size();
+		}
 
-			closedir(dir);
+		[[nodiscard]]
+		const Key& key() const noexcept
+		{
+			return view ? current : entries[index].first;
+		}
 
-			// TODO: stricter integrity check
-			// regenerate hash file if it's corrupted?
+		[[nodiscard]]
+		Value value() const noexcept
+		{
+			if (view and from_delta)
+				return *change->second;
 
-			return true;
+			if (view)
+				return Serializer::template deserialize<Value>(view->value_at(position));
+
+			return entries[index].second;
 		}
 
-		void construct() noexcept
+		void next() noexcept
 		{
-			for (auto dir : {"/MILI", "/MILI/Vault"})
-				mkdir(dir, 0777);
+			if (view and from_delta)
+				++change;
+			else if (view)
+				position = view->next(position);
+			else
+				++index;
+
+			decode();
 		}
 
-		auto get_bucket(std::string_view table_name, std::size_t bucket_number) noexcept -> std::optional<details::Bucket<Key, Value, Serializer>>
+	private:
+
+		using change_iterator = typename std::map<Key, std::optional<Value>>::const_iterator;
+
+		// mapped keys are decoded once per entry, the merge compares them many times
+		// a change shadows the mapped entry with the same key, removed entries are skipped
+		void decode() noexcept
 		{
-			// convert read file named table_name from the disk under the MILI/Vault/ directory
-			std::string&& path = database_path + std::string{db_name} + "/" + std::string{table_name};
-			std::string&& filename = path + "/fragment" + std::to_string(bucket_number);
-			// check if file exists
-			FILE* file = fopen(filename.c_str(), "r");
+			if (not view)
+				return;
 
-			if (not file)
+			while (true)
 			{
-				using namespace std::literals;
-				for (const auto& dir : {"/MILI"s, "/MILI/Vault"s, (database_path + std::string{db_name}), path})
-					mkdir(dir.c_str(), 0777);
+				const bool mapped_left = position < end;
 
-				Header header{};
+				if (mapped_left)
+					current = view->key_at(position);
 
-				// create file
-				file = fopen(filename.c_str(), "w");
+				if (change == changes_end or (mapped_left and current < change->first))
+				{
+					from_delta = false;
+					in_range = mapped_left;
+					return;
+				}
 
-				if (not file)
-					return std::nullopt;
+				if (mapped_left and not (change->first < current))
+					position = view->next(position);
 
-				// write header
-				auto&& serialized_header = header.serialize();
-				fwrite(serialized_header.data(), sizeof(std::byte), 16, file);
-				fclose(file);
+				if (change->second)
+				{
+					current = change->first;
+					from_delta = true;
+					in_range = true;
+					return;
+				}
 
-				return Bucket<Key, Value, Serializer>{db_name, table_name, bucket_number};
+				++change;
 			}
-
-			// read	header
-			std::array<std::byte, 16> header_data{};
-			fread(header_data.data(), sizeof(std::byte), 16, file);
-			Header header{};
-			header.construct(header_data);
-			fclose(file);
-
-			return Bucket<Key, Value, Serializer>{db_name, table_name, bucket_number};
 		}
-	};
 
-	}
+		std::vector<std::pair<Key, Value>> entries;
+		std::size_t index = 0;
+		std::shared_ptr<const mapped_t> view;
+		typename mapped_t::Position position{};
+		typename mapped_t::Position end{};
+		change_iterator change{};
+		change_iterator changes_end{};
+		Key current{};
+		bool from_delta = false;
+		bool in_range = false;
+	};
 
-template <typename Key, typename Value>
-struct Cache
-{
-	enum class Operation
+	struct BufferPoolStats
 	{
-		Insert,
-		Remove,
-		Update
+		std::size_t hits{};
+		std::size_t misses{};
+		std::size_t evictions{};
+		std::size_t dirty_evictions{};
+		std::size_t resident{};
+		std::size_t memory{};
 	};
 
-	struct Entry
+	// sorts rows by key and keeps only the one added last of every key, in place
+	template <typename Key, typename Value>
+	void keep_newest(std::vector<std::pair<Key, Value>>& rows)
 	{
-		std::string table;
-		Key key;
-		Value value;
-		Operation operation;
-	};
+		std::stable_sort(rows.begin(), rows.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
 
-	std::vector<Entry> entries;
-};
+		std::size_t kept = 0;
 
+		for (std::size_t i = 0; i < rows.size(); ++i)
+		{
+			if (i + 1 < rows.size() and rows[i + 1].first == rows[i].first)
+				continue;
 
+			// a row that is already in place stays where it is, moving it onto itself would leave a string value empty
+			if (kept != i)
+				rows[kept] = std::move(rows[i]);
 
-template <typename Key, typename Value, typename Serializer = details::DefaultSerializer<Key, Value>>
-class Vault
-{
-	constexpr static std::size_t cache_size = 16;
-	using Engine = details::Engine<Key, Value, Serializer, 64>;
-	using bucket_t = decltype(std::declval<Engine>().get_bucket("table_name", 0));
+			++kept;
+		}
 
-	Engine engine{};
-	std::string name;
-	bucket_t bucket{std::nullopt};
-	Cache<Key, Value> cache;
-	std::set<std::size_t> hash_map;
+		rows.resize(kept);
+	}
 
-	explicit Vault(Engine eng, std::string_view db_name = "Vault") noexcept : engine{eng}, name{db_name}
+	// when the background flusher of a Vault runs, whichever threshold is reached first triggers a checkpoint
+	struct FlushPolicy
 	{
-		// initialize the hash map
-		FILE* hash_file = fopen((database_path + name + ".hash").c_str()  , "rb");
+		std::chrono::milliseconds interval{5000}; // the log is committed at least this often
+		std::size_t dirty_bytes = 64 * 1024 * 1024; // bytes logged since the last checkpoint
+		std::size_t entries = 32768; // mutations waiting in the cache
+	};
 
-		// read the file if it exists
-		if (hash_file)
-		{
-			std::array<std::byte, sizeof(std::size_t)> data{};
-			fread(data.data(), sizeof(std::byte), data.size(), hash_file);
+	// The buffer pool keeps resident buckets under CLOCK replacement so that lookups only need a shared lock.
+	// The pool's own bookkeeping is guarded here, the contents of a bucket are guarded by Vault's stripe locks.
+	template <typename Key, typename Value, typename Serializer, std::size_t BucketSize>
+	class Engine
+	{
+		using bucket_t = Bucket<Key, Value, Serializer>;
+		using mapped_t = MappedBucket<Key, Value, Serializer>;
+		using bucket_id = std::pair<std::string, std::size_t>;
 
-			auto&& size = MILI::deserialize<std::size_t>(data);
+		struct Frame
+		{
+			std::shared_ptr<bucket_t> bucket;
+			mutable std::atomic<bool> referenced{true};
+			mutable std::atomic<std::size_t> leases{0}; // handed out by get_bucket and still held
+			std::size_t usage = 0; // as of the last time the bucket was not leased
+		};
+
+		// keeps the frame marked as leased for as long as the bucket handed out by get_bucket is held.
+		// letting go releases everything the holder did to the bucket to whoever sees the count drop
+		struct Lease
+		{
+			std::shared_ptr<bucket_t> bucket;
+			std::atomic<std::size_t>& leases;
 
-			while (fread(data.data(), sizeof(std::byte), data.size(), hash_file) == data.size())
+			~Lease()
 			{
-				const auto hash = MILI::deserialize<std::size_t>(data);
-				hash_map.insert(hash);
+				leases.fetch_sub(1, std::memory_order_release);
 			}
+		};
+
+		[[nodiscard]]
+		static std::shared_ptr<bucket_t> lease(const Frame& frame)
+		{
+			frame.leases.fetch_add(1, std::memory_order_relaxed);
+
+			auto held = std::make_shared<Lease>(frame.bucket, frame.leases);
+			return std::shared_ptr<bucket_t>{held, held->bucket.get()};
 		}
 
+		[[nodiscard]]
+		static bool leased(const Frame& frame) noexcept
+		{
+			return frame.leases.load(std::memory_order_acquire) != 0;
+		}
 
-		fclose(hash_file);
-	}
+		std::string db_name;
 
-	class Table
-	{
-		friend class Vault;
+		mutable std::shared_mutex mutex;
+		std::condition_variable_any written_back; // signalled when evicted buckets are done being written
+		std::map<bucket_id, std::shared_ptr<mapped_t>> mapped;
+		std::size_t mapped_usage = 0; // of the views in mapped, they share the budget with the resident buckets
+		std::map<bucket_id, Frame> frames;
+		std::map<bucket_id, std::shared_ptr<bucket_t>> evicting; // left the pool, still being written by whoever evicted them
+		typename std::map<bucket_id, Frame>::iterator hand = frames.end();
+		std::size_t memory_budget;
+		std::map<std::string, Compression, std::less<>> compressions; // tables that don't store their blocks as they are
+
+		mutable std::atomic<std::size_t> hits = 0;
+		mutable std::atomic<std::size_t> misses = 0;
+		std::size_t evictions = 0;
+		std::size_t dirty_evictions = 0;
 
-		std::string name;
-		Vault& vault;
+	public:
 
-		explicit Table(std::string_view table_name, Vault& v) noexcept : name{table_name}, vault{v}
+		constexpr static std::size_t bucket_size = BucketSize; // of tables created without a bucket count
+		constexpr static std::size_t default_memory_budget = 64 * 1024 * 1024;
+
+		// fragments are rewritten in full once their delta grows large, so tables split their buckets as they grow
+		constexpr static bool splits_buckets = true;
+
+		explicit Engine(std::string_view name, std::size_t budget = default_memory_budget) noexcept : db_name{name}, memory_budget{budget}
 		{}
 
-	public:
+		bool integrity_check() noexcept
+		{
+			// check if a folder named /MILI/Vault/ exists
+			DIR* dir = opendir(database_path);
 
-		[[nodiscard]]
-		std::optional<Value> read(const Key& key) noexcept
+			if (not dir)
+				return false;
+
+			closedir(dir);
+
+			// TODO: stricter integrity check
+			// regenerate hash file if it's corrupted?
+
+			return true;
+		}
+
+		void construct() noexcept
 		{
-			const std::size_t hash = std::hash<Key>{}(key);
+			for (auto dir : {"/MILI", "/MILI/Vault"})
+				mkdir(dir, 0777);
+		}
 
-			// if hash does not exist in the hash map, return std::nullopt
-			if (not vault.hash_map.count(hash))
-				return std::nullopt;
+		// returns the writable bucket, loading it into the pool if it is not resident yet.
+		// the caller must hold the bucket's stripe exclusively, an evicted bucket is flushed once its last user lets go of it
+		auto get_bucket(std::string_view table_name, std::size_t bucket_number) noexcept -> std::shared_ptr<bucket_t>
+		{
+			bucket_id id{table_name, bucket_number};
 
-			// search the cache for the key
-			for (const auto& entry : vault.cache.entries)
 			{
-				if (entry.key == key)
+				std::shared_lock lock{mutex};
+
+				if (auto itr = frames.find(id); itr != frames.end())
 				{
-					if (entry.operation == Cache<Key, Value>::Operation::Remove)
-						return std::nullopt;
+					hits.fetch_add(1, std::memory_order_relaxed);
+					metrics::buffer_pool_hits.add();
+					itr->second.referenced.store(true, std::memory_order_relaxed);
 
-					else
-						return entry.value;
+					return lease(itr->second);
 				}
 			}
 
-			// check if we have the correct bucket
-			if (not vault.bucket or vault.bucket->get_name() != name or vault.bucket->get_id() != (hash % vault.engine.bucket_size))
+			misses.fetch_add(1, std::memory_order_relaxed);
+			metrics::buffer_pool_misses.add();
+
 			{
-				vault.bucket = std::nullopt;
-				vault.bucket = vault.engine.get_bucket(name, hash % vault.engine.bucket_size);
-			}
+				// a bucket that is being evicted is loaded back once its fragment is complete
+				std::unique_lock lock{mutex};
+				written_back.wait(lock, [&] { return not evicting.contains(id); });
 
-			auto ret = vault.bucket->read(key);
+				// one that couldn't be written went back into the pool
+				if (auto itr = frames.find(id); itr != frames.end())
+					return lease(itr->second);
+			}
 
-			return ret;
-		}
+			std::shared_ptr<bucket_t> bucket;
 
+			{
+				metrics::Timer timer{metrics::bucket_loads};
+				bucket = load(table_name, bucket_number);
+			}
 
-		bool update(const Key& key, Value value)
-		{
-			const std::size_t hash = std::hash<Key>{}(key);
+			if (not bucket)
+				return nullptr;
 
-			// if hash does not exist in the hash map, return false
-			if (not vault.hash_map.count(hash))
-				return false;
+			std::shared_ptr<bucket_t> leased_bucket;
+			std::vector<std::pair<bucket_id, std::shared_ptr<bucket_t>>> victims;
 
-			// search the cache for the key
-			for (auto& entry : vault.cache.entries)
 			{
-				if (entry.key == key)
-				{
-					if (entry.operation == Cache<Key, Value>::Operation::Remove)
-						return false;
+				std::unique_lock lock{mutex};
 
-					entry.value = value;
-					entry.operation = Cache<Key, Value>::Operation::Update;
+				// the fragment is going to be rewritten by the bucket, drop the read-only view of it
+				drop_view(id);
 
-					// add the hash to the hash map
-					vault.hash_map.insert(hash);
-					return true;
-				}
+				auto& frame = frames.try_emplace(id).first->second;
+				frame.bucket = bucket;
+				frame.usage = bucket->memory_usage();
+				victims = evict(id);
+				leased_bucket = lease(frame);
 			}
 
-			// add the entry to the cache
-			vault.cache.entries.push_back(typename Cache<Key, Value>::Entry{name, key, value, Cache<Key, Value>::Operation::Update});
+			write_back(std::move(victims));
 
-			// add the hash to the hash map
-			vault.hash_map.insert(hash);
+			return leased_bucket;
+		}
+
+		// serves a point read from the resident bucket, or from the mapped fragment without materializing the bucket
+		[[nodiscard]]
+		std::optional<Value> read(std::string_view table_name, std::size_t bucket_number, const Key& key) noexcept
+		{
+			bucket_id id{table_name, bucket_number};
+
+			{
+				std::shared_lock lock{mutex};
+
+				// the resident bucket may hold changes that did not reach its fragment yet
+				if (auto bucket = resident(id))
+				{
+					hits.fetch_add(1, std::memory_order_relaxed);
+					metrics::buffer_pool_hits.add();
+					lock.unlock();
+
+					return bucket->read(key);
+				}
+
+				misses.fetch_add(1, std::memory_order_relaxed);
+				metrics::buffer_pool_misses.add();
+
+				if (auto itr = mapped.find(id); itr != mapped.end())
+				{
+					auto view = itr->second;
+					lock.unlock();
+
+					return view->read(key);
+				}
+			}
+
+			return map(std::move(id))->read(key);
+		}
+
+		// serves a batch of point reads from one bucket, which is looked up in the pool once for all of them.
+		// reads is called with a function answering a single key, the caller holds the bucket's stripe like for a read
+		template <typename F>
+		void read_batch(std::string_view table_name, std::size_t bucket_number, F&& reads) noexcept
+		{
+			bucket_id id{table_name, bucket_number};
+			std::shared_ptr<bucket_t> bucket;
+			std::shared_ptr<mapped_t> view;
+
+			{
+				std::shared_lock lock{mutex};
+
+				bucket = resident(id);
+
+				if (bucket)
+				{
+					hits.fetch_add(1, std::memory_order_relaxed);
+					metrics::buffer_pool_hits.add();
+				}
+
+				else
+				{
+					misses.fetch_add(1, std::memory_order_relaxed);
+					metrics::buffer_pool_misses.add();
+
+					if (auto mapped_itr = mapped.find(id); mapped_itr != mapped.end())
+						view = mapped_itr->second;
+				}
+			}
+
+			if (bucket)
+				reads([&](const Key& key) { return bucket->read(key); });
+
+			else
+			{
+				if (not view)
+					view = map(std::move(id));
+
+				reads([&](const Key& key) { return view->read(key); });
+			}
+		}
+
+		// writes the entries of bucket from that moves(key) picks as the new bucket to, and returns from with them still in it.
+		// the caller takes them out of from once to is addressable. Whatever an earlier split that never completed left of to is
+		// discarded first. The caller holds the stripe of from exclusively, like for get_bucket
+		template <typename F>
+		auto split(std::string_view table_name, std::size_t from, std::size_t to, F&& moves) noexcept -> std::shared_ptr<bucket_t>
+		{
+			auto source = get_bucket(table_name, from);
+
+			if (not source)
+				return nullptr;
+
+			{
+				bucket_id id{table_name, to};
+				std::unique_lock lock{mutex};
+
+				written_back.wait(lock, [&] { return not evicting.contains(id); });
+				drop_view(id);
+
+				if (auto itr = frames.find(id); itr != frames.end())
+				{
+					if (hand == itr)
+						hand = frames.erase(itr);
+					else
+						frames.erase(itr);
+				}
+			}
+
+			const std::string path = fragment_path(table_name, to);
+			unlink(path.c_str());
+			unlink((path + ".delta").c_str());
+
+			auto target = load(table_name, to);
+
+			if (not target)
+				return nullptr;
+
+			for (const auto& [key, value] : source->data)
+				if (moves(key))
+					target->insert(key, value);
+
+			// the new bucket isn't kept resident, readers map its fragment once it is addressable
+			if (not target->flush())
+				return nullptr;
+
+			return source;
+		}
+
+		// maps a cold fragment and starts reading it in, so a later read doesn't wait on the disk.
+		// the caller must hold the bucket's stripe, like a read
+		void prefetch(std::string_view table_name, std::size_t bucket_number) noexcept
+		{
+			bucket_id id{table_name, bucket_number};
+			std::shared_ptr<mapped_t> view;
+
+			{
+				std::shared_lock lock{mutex};
+
+				if (frames.contains(id) or evicting.contains(id))
+					return;
+
+				if (auto itr = mapped.find(id); itr != mapped.end())
+					view = itr->second;
+			}
+
+			if (not view)
+				view = map(std::move(id));
+
+			view->prefetch();
+		}
+
+		// ordered view of the entries of a bucket within [low, high], the caller must hold the bucket's stripe
+		[[nodiscard]]
+		BucketCursor<Key, Value, Serializer> scan(std::string_view table_name, std::size_t bucket_number, const Key& low, const Key& high) noexcept
+		{
+			bucket_id id{table_name, bucket_number};
+
+			{
+				std::shared_lock lock{mutex};
+
+				if (auto bucket = resident(id))
+				{
+					const auto& data = bucket->data;
+					std::vector<std::pair<Key, Value>> copied;
+
+					if (not (high < low))
+						copied.assign(data.lower_bound(low), data.upper_bound(high));
+
+					return BucketCursor<Key, Value, Serializer>{std::move(copied)};
+				}
+
+				if (auto itr = mapped.find(id); itr != mapped.end())
+					return BucketCursor<Key, Value, Serializer>{itr->second, low, high};
+			}
+
+			return BucketCursor<Key, Value, Serializer>{map(std::move(id)), low, high};
+		}
+
+		// writes every dirty resident bucket, the buckets stay resident
+		bool flush() noexcept
+		{
+			std::shared_lock lock{mutex};
+
+			bool ret = true;
+
+			for (auto& [id, frame] : frames)
+				if (frame.bucket->is_dirty())
+					ret = frame.bucket->flush() and ret;
+
+			return ret;
+		}
+
+		// takes effect the next time a bucket is loaded, only the checkpoint may touch the contents of resident buckets
+		void set_memory_budget(std::size_t budget) noexcept
+		{
+			std::unique_lock lock{mutex};
+			memory_budget = budget;
+		}
+
+		// resident buckets of the table pick it up too, fragments written with another codec stay readable
+		void set_compression(std::string_view table_name, Compression codec)
+		{
+			std::unique_lock lock{mutex};
+
+			compressions.insert_or_assign(std::string{table_name}, codec);
+
+			for (auto itr = frames.lower_bound(bucket_id{table_name, 0}); itr != frames.end() and itr->first.first == table_name; ++itr)
+				itr->second.bucket->set_compression(codec);
+
+			for (auto itr = evicting.lower_bound(bucket_id{table_name, 0}); itr != evicting.end() and itr->first.first == table_name; ++itr)
+				itr->second->set_compression(codec);
+		}
+
+		[[nodiscard]]
+		BufferPoolStats stats() const noexcept
+		{
+			std::shared_lock lock{mutex};
+
+			return BufferPoolStats{hits.load(), misses.load(), evictions, dirty_evictions, frames.size(), memory_usage()};
+		}
+
+	private:
+
+		[[nodiscard]]
+		std::string fragment_path(std::string_view table_name, std::size_t bucket_number) const
+		{
+			return database_path + db_name + "/" + std::string{table_name} + "/fragment" + std::to_string(bucket_number);
+		}
+
+		// the bucket if it is resident or still being written by an eviction, the caller holds mutex
+		[[nodiscard]]
+		std::shared_ptr<bucket_t> resident(const bucket_id& id) const noexcept
+		{
+			if (auto itr = frames.find(id); itr != frames.end())
+			{
+				itr->second.referenced.store(true, std::memory_order_relaxed);
+				return itr->second.bucket;
+			}
+
+			if (auto itr = evicting.find(id); itr != evicting.end())
+				return itr->second;
+
+			return nullptr;
+		}
+
+		// returns the shared read-only view of a cold fragment, mapping it on first use.
+		// the views of other fragments are dropped if it takes the pool over budget, their readers keep them until done
+		[[nodiscard]]
+		std::shared_ptr<mapped_t> map(bucket_id id) noexcept
+		{
+			std::shared_ptr<mapped_t> view{new mapped_t{fragment_path(id.first, id.second)}};
+
+			std::unique_lock lock{mutex};
+			auto [itr, mapped_now] = mapped.try_emplace(std::move(id), std::move(view));
+
+			if (mapped_now)
+			{
+				mapped_usage += itr->second->memory_usage();
+				trim_views(memory_usage(), itr->first);
+			}
+
+			return itr->second;
+		}
+
+		// the caller holds mutex exclusively
+		void drop_view(const bucket_id& id) noexcept
+		{
+			if (auto itr = mapped.find(id); itr != mapped.end())
+			{
+				mapped_usage -= itr->second->memory_usage();
+				mapped.erase(itr);
+			}
+		}
+
+		// drops views until usage fits the budget, returns what is left of it. They are cheaper to get back than a
+		// bucket, so they go before any bucket is evicted
+		std::size_t trim_views(std::size_t usage, const bucket_id& keep = {}) noexcept
+		{
+			for (auto itr = mapped.begin(); itr != mapped.end() and usage > memory_budget;)
+			{
+				if (itr->first == keep)
+				{
+					++itr;
+					continue;
+				}
+
+				const std::size_t view_usage = itr->second->memory_usage();
+				mapped_usage -= view_usage;
+				usage -= view_usage;
+				itr = mapped.erase(itr);
+			}
+
+			return usage;
+		}
+
+		// of the resident buckets and the mapped views
+		[[nodiscard]]
+		std::size_t memory_usage() const noexcept
+		{
+			std::size_t total = mapped_usage;
+
+			for (const auto& [id, frame] : frames)
+				total += frame.usage;
+
+			return total;
+		}
+
+		// buckets that checkpoint workers are still changing keep the size they had when they were handed out
+		void measure() noexcept
+		{
+			for (auto& [id, frame] : frames)
+				if (not leased(frame))
+					frame.usage = frame.bucket->memory_usage();
+		}
+
+		// sweeps the clock hand until the pool fits the budget, the caller holds mutex exclusively.
+		// dirty buckets are returned for the caller to write once it let go of mutex, until then they stay readable in evicting
+		// so that a reader doesn't map the old fragment in the meantime
+		[[nodiscard]]
+		auto evict(const bucket_id& keep = {}) noexcept -> std::vector<std::pair<bucket_id, std::shared_ptr<bucket_t>>>
+		{
+			std::vector<std::pair<bucket_id, std::shared_ptr<bucket_t>>> victims;
+
+			measure();
+			std::size_t usage = trim_views(memory_usage());
+
+			// two turns of the hand are enough to clear every reference bit, buckets that still can't go stay over budget
+			for (std::size_t steps = 2 * frames.size() + 1; steps and frames.size() > 1 and usage > memory_budget; --steps)
+			{
+				if (hand == frames.end())
+					hand = frames.begin();
+
+				// recently used buckets get a second chance, the ones a checkpoint worker holds are still being changed
+				if (hand->first == keep or leased(hand->second) or hand->second.referenced.exchange(false, std::memory_order_relaxed))
+				{
+					++hand;
+					continue;
+				}
+
+				++evictions;
+				if (hand->second.bucket->is_dirty())
+				{
+					++dirty_evictions;
+
+					evicting.emplace(hand->first, hand->second.bucket);
+					victims.emplace_back(hand->first, hand->second.bucket);
+				}
+
+				// a view mapped while the bucket was resident would miss the changes it is leaving with
+				drop_view(hand->first);
+
+				usage -= hand->second.usage;
+				hand = frames.erase(hand);
+			}
+
+			return victims;
+		}
+
+		// writes the buckets evict picked without holding mutex. A bucket that can't be written goes back into the pool,
+		// its changes are not in the fragment
+		void write_back(std::vector<std::pair<bucket_id, std::shared_ptr<bucket_t>>> victims) noexcept
+		{
+			if (victims.empty())
+				return;
+
+			std::vector<bool> written;
+
+			for (auto& [id, bucket] : victims)
+				written.push_back(bucket->flush());
+
+			{
+				std::unique_lock lock{mutex};
+
+				for (std::size_t i = 0; i < victims.size(); ++i)
+				{
+					auto& [id, bucket] = victims[i];
+					evicting.erase(id);
+
+					if (not written[i])
+					{
+						auto& frame = frames.try_emplace(id).first->second;
+						frame.usage = bucket->memory_usage();
+						frame.bucket = std::move(bucket);
+					}
+				}
+			}
+
+			written_back.notify_all();
+		}
+
+		auto load(std::string_view table_name, std::size_t bucket_number) noexcept -> std::unique_ptr<bucket_t>
+		{
+			// the fragment itself is only created once the bucket is flushed, into the directory the checkpoint made for its table
+			std::unique_ptr<bucket_t> bucket{new bucket_t{db_name, table_name, bucket_number}};
+
+			{
+				std::shared_lock lock{mutex};
+
+				if (auto itr = compressions.find(table_name); itr != compressions.end())
+					bucket->set_compression(itr->second);
+			}
+
+			if (bucket->corrupt)
+				return nullptr;
+
+			return bucket;
+		}
+	};
+
+	}
+
+template <typename Key, typename Value>
+struct Cache
+{
+	enum class Operation
+	{
+		Insert,
+		Remove,
+		Update
+	};
+
+	struct Entry
+	{
+		std::string table;
+		Key key;
+		Value value;
+		Operation operation;
+	};
+
+	// entries are kept dense in insertion order, the index maps (table, key) to a position in it
+	std::vector<Entry> entries;
+
+	[[nodiscard]]
+	Entry* find(std::string_view table, const Key& key) noexcept
+	{
+		if (slots.empty())
+			return nullptr;
+
+		const std::size_t hash = hash_of(table, key);
+		const std::size_t mask = slots.size() - 1;
+
+		for (std::size_t i = hash & mask; slots[i].position; i = (i + 1) & mask)
+		{
+			if (slots[i].hash != hash)
+				continue;
+
+			auto& entry = entries[slots[i].position - 1];
+
+			if (entry.key == key and entry.table == table)
+				return &entry;
+		}
+
+		return nullptr;
+	}
+
+	Entry& push(Entry entry)
+	{
+		// keep the load factor under 1/2 so probe sequences stay short
+		if ((entries.size() + 1) * 2 > slots.size())
+			rehash(std::max<std::size_t>(slots.size() * 2, 64));
+
+		const std::size_t hash = hash_of(entry.table, entry.key);
+		entries.push_back(std::move(entry));
+		place(hash, entries.size());
+
+		return entries.back();
+	}
+
+	[[nodiscard]]
+	std::size_t size() const noexcept
+	{
+		return entries.size();
+	}
+
+	void clear() noexcept
+	{
+		entries.clear();
+		std::fill(slots.begin(), slots.end(), Slot{});
+	}
+
+private:
+
+	struct Slot
+	{
+		std::size_t hash{};
+		std::size_t position{}; // index into entries + 1, 0 marks an empty slot
+	};
+
+	std::vector<Slot> slots;
+
+	[[nodiscard]]
+	static std::size_t hash_of(std::string_view table, const Key& key) noexcept
+	{
+		const std::size_t seed = std::hash<std::string_view>{}(table);
+		return std::hash<Key>{}(key) ^ (seed + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+	}
+
+	void place(std::size_t hash, std::size_t position) noexcept
+	{
+		const std::size_t mask = slots.size() - 1;
+
+		std::size_t i = hash & mask;
+		while (slots[i].position)
+			i = (i + 1) & mask;
+
+		slots[i] = Slot{hash, position};
+	}
+
+	void rehash(std::size_t capacity)
+	{
+		slots.assign(capacity, Slot{});
+
+		for (std::size_t i = 0; i < entries.size(); ++i)
+			place(hash_of(entries[i].table, entries[i].key), i + 1);
+	}
+};
+
+
+
+// StorageEngine picks the on-disk layout, details::Engine rewrites hash partitioned fragments and
+// details::LsmEngine (LsmEngine.hpp) keeps a log-structured merge tree per table.
+// Every operation is safe to call from any thread. Buckets are striped over a fixed set of locks, each stripe owning
+// the part of the write cache that belongs to its buckets, so operations on different stripes run in parallel and
+// reads only take their stripe shared.
+// Snapshots see every table as it was when they were taken. While any is live, mutations are numbered and keep the
+// value they replace in their stripe, readers of a snapshot look there first and the rest of the store is unchanged.
+// The number of buckets of a table is part of its layout (TableLayout.hpp). Tables grow one bucket at a time as their
+// fragments outgrow the split threshold, a bucket and the ones split off it share a stripe.
+// Checkpoints run on a background flusher thread. The caches are double buffered: a checkpoint freezes them and starts
+// new ones, so clients keep working while the frozen batch is written out.
+template <typename Key, typename Value, typename Serializer = details::DefaultSerializer<Key, Value>,
+		  template <typename, typename, typename, std::size_t> typename StorageEngine = details::Engine>
+class Vault
+{
+	constexpr static std::size_t stripe_count = 64;
+	constexpr static std::size_t backlog_factor = 4; // writers checkpoint themselves once the flusher falls this far behind
+	constexpr static std::size_t default_split_bytes = 16 * 1024 * 1024;
+	using Engine = StorageEngine<Key, Value, Serializer, 64>;
+	using Operation = typename Cache<Key, Value>::Operation;
+
+	// the value a key had until the mutation numbered until, nullopt if it didn't exist
+	struct Version
+	{
+		std::uint64_t until;
+		std::optional<Value> value;
+	};
+
+	struct alignas(64) Stripe
+	{
+		std::shared_mutex mutex;
+		Cache<Key, Value> cache;
+		Cache<Key, Value> frozen; // the batch being checkpointed, only read until the checkpoint clears it
+		std::map<std::pair<std::string, Key>, std::vector<Version>> versions; // oldest first, kept for the live snapshots
+	};
+
+	Engine engine;
+	std::string name;
+	std::array<Stripe, stripe_count> stripes;
+	std::atomic<std::size_t> cached = 0;
+	std::mutex checkpoint_mutex;
+	bool has_frozen = false; // guarded by checkpoint_mutex
+
+	std::mutex flusher_mutex;
+	std::condition_variable flusher_wake;
+	details::FlushPolicy policy;
+	std::atomic<std::size_t> entry_threshold = policy.entries; // copies of the policy for the client threads
+	std::atomic<std::size_t> byte_threshold = policy.dirty_bytes;
+	bool stopping = false;
+	std::thread flusher;
+
+	mutable std::shared_mutex filters_mutex;
+	std::map<std::string, details::MembershipFilter, std::less<>> filters;
+	std::shared_ptr<const std::byte> legacy_hashes; // mapping of the .hash file until every table it covers has a filter
+	std::size_t legacy_size = 0;
+	mutable std::shared_mutex layouts_mutex;
+	std::map<std::string, details::TableLayout, std::less<>> layouts;
+	std::atomic<std::size_t> split_bytes = default_split_bytes; // a bucket whose fragment grows past it makes its table split
+	std::mutex snapshots_mutex;
+	std::multiset<std::uint64_t> snapshots; // the sequence numbers the live snapshots were taken at
+	std::atomic<std::size_t> live_snapshots = 0;
+	std::atomic<std::uint64_t> sequence = 0; // numbers the mutations made while a snapshot is live
+
+	details::WriteAheadLog<Key, Value, Serializer, Operation> wal;
+	details::IoService io; // declared last, its jobs may use everything above until it is joined
+
+	explicit Vault(std::string_view db_name = "Vault") noexcept : engine{db_name}, name{db_name}, wal{database_path + name + ".wal"}
+	{
+		// databases written before the per-table filters only have the .hash file, it is only read by the tables that need it
+		if (const int fd = open((database_path + name + ".hash").c_str(), O_RDONLY); fd >= 0)
+		{
+			struct stat info{};
+			void* addr = fstat(fd, &info) == 0 and info.st_size > 0 ? mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+			close(fd);
+
+			if (addr != MAP_FAILED)
+			{
+				legacy_hashes = {static_cast<const std::byte*>(addr), [length = info.st_size](const std::byte* data) { munmap(const_cast<std::byte*>(data), length); }};
+				legacy_size = info.st_size;
+			}
+		}
+
+		// layouts are a few bytes per table, the filters are left for the first use of their table
+		for_each_table([this](std::string_view table_name)
+		{
+			layouts.emplace(table_name, details::TableLayout::load(layout_path(table_name), Engine::bucket_size));
+		});
+
+		// a split interrupted by the last shutdown may have left the entries it moved in the bucket that was split
+		if constexpr (Engine::splits_buckets)
+			for (auto& [table_name, table_layout] : layouts)
+				if (table_layout.cleaning)
+					finish_split(table_name, table_layout);
+
+		// bring back the mutations that were logged but not checkpointed before the last shutdown
+		wal.replay([this](std::string_view table, const Key& key, const Value& value, Operation operation)
+		{
+			recover(table, key, value, operation);
+		});
+
+		flusher = std::thread{[this] { flush_loop(); }};
+	}
+
+	[[nodiscard]]
+	std::string filter_path(std::string_view table_name) const
+	{
+		return database_path + name + "/" + std::string{table_name} + "/membership";
+	}
+
+	[[nodiscard]]
+	std::string layout_path(std::string_view table_name) const
+	{
+		return database_path + name + "/" + std::string{table_name} + "/layout";
+	}
+
+	// a new table gets initial_buckets, the layout of an existing one is kept as is.
+	// a new table only lives here until its first write is checkpointed, so reading a table never creates it.
+	// layouts are never erased, the reference stays valid once the lock is released
+	details::TableLayout& layout(std::string_view table_name, std::size_t initial_buckets = Engine::bucket_size)
+	{
+		{
+			std::shared_lock lock{layouts_mutex};
+
+			if (auto itr = layouts.find(table_name); itr != layouts.end())
+				return itr->second;
+		}
+
+		std::unique_lock lock{layouts_mutex};
+		return layouts.try_emplace(std::string{table_name}, initial_buckets).first->second;
+	}
+
+	// creates the directory of a table and writes its layout, which has to be on disk before any fragment written with it
+	bool create_table(std::string_view table_name, details::TableLayout& table_layout) noexcept
+	{
+		for (const auto& dir : {database_path + name, database_path + name + "/" + std::string{table_name}})
+			mkdir(dir.c_str(), 0777);
+
+		return table_layout.persist(layout_path(table_name));
+	}
+
+	// every table is a directory under the database
+	template <typename F>
+	void for_each_table(F&& f) const
+	{
+		DIR* dir = opendir((database_path + name).c_str());
+
+		if (not dir)
+			return;
+
+		while (dirent* table = readdir(dir))
+		{
+			const std::string_view table_name = table->d_name;
+
+			if (table->d_type == DT_DIR and table_name != "." and table_name != "..")
+				f(table_name);
+		}
+
+		closedir(dir);
+	}
+
+	// a filter is loaded the first time its table is used, which only maps its file
+	details::MembershipFilter& membership(std::string_view table_name)
+	{
+		{
+			std::shared_lock lock{filters_mutex};
+
+			if (auto itr = filters.find(table_name); itr != filters.end())
+				return itr->second;
+		}
+
+		std::unique_lock lock{filters_mutex};
+
+		if (auto itr = filters.find(table_name); itr != filters.end())
+			return itr->second;
+
+		const std::string path = filter_path(table_name);
+		auto& filter = filters.emplace(std::string{table_name}, details::MembershipFilter::load(path)).first->second;
+
+		// a table from before the per-table filters starts out with every hash of the legacy file
+		if (legacy_hashes and access(path.c_str(), F_OK) != 0 and access((database_path + name + "/" + std::string{table_name}).c_str(), F_OK) == 0)
+			for (std::size_t offset = sizeof(std::size_t); offset + sizeof(std::size_t) <= legacy_size; offset += sizeof(std::size_t))
+				filter.insert(MILI::deserialize<std::size_t>(std::span<const std::byte, sizeof(std::size_t)>{legacy_hashes.get() + offset, sizeof(std::size_t)}));
+
+		return filter;
+	}
+
+	// root is TableLayout::root of the key or bucket, every bucket split off a root stays in its stripe
+	[[nodiscard]]
+	Stripe& stripe(std::string_view table_name, std::size_t root) noexcept
+	{
+		const std::size_t seed = std::hash<std::string_view>{}(table_name);
+		return stripes[(seed ^ (root + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2))) % stripe_count];
+	}
+
+	// Grows a table by the bucket at its split pointer. The new bucket is written and the layout naming it persisted before
+	// the entries that moved leave the bucket that was split, so a crash never loses them, it can only leave them behind in
+	// both buckets. finish_split cleans that up, the layout says it is needed until it is done.
+	bool split(std::string_view table_name, details::TableLayout& table_layout) noexcept
+	{
+		const auto [from, to] = table_layout.next_split();
+		auto moves = [&](const Key& key) { return table_layout.moves(std::hash<Key>{}(key)); };
+
+		decltype(engine.split(table_name, from, to, moves)) bucket;
+
+		{
+			// from is loaded under its stripe like any bucket, to isn't addressable until the layout grows
+			std::unique_lock lock{stripe(table_name, table_layout.root(from)).mutex};
+			bucket = engine.split(table_name, from, to, moves);
+		}
+
+		if (not bucket)
+			return false;
+
+		table_layout.cleaning = true;
+
+		if (not table_layout.persist_split(layout_path(table_name)))
+		{
+			table_layout.cleaning = false;
+			return false;
+		}
+
+		{
+			// both buckets belong to the stripe of their root, readers of it see the rows in one of them or the other
+			std::unique_lock lock{stripe(table_name, table_layout.root(from)).mutex};
+
+			bucket->erase_if(moves);
+			table_layout.grow();
+		}
+
+		metrics::bucket_splits.add();
+
+		return finish_split(table_name, table_layout);
+	}
+
+	// drops the entries the last split moved out of its bucket, if they are still in there, and clears the cleaning mark
+	bool finish_split(std::string_view table_name, details::TableLayout& table_layout) noexcept
+	{
+		const std::size_t from = table_layout.last_split().first;
+
+		{
+			std::unique_lock lock{stripe(table_name, table_layout.root(from)).mutex};
+			auto bucket = engine.get_bucket(table_name, from);
+
+			if (not bucket)
+				return false;
+
+			bucket->erase_if([&](const Key& key) { return table_layout.bucket(std::hash<Key>{}(key)) != from; });
+
+			if (not bucket->flush())
+				return false;
+		}
+
+		table_layout.cleaning = false;
+
+		return table_layout.persist(layout_path(table_name));
+	}
+
+	// keeps the value a key has before a mutation for the snapshots taken earlier, previous() returns it.
+	// the caller holds the key's stripe exclusively. A snapshot taken after the check gets a sequence number past this
+	// mutation, or waits on the stripe to read the key after it.
+	template <typename Previous>
+	void keep_version(Stripe& key_stripe, std::string_view table_name, const Key& key, Previous&& previous)
+	{
+		if (live_snapshots.load() == 0)
+			return;
+
+		const std::uint64_t until = sequence.fetch_add(1) + 1;
+		key_stripe.versions[std::pair{std::string{table_name}, key}].push_back(Version{until, previous()});
+	}
+
+	// the value of the key as of the snapshot taken at taken if it changed since, the caller holds the key's stripe
+	[[nodiscard]]
+	static const Version* version_at(const Stripe& key_stripe, std::string_view table_name, const Key& key, std::uint64_t taken)
+	{
+		if (key_stripe.versions.empty())
+			return nullptr;
+
+		auto itr = key_stripe.versions.find(std::pair{std::string{table_name}, key});
+
+		return itr == key_stripe.versions.end() ? nullptr : version_after(itr->second, taken);
+	}
+
+	// the first change after taken replaced the value the key had at taken
+	[[nodiscard]]
+	static const Version* version_after(const std::vector<Version>& kept, std::uint64_t taken) noexcept
+	{
+		auto itr = std::ranges::upper_bound(kept, taken, {}, &Version::until);
+
+		return itr == kept.end() ? nullptr : &*itr;
+	}
+
+	// drops the versions no live snapshot can see anymore
+	void release(std::uint64_t taken) noexcept
+	{
+		std::uint64_t horizon;
+
+		{
+			std::lock_guard lock{snapshots_mutex};
+
+			snapshots.erase(snapshots.find(taken));
+			live_snapshots.fetch_sub(1);
+
+			// snapshots taken from here on are numbered past every version kept so far
+			horizon = snapshots.empty() ? sequence.load() : *snapshots.begin();
+		}
+
+		for (auto& stripe : stripes)
+		{
+			{
+				std::shared_lock lock{stripe.mutex};
+
+				if (stripe.versions.empty())
+					continue;
+			}
+
+			std::unique_lock lock{stripe.mutex};
+
+			for (auto itr = stripe.versions.begin(); itr != stripe.versions.end();)
+			{
+				std::erase_if(itr->second, [horizon](const Version& version) { return version.until <= horizon; });
+				itr = itr->second.empty() ? stripe.versions.erase(itr) : std::next(itr);
+			}
+		}
+	}
+
+	// applies a logged mutation to the cache the same way the Table operations did when it was logged
+	void recover(std::string_view table, const Key& key, const Value& value, Operation operation)
+	{
+		const std::size_t hash = std::hash<Key>{}(key);
+
+		if (operation != Operation::Remove)
+			membership(table).insert(hash);
+
+		auto& cache = stripe(table, layout(table).root(hash)).cache;
+
+		if (auto* entry = cache.find(table, key))
+		{
+			entry->value = value;
+			entry->operation = operation == Operation::Remove ? Operation::Remove : Operation::Update;
+		}
+
+		else
+		{
+			cache.push(typename Cache<Key, Value>::Entry{std::string{table}, key, value, operation});
+			++cached;
+		}
+	}
+
+	[[nodiscard]]
+	bool over_threshold() noexcept
+	{
+		return cached.load() >= entry_threshold.load() or wal.size() >= byte_threshold.load();
+	}
+
+	// called by the Table operations once their stripe is released
+	void schedule_checkpoint() noexcept
+	{
+		const std::size_t pending = cached.load(std::memory_order_relaxed);
+		const std::size_t threshold = entry_threshold.load(std::memory_order_relaxed);
+
+		if (pending >= threshold)
+			flusher_wake.notify_one();
+
+		// the flusher can't keep up, writers pay for the checkpoint instead of letting the cache grow without bound
+		if (pending >= threshold * backlog_factor)
+			checkpoint();
+	}
+
+	void flush_loop() noexcept
+	{
+		std::unique_lock lock{flusher_mutex};
+
+		while (not stopping)
+		{
+			flusher_wake.wait_for(lock, policy.interval, [this] { return stopping or over_threshold(); });
+
+			if (stopping)
+				break;
+
+			const bool full = over_threshold();
+			lock.unlock();
+
+			// between checkpoints only the log is synced, which bounds how much a crash can lose to one interval
+			if (full)
+				checkpoint();
+			else
+				wal.commit();
+
+			lock.lock();
+		}
+	}
+
+	using cursor_t = decltype(std::declval<Engine&>().scan(std::string_view{}, 0, std::declval<const Key&>(), std::declval<const Key&>()));
+
+public:
+
+	// Lazy ordered range over a table, returned by Table::scan.
+	// Every bucket is merged with the write cache as it was when the scan started on its stripe, rows are decoded
+	// one at a time from resident copies and mapped fragments instead of loading the buckets.
+	class Scan
+	{
+	public:
+
+		using value_type = std::pair<Key, Value>;
+
+		struct Sentinel
+		{};
+
+		class Iterator
+		{
+		public:
+
+			using value_type = Scan::value_type;
+			using difference_type = std::ptrdiff_t;
+
+			Iterator() noexcept = default;
+
+			explicit Iterator(Scan* parent) noexcept : scan{parent}
+			{}
+
+			const value_type& operator*() const noexcept
+			{
+				return *scan->current;
+			}
+
+			const value_type* operator->() const noexcept
+			{
+				return &*scan->current;
+			}
+
+			Iterator& operator++() noexcept
+			{
+				scan->advance();
+				return *this;
+			}
+
+			void operator++(int) noexcept
+			{
+				scan->advance();
+			}
+
+			bool operator==(Sentinel) const noexcept
+			{
+				return not scan->current;
+			}
+
+		private:
+
+			Scan* scan = nullptr;
+		};
+
+		Scan(const Scan&) = delete;
+		Scan& operator=(const Scan&) = delete;
+		Scan(Scan&&) noexcept = default;
+		Scan& operator=(Scan&&) noexcept = default;
+
+		[[nodiscard]]
+		Iterator begin() noexcept
+		{
+			return Iterator{this};
+		}
+
+		[[nodiscard]]
+		Sentinel end() const noexcept
+		{
+			return {};
+		}
+
+		// returns the next row, nullopt once the range is exhausted
+		std::optional<value_type> next() noexcept
+		{
+			auto ret = std::move(current);
+			advance();
+
+			return ret;
+		}
+
+	private:
+
+		friend class Vault;
+
+		Scan() noexcept = default;
+
+		// the stored rows come from the bucket cursors, the cached ones shadow them and nullopt marks a removal
+		void advance() noexcept
+		{
+			auto later = [&](std::size_t lhs, std::size_t rhs) { return cursors[rhs].key() < cursors[lhs].key(); };
+
+			while (true)
+			{
+				const bool has_stored = not heap.empty();
+				const bool has_cached = cached_position < cached.size();
+
+				if (not has_stored and not has_cached)
+				{
+					current.reset();
+					return;
+				}
+
+				auto step = [&]
+				{
+					std::pop_heap(heap.begin(), heap.end(), later);
+					auto& cursor = cursors[heap.back()];
+					cursor.next();
+
+					if (cursor.valid())
+						std::push_heap(heap.begin(), heap.end(), later);
+					else
+						heap.pop_back();
+				};
+
+				if (has_cached and (not has_stored or not (cursors[heap.front()].key() < cached[cached_position].first)))
+				{
+					auto& [key, value] = cached[cached_position++];
+
+					if (has_stored and cursors[heap.front()].key() == key)
+						step();
+
+					if (value)
+					{
+						current.emplace(std::move(key), std::move(*value));
+						return;
+					}
+
+					continue;
+				}
+
+				auto& cursor = cursors[heap.front()];
+				current.emplace(cursor.key(), cursor.value());
+				step();
+
+				return;
+			}
+		}
+
+		// called once every source is in place
+		void start() noexcept
+		{
+			auto later = [&](std::size_t lhs, std::size_t rhs) { return cursors[rhs].key() < cursors[lhs].key(); };
+
+			for (std::size_t i = 0; i < cursors.size(); ++i)
+				if (cursors[i].valid())
+					heap.push_back(i);
+
+			std::make_heap(heap.begin(), heap.end(), later);
+
+			// newer entries were added last
+			details::keep_newest(cached);
+
+			advance();
+		}
+
+		std::vector<cursor_t> cursors;
+		std::vector<std::size_t> heap; // cursors that still have rows, ordered by their current key
+		std::vector<std::pair<Key, std::optional<Value>>> cached;
+		std::size_t cached_position = 0;
+		std::optional<value_type> current;
+	};
+
+	// Consistent view of every table as of the call to Vault::snapshot(). Reading through it blocks neither writers nor the
+	// flusher, the versions it needs are kept until it is destroyed.
+	class Snapshot
+	{
+	public:
+
+		Snapshot(const Snapshot&) = delete;
+		Snapshot& operator=(const Snapshot&) = delete;
+
+		Snapshot(Snapshot&& rhs) noexcept : vault{std::exchange(rhs.vault, nullptr)}, taken{rhs.taken}
+		{}
+
+		[[nodiscard]]
+		std::optional<Value> read(std::string_view table_name, const Key& key) noexcept
+		{
+			return vault->table(table_name).read_at(key, taken);
+		}
+
+		// ordered rows of the table with keys in [low, high]
+		[[nodiscard]]
+		Scan scan(std::string_view table_name, const Key& low, const Key& high)
+		{
+			return vault->table(table_name).scan_at(low, high, taken);
+		}
+
+		~Snapshot() noexcept
+		{
+			if (vault)
+				vault->release(taken);
+		}
+
+	private:
+
+		friend class Vault;
+
+		Snapshot(Vault& v, std::uint64_t sequence_number) noexcept : vault{&v}, taken{sequence_number}
+		{}
+
+		Vault* vault;
+		std::uint64_t taken;
+	};
+
+private:
+
+	class Table
+	{
+		friend class Vault;
+
+		std::string name;
+		Vault& vault;
+		details::MembershipFilter& filter;
+		details::TableLayout& layout;
+
+		explicit Table(std::string_view table_name, Vault& v, std::size_t initial_buckets) noexcept
+			: name{table_name}, vault{v}, filter{v.membership(table_name)}, layout{v.layout(table_name, initial_buckets)}
+		{}
+
+		[[nodiscard]]
+		std::optional<Value> read_stored(const Key& key, std::size_t bucket_number) noexcept
+		{
+			// resident buckets answer from memory, cold ones from the mapped fragment without being loaded
+			return vault.engine.read(name, bucket_number, key);
+		}
+
+	public:
+
+		[[nodiscard]]
+		std::size_t bucket_count() const noexcept
+		{
+			return layout.bucket_count();
+		}
+
+		// starts loading the buckets of keys on the I/O threads, so a batch touching cold buckets waits on the disk once.
+		// a split in the meantime only makes it load a bucket that is no longer needed
+		void prefetch(std::span<const Key> keys)
+		{
+			std::vector<std::size_t> buckets;
+			buckets.reserve(keys.size());
+
+			for (const auto& key : keys)
+				buckets.push_back(layout.bucket(std::hash<Key>{}(key)));
+
+			std::ranges::sort(buckets);
+			const auto duplicates = std::ranges::unique(buckets);
+			buckets.erase(duplicates.begin(), duplicates.end());
+
+			for (auto bucket_number : buckets)
+			{
+				vault.io.post([&vault = vault, table = name, root = layout.root(bucket_number), bucket_number]
+				{
+					std::shared_lock lock{vault.stripe(table, root).mutex};
+					vault.engine.prefetch(table, bucket_number);
+				});
+			}
+		}
+
+		// ordered rows with keys in [low, high]
+		[[nodiscard]]
+		Scan scan(const Key& low, const Key& high)
+		{
+			return scan_at(low, high, std::nullopt);
+		}
+
+	private:
+
+		friend class Snapshot;
+
+		// scans the table as of the snapshot taken at the given sequence number, or as it is now
+		[[nodiscard]]
+		Scan scan_at(const Key& low, const Key& high, std::optional<std::uint64_t> taken)
+		{
+			metrics::Timer timer{metrics::table_operations_scan};
+
+			Scan ret;
+
+			// roots are grouped by stripe so every stripe is visited once
+			std::array<std::vector<std::size_t>, stripe_count> roots;
+			for (std::size_t root = 0; root < layout.initial_buckets(); ++root)
+				roots[&vault.stripe(name, root) - vault.stripes.data()].push_back(root);
+
+			for (std::size_t i = 0; i < stripe_count; ++i)
+			{
+				if (roots[i].empty())
+					continue;
+
+				auto& stripe = vault.stripes[i];
+				std::shared_lock lock{stripe.mutex};
+
+				// the frozen batch is older than the active cache, so it goes in first
+				for (const auto* cache : {&stripe.frozen, &stripe.cache})
+				{
+					for (const auto& entry : cache->entries)
+					{
+						if (entry.table != name or entry.key < low or high < entry.key)
+							continue;
+
+						if (entry.operation == Cache<Key, Value>::Operation::Remove)
+							ret.cached.emplace_back(entry.key, std::nullopt);
+						else
+							ret.cached.emplace_back(entry.key, entry.value);
+					}
+				}
+
+				// keys changed since the snapshot go in last, with the value they had when it was taken
+				if (taken)
+				{
+					for (auto itr = stripe.versions.lower_bound(std::pair{name, low}); itr != stripe.versions.end(); ++itr)
+					{
+						if (itr->first.first != name or high < itr->first.second)
+							break;
+
+						if (const auto* version = version_after(itr->second, *taken))
+							ret.cached.emplace_back(itr->first.second, version->value);
+					}
+				}
+
+				// the buckets of a root are counted under its stripe, no split can move rows between them meanwhile
+				for (auto root : roots[i])
+					for (std::size_t bucket_number = root; bucket_number < layout.bucket_count(); bucket_number += layout.initial_buckets())
+						ret.cursors.push_back(vault.engine.scan(name, bucket_number, low, high));
+			}
+
+			ret.start();
+
+			return ret;
+		}
+
+		[[nodiscard]]
+		std::optional<Value> read_at(const Key& key, std::uint64_t taken) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_read};
+
+			const std::size_t hash = std::hash<Key>{}(key);
+			auto& stripe = vault.stripe(name, layout.root(hash));
+			std::shared_lock lock{stripe.mutex};
+
+			if (const auto* version = version_at(stripe, name, key, taken))
+				return version->value;
+
+			// the key hasn't changed since the snapshot, the filter only ever grows so it still knows the key if it existed
+			if (not filter.contains(hash))
+				return std::nullopt;
+
+			const std::size_t bucket_number = layout.bucket(hash);
+
+			return read_locked(stripe, key, [&](const Key& stored_key) { return read_stored(stored_key, bucket_number); });
+		}
+
+	public:
+
+		[[nodiscard]]
+		std::optional<Value> read(const Key& key) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_read};
+
+			const std::size_t hash = std::hash<Key>{}(key);
+
+			// if the filter has never seen the key, it does not exist
+			if (not filter.contains(hash))
+				return std::nullopt;
+
+			auto& stripe = vault.stripe(name, layout.root(hash));
+			std::shared_lock lock{stripe.mutex};
+
+			// the bucket is only known once the stripe keeps splits of it away
+			const std::size_t bucket_number = layout.bucket(hash);
+
+			return read_locked(stripe, key, [&](const Key& stored_key) { return read_stored(stored_key, bucket_number); });
+		}
+
+
+		// inserts and updates also fail when the key or the value serializes to more than MILI::max_sized_bytes
+		bool update(const Key& key, Value value)
+		{
+			metrics::Timer timer{metrics::table_operations_update};
+
+			const std::size_t hash = std::hash<Key>{}(key);
+
+			// if the filter has never seen the key, it does not exist
+			if (not filter.contains(hash))
+				return false;
+
+			auto& stripe = vault.stripe(name, layout.root(hash));
+
+			{
+				std::unique_lock lock{stripe.mutex};
+
+				if (not update_locked(stripe, key, std::move(value), layout.bucket(hash)))
+					return false;
+			}
+
+			vault.schedule_checkpoint();
+
+			return true;
+		}
+
+		[[nodiscard]]
+		bool insert(const Key& key, Value value) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_insert};
+
+			const std::size_t hash = std::hash<Key>{}(key);
+			auto& stripe = vault.stripe(name, layout.root(hash));
 
-			if (vault.cache.entries.size() > cache_size)
-				vault.flush();
+			{
+				std::unique_lock lock{stripe.mutex};
+
+				if (not insert_locked(stripe, key, std::move(value), hash, layout.bucket(hash)))
+					return false;
+			}
+
+			vault.schedule_checkpoint();
 
 			return true;
 		}
 
 		[[nodiscard]]
-		bool insert(const Key& key, Value value) noexcept
+		bool remove(const Key& key) noexcept
 		{
+			metrics::Timer timer{metrics::table_operations_remove};
+
 			const std::size_t hash = std::hash<Key>{}(key);
 
-			// search the cache to make sure that we don't have in it
-			for (auto& entry : vault.cache.entries)
+			// if the filter has never seen the key, it does not exist
+			if (not filter.contains(hash))
+				return false;
+
+			auto& stripe = vault.stripe(name, layout.root(hash));
+
 			{
-				if (entry.key == key)
+				std::unique_lock lock{stripe.mutex};
+
+				if (not remove_locked(stripe, key, layout.bucket(hash)))
+					return false;
+			}
+
+			vault.schedule_checkpoint();
+
+			return true;
+		}
+
+		// The batch operations group their keys by bucket, so each bucket is looked up under a single hold of its stripe
+		// instead of once per key. Results are in the order of the input, keys repeated in a batch are applied in that order too.
+
+		[[nodiscard]]
+		std::vector<std::optional<Value>> multi_read(std::span<const Key> keys) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_multi_read};
+
+			std::vector<std::optional<Value>> ret(keys.size());
+
+			for_each_bucket<std::shared_lock<std::shared_mutex>>(keys.size(), [&](std::size_t i) -> const Key& { return keys[i]; },
+				[&](std::span<const Slot> slots, Stripe& stripe, std::size_t bucket_number)
 				{
-					if (entry.operation != Cache<Key, Value>::Operation::Remove)
-						return false;
+					// the keys that the caches don't answer are read from the bucket, which is looked up once for all of them
+					vault.engine.read_batch(name, bucket_number, [&](auto&& read_stored)
+					{
+						for (const auto& slot : slots)
+							if (filter.contains(slot.hash))
+								ret[slot.index] = read_locked(stripe, keys[slot.index], read_stored);
+					});
+				});
+
+			return ret;
+		}
 
-					entry.value = value;
-					entry.operation = Cache<Key, Value>::Operation::Update;
+		[[nodiscard]]
+		std::vector<bool> multi_update(std::span<const std::pair<Key, Value>> entries) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_multi_update};
 
-					// add the hash to the hash map
-					vault.hash_map.insert(hash);
-					return true;
+			std::vector<bool> ret(entries.size());
+
+			for_each_bucket<std::unique_lock<std::shared_mutex>>(entries.size(), [&](std::size_t i) -> const Key& { return entries[i].first; },
+				[&](std::span<const Slot> slots, Stripe& stripe, std::size_t bucket_number)
+				{
+					for (const auto& slot : slots)
+						ret[slot.index] = filter.contains(slot.hash) and update_locked(stripe, entries[slot.index].first, entries[slot.index].second, bucket_number);
+				});
+
+			if (std::ranges::find(ret, true) != ret.end())
+				vault.schedule_checkpoint();
+
+			return ret;
+		}
+
+		[[nodiscard]]
+		std::vector<bool> multi_insert(std::span<const std::pair<Key, Value>> entries) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_multi_insert};
+
+			std::vector<bool> ret(entries.size());
+
+			for_each_bucket<std::unique_lock<std::shared_mutex>>(entries.size(), [&](std::size_t i) -> const Key& { return entries[i].first; },
+				[&](std::span<const Slot> slots, Stripe& stripe, std::size_t bucket_number)
+				{
+					for (const auto& slot : slots)
+						ret[slot.index] = insert_locked(stripe, entries[slot.index].first, entries[slot.index].second, slot.hash, bucket_number);
+				});
+
+			if (std::ranges::find(ret, true) != ret.end())
+				vault.schedule_checkpoint();
+
+			return ret;
+		}
+
+		[[nodiscard]]
+		std::vector<bool> multi_remove(std::span<const Key> keys) noexcept
+		{
+			metrics::Timer timer{metrics::table_operations_multi_remove};
+
+			std::vector<bool> ret(keys.size());
+
+			for_each_bucket<std::unique_lock<std::shared_mutex>>(keys.size(), [&](std::size_t i) -> const Key& { return keys[i]; },
+				[&](std::span<const Slot> slots, Stripe& stripe, std::size_t bucket_number)
+				{
+					for (const auto& slot : slots)
+						ret[slot.index] = filter.contains(slot.hash) and remove_locked(stripe, keys[slot.index], bucket_number);
+				});
+
+			if (std::ranges::find(ret, true) != ret.end())
+				vault.schedule_checkpoint();
+
+			return ret;
+		}
+
+	private:
+
+		// where a key of a batch is, and which bucket it belongs to
+		struct Slot
+		{
+			std::size_t root;
+			std::size_t bucket_number;
+			std::size_t index;
+			std::size_t hash;
+		};
+
+		// calls operation(slots, stripe, bucket number) with the keys of every bucket in the batch, holding the bucket's stripe by Lock
+		template <typename Lock, typename KeyAt, typename Operation>
+		void for_each_bucket(std::size_t count, KeyAt&& key_at, Operation&& operation)
+		{
+			std::vector<Slot> slots;
+			slots.reserve(count);
+
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const std::size_t hash = std::hash<Key>{}(key_at(i));
+				slots.push_back(Slot{layout.root(hash), 0, i, hash});
+			}
+
+			std::ranges::sort(slots, [](const Slot& lhs, const Slot& rhs) {
+				return std::tie(lhs.root, lhs.index) < std::tie(rhs.root, rhs.index);
+			});
+
+			for (std::size_t begin = 0, end = 0; begin < slots.size(); begin = end)
+			{
+				const std::size_t root = slots[begin].root;
+
+				while (end < slots.size() and slots[end].root == root)
+					++end;
+
+				auto& stripe = vault.stripe(name, root);
+				Lock lock{stripe.mutex};
+
+				// the buckets of a root are only known once its stripe keeps splits away, within a bucket the keys keep their input order
+				const std::span<Slot> run = std::span{slots}.subspan(begin, end - begin);
+
+				for (auto& slot : run)
+					slot.bucket_number = layout.bucket(slot.hash);
+
+				std::ranges::sort(run, [](const Slot& lhs, const Slot& rhs) {
+					return std::tie(lhs.bucket_number, lhs.index) < std::tie(rhs.bucket_number, rhs.index);
+				});
+
+				for (std::size_t first = 0, last = 0; first < run.size(); first = last)
+				{
+					while (last < run.size() and run[last].bucket_number == run[first].bucket_number)
+						++last;
+
+					operation(std::span<const Slot>{run.subspan(first, last - first)}, stripe, run[first].bucket_number);
+				}
+			}
+		}
+
+		// The point operations once the key's stripe is held, shared for reads and exclusively for the rest.
+		// Callers check the filter first where a key it has never seen can't exist, and schedule the checkpoint after letting go
+
+		// stored(key) answers for the bucket when neither cache has the key
+		template <typename Stored>
+		[[nodiscard]]
+		std::optional<Value> read_locked(Stripe& stripe, const Key& key, Stored&& stored) noexcept
+		{
+			// search the caches for the key, the active one is newer than the batch being checkpointed
+			for (auto* cache : {&stripe.cache, &stripe.frozen})
+			{
+				if (const auto* entry = cache->find(name, key))
+				{
+					if (entry->operation == Cache<Key, Value>::Operation::Remove)
+						return std::nullopt;
+
+					else
+						return entry->value;
 				}
 			}
 
-			// check if we have the correct bucket
-			if (not vault.bucket or vault.bucket->get_name() != name or vault.bucket->get_id() != hash % vault.engine.bucket_size)
+			return stored(key);
+		}
+
+		bool update_locked(Stripe& stripe, const Key& key, Value value, std::size_t bucket_number)
+		{
+			// search the cache for the key
+			if (auto* entry = stripe.cache.find(name, key))
+			{
+				if (entry->operation == Cache<Key, Value>::Operation::Remove)
+					return false;
+
+				if (not vault.wal.append(name, key, value, Cache<Key, Value>::Operation::Update))
+					return false;
+
+				vault.keep_version(stripe, name, key, [&] { return std::optional{entry->value}; });
+
+				entry->value = value;
+				entry->operation = Cache<Key, Value>::Operation::Update;
+
+				return true;
+			}
+
+			const auto* frozen = stripe.frozen.find(name, key);
+			std::optional<Value> stored;
+
+			if (frozen)
 			{
-				vault.bucket = std::nullopt;
-				vault.bucket = vault.engine.get_bucket(name, hash % vault.engine.bucket_size);
+				if (frozen->operation == Cache<Key, Value>::Operation::Remove)
+					return false;
 			}
 
-			// if the bucket already has the entry, return false
-			if (vault.bucket->read(key))
+			// the filter may answer with a false positive, make sure the key is really there
+			else if (not (stored = read_stored(key, bucket_number)))
 				return false;
 
-			// add data to the cache and the hash map
-			vault.cache.entries.push_back(typename Cache<Key, Value>::Entry{name, key, value, Cache<Key, Value>::Operation::Insert});
-			vault.hash_map.insert(hash);
+			if (not vault.wal.append(name, key, value, Cache<Key, Value>::Operation::Update))
+				return false;
 
-			// if the cache is full, flush it
-			if (vault.cache.entries.size() >= cache_size)
-				vault.flush();
+			vault.keep_version(stripe, name, key, [&] { return frozen ? std::optional{frozen->value} : std::move(stored); });
 
+			// add the entry to the cache
+			stripe.cache.push(typename Cache<Key, Value>::Entry{name, key, value, Cache<Key, Value>::Operation::Update});
+			++vault.cached;
 
 			return true;
 		}
 
-		[[nodiscard]]
-		bool remove(const Key& key) noexcept
+		bool insert_locked(Stripe& stripe, const Key& key, Value value, std::size_t hash, std::size_t bucket_number) noexcept
 		{
-			const std::size_t hash = std::hash<Key>{}(key);
+			// search the cache to make sure that we don't have in it
+			if (auto* entry = stripe.cache.find(name, key))
+			{
+				if (entry->operation != Cache<Key, Value>::Operation::Remove)
+					return false;
 
-			// if hash does not exist in the hash map, return false
-			if (not vault.hash_map.count(hash))
+				if (not vault.wal.append(name, key, value, Cache<Key, Value>::Operation::Insert))
+					return false;
+
+				vault.keep_version(stripe, name, key, [] { return std::optional<Value>{}; });
+
+				entry->value = value;
+				entry->operation = Cache<Key, Value>::Operation::Update;
+
+				return true;
+			}
+
+			if (const auto* entry = stripe.frozen.find(name, key))
+			{
+				if (entry->operation != Cache<Key, Value>::Operation::Remove)
+					return false;
+			}
+
+			// if the bucket already has the entry, return false. keys the filter has never seen skip the lookup
+			else if (filter.contains(hash) and read_stored(key, bucket_number))
+				return false;
+
+			if (not vault.wal.append(name, key, value, Cache<Key, Value>::Operation::Insert))
 				return false;
 
+			vault.keep_version(stripe, name, key, [] { return std::optional<Value>{}; });
+
+			// add data to the cache and the filter
+			stripe.cache.push(typename Cache<Key, Value>::Entry{name, key, value, Cache<Key, Value>::Operation::Insert});
+			filter.insert(hash);
+			++vault.cached;
+
+			return true;
+		}
+
+		bool remove_locked(Stripe& stripe, const Key& key, std::size_t bucket_number) noexcept
+		{
 			// check the cache
-			for (auto& entry : vault.cache.entries)
+			if (auto* entry = stripe.cache.find(name, key))
 			{
-				if (entry.key == key)
-				{
-					if (entry.operation == Cache<Key, Value>::Operation::Remove)
-						return false;
+				if (entry->operation == Cache<Key, Value>::Operation::Remove)
+					return false;
 
-					entry.operation = Cache<Key, Value>::Operation::Remove;
+				if (not vault.wal.append(name, key, Value{}, Cache<Key, Value>::Operation::Remove))
+					return false;
 
-					// remove the hash from the map
-					vault.hash_map.erase(hash);
-					return true;
-				}
+				vault.keep_version(stripe, name, key, [&] { return std::optional{entry->value}; });
+
+				entry->operation = Cache<Key, Value>::Operation::Remove;
+
+				return true;
+			}
+
+			const auto* frozen = stripe.frozen.find(name, key);
+			std::optional<Value> stored;
+
+			if (frozen)
+			{
+				if (frozen->operation == Cache<Key, Value>::Operation::Remove)
+					return false;
 			}
 
-			// add operation to the cache to be performed later
-			vault.cache.entries.push_back(typename Cache<Key, Value>::Entry{name, key, Value{}, Cache<Key, Value>::Operation::Remove});
-			vault.hash_map.erase(hash);
+			// the filter may answer with a false positive, make sure the key is really there
+			else if (not (stored = read_stored(key, bucket_number)))
+				return false;
+
+			if (not vault.wal.append(name, key, Value{}, Cache<Key, Value>::Operation::Remove))
+				return false;
+
+			vault.keep_version(stripe, name, key, [&] { return frozen ? std::optional{frozen->value} : std::move(stored); });
 
-			// if the cache is full, flush it
-			if (vault.cache.entries.size() >= cache_size)
-				vault.flush();
+			// add operation to the cache to be performed later, bloom filters can't forget so the filter stays as is
+			stripe.cache.push(typename Cache<Key, Value>::Entry{name, key, Value{}, Cache<Key, Value>::Operation::Remove});
+			++vault.cached;
 
 			return true;
 		}
@@ -581,6 +2460,9 @@ class Vault
 
 public:
 
+	using key_type = Key;
+	using value_type = Value;
+	using serializer_type = Serializer;
 
 	// The goal is to not allow more than one instance for a database
 	static auto get_instance(std::string_view db_name) noexcept -> std::optional<std::reference_wrapper<Vault>>
@@ -592,7 +2474,7 @@ public:
 
 		else
 		{
-			static Vault vault{db_engine, db_name}; // TODO:: lifetime management?
+			static Vault vault{db_name}; // TODO:: lifetime management?
 			return std::optional{std::ref(vault)};
 		}
 	}
@@ -609,85 +2491,314 @@ public:
 
 	}
 
-	Table table(std::string_view table_name) noexcept
+	// a table that doesn't exist yet starts with initial_buckets, existing ones keep the layout they grew into
+	Table table(std::string_view table_name, std::size_t initial_buckets = Engine::bucket_size) noexcept
+	{
+		return Table{table_name, *this, initial_buckets};
+	}
+
+	// a view of every table as it is now, see Snapshot
+	[[nodiscard]]
+	Snapshot snapshot()
 	{
-		return Table{table_name, *this};
+		std::lock_guard lock{snapshots_mutex};
+
+		// mutations look for live snapshots before numbering themselves, see keep_version
+		live_snapshots.fetch_add(1);
+		const std::uint64_t taken = sequence.load();
+		snapshots.insert(taken);
+
+		return Snapshot{*this, taken};
 	}
 
+	// makes every mutation so far durable by committing the log, the fragments are rewritten by the flusher
 	bool flush() noexcept
 	{
-		// sort the cache by bucket number
-		std::sort(cache.entries.begin(), cache.entries.end(), [&](const auto& lhs, const auto& rhs) {
-			return (std::hash<Key>{}(lhs.key) % engine.bucket_size) < (std::hash<Key>{}(rhs.key) % engine.bucket_size);
+		if (not wal.commit())
+			return false;
+
+		if (over_threshold())
+			flusher_wake.notify_one();
+
+		return true;
+	}
+
+	// replays a cached mutation on its bucket, the caller holds the bucket's stripe exclusively
+	template <typename Bucket>
+	static bool apply(Bucket& bucket, const typename Cache<Key, Value>::Entry& entry) noexcept
+	{
+		switch (entry.operation)
+		{
+			case Cache<Key, Value>::Operation::Insert:
+
+				if (not bucket.insert(entry.key, entry.value))
+					bucket.update(entry.key, entry.value);
+
+			break;
+
+			case Cache<Key, Value>::Operation::Update:
+
+				if (not bucket.update(entry.key, entry.value))
+					bucket.insert(entry.key, entry.value);
+
+			break;
+
+			case Cache<Key, Value>::Operation::Remove: bucket.remove(entry.key);
+				break;
+
+			default:
+				return false;
+		}
+
+		return true;
+	}
+
+	// applies the cache to the fragments, after which the log can be discarded
+	bool checkpoint() noexcept
+	{
+		std::lock_guard guard{checkpoint_mutex};
+		metrics::Timer timer{metrics::checkpoints};
+
+		// a batch left over from a failed checkpoint is applied again before a new one is frozen
+		if (not has_frozen)
+		{
+			// most of the log is synced before taking the stripes so the freeze itself stays short
+			if (not wal.commit())
+				return false;
+
+			std::array<std::unique_lock<std::shared_mutex>, stripe_count> locks;
+			for (std::size_t i = 0; i < stripe_count; ++i)
+				locks[i] = std::unique_lock{stripes[i].mutex};
+
+			// the sealed log holds exactly the frozen batch, mutations from here on go to the new one
+			if (not wal.seal())
+				return false;
+
+			for (auto& stripe : stripes)
+				std::swap(stripe.cache, stripe.frozen);
+
+			cached = 0;
+			has_frozen = true;
+		}
+
+		// the legacy hash file can only go once every table it covers has a filter of its own
+		if (legacy_hashes)
+			for_each_table([this](std::string_view table_name) { membership(table_name); });
+
+		// split the frozen batch by table and bucket number, only this thread changes it so no lock is needed to look.
+		// splits are made by the checkpoint too, so the bucket numbers hold until it is done
+		std::vector<std::pair<std::size_t, const typename Cache<Key, Value>::Entry*>> order;
+
+		for (const auto& stripe : stripes)
+		{
+			// entries of one table tend to come in runs, the layout is only looked up again when the table changes
+			std::string_view layout_table;
+			details::TableLayout* table_layout = nullptr;
+
+			for (const auto& entry : stripe.frozen.entries)
+			{
+				if (not table_layout or entry.table != layout_table)
+				{
+					layout_table = entry.table;
+					table_layout = &layout(entry.table);
+
+					// the first write of a table creates it, the next checkpoint retries if this fails
+					if (not table_layout->is_persisted() and not create_table(entry.table, *table_layout))
+						return false;
+				}
+
+				order.emplace_back(table_layout->bucket(std::hash<Key>{}(entry.key)), &entry);
+			}
+		}
+
+		std::stable_sort(order.begin(), order.end(), [](const auto& lhs, const auto& rhs) {
+			return std::tie(lhs.second->table, lhs.first) < std::tie(rhs.second->table, rhs.first);
 		});
 
-		for (const auto& entry: cache.entries)
+		// each partition is the run of entries of one bucket in order
+		std::vector<std::pair<std::size_t, std::size_t>> partitions;
+
+		for (std::size_t i = 0; i < order.size(); ++i)
+			if (i == 0 or order[i].first != order[i - 1].first or order[i].second->table != order[i - 1].second->table)
+				partitions.emplace_back(i, i);
+
+		for (std::size_t i = 0; i < partitions.size(); ++i)
+			partitions[i].second = i + 1 < partitions.size() ? partitions[i + 1].first : order.size();
+
+		// buckets are applied and written in parallel, the filters are written alongside them as one more task
+		std::atomic<bool> written = true;
+		std::vector<char> overflowed(partitions.size()); // the bucket of the partition outgrew the split threshold
+
+		details::parallel_for(io, partitions.size() + 1, [&](std::size_t i)
 		{
-			// get the bucket
-			const auto bucket_number = std::hash<Key>{}(entry.key) % engine.bucket_size;
+			if (i == partitions.size())
+			{
+				std::shared_lock filters_lock{filters_mutex};
+
+				// filters only write the blocks that changed since the last checkpoint. A table first written to after the
+				// batch was frozen has no directory yet, its filter is written by the checkpoint that creates it
+				for (auto& [table_name, filter] : filters)
+					if (filter.is_dirty() and access((database_path + name + "/" + table_name).c_str(), F_OK) == 0 and not filter.persist(filter_path(table_name)))
+						written = false;
+
+				return;
+			}
+
+			const auto [begin, end] = partitions[i];
+			const std::string_view table = order[begin].second->table;
+			const std::size_t bucket_number = order[begin].first;
 
-			if (not bucket or bucket->get_name() != entry.table or bucket->get_id() != bucket_number)
+			// the stripe is held from loading the bucket until it is written, a reader of it could otherwise map the fragment
+			// the bucket is about to replace and keep serving from that view once the bucket is evicted
+			std::unique_lock lock{stripe(table, layout(table).root(bucket_number)).mutex};
+			auto bucket = engine.get_bucket(table, bucket_number);
+
+			if (not bucket)
 			{
-				bucket = std::nullopt; // flush the damn thing
-				bucket = engine.get_bucket(entry.table, bucket_number);
+				written = false;
+				return;
 			}
 
-			if (bucket == std::nullopt)
-				return false;
+			// buckets that take a sorted run of changes get it whole, which spares a flat container a shift per entry
+			if constexpr (requires (std::span<const std::pair<const Key*, const Value*>> changes) { bucket->merge(changes); })
+			{
+				std::vector<std::pair<const Key*, const Value*>> changes;
+				changes.reserve(end - begin);
+
+				for (std::size_t e = begin; e < end; ++e)
+				{
+					const auto& entry = *order[e].second;
+					changes.emplace_back(&entry.key, entry.operation == Cache<Key, Value>::Operation::Remove ? nullptr : &entry.value);
+				}
+
+				// a table has one entry per key in the batch
+				std::ranges::sort(changes, [](const auto& lhs, const auto& rhs) { return *lhs.first < *rhs.first; });
 
-			switch (entry.operation)
+				bucket->merge(changes);
+			}
+			else
 			{
-				case Cache<Key, Value>::Operation::Insert:
+				for (std::size_t e = begin; e < end; ++e)
+					if (not apply(*bucket, *order[e].second))
+						written = false;
+			}
 
-					if (not bucket.value().insert(entry.key, entry.value))
-						assert(bucket.value().update(entry.key, entry.value));
+			if (not bucket->flush())
+				written = false;
 
-				break;
+			if constexpr (Engine::splits_buckets)
+				overflowed[i] = bucket->bytes() > split_bytes.load(std::memory_order_relaxed);
+		});
 
-				case Cache<Key, Value>::Operation::Update:
+		if (not written)
+			return false;
 
-					if (not bucket.value().update(entry.key, entry.value))
-						assert(bucket.value().insert(entry.key, entry.value));
+		if constexpr (Engine::splits_buckets)
+		{
+			// splits that were cut short are finished before the tables grow any further
+			{
+				std::shared_lock lock{layouts_mutex};
 
-				break;
+				for (auto& [table_name, table_layout] : layouts)
+					if (table_layout.cleaning)
+						finish_split(table_name, table_layout);
+			}
 
-				case Cache<Key, Value>::Operation::Remove: bucket.value().remove(entry.key);
-					break;
+			// a table grows by one bucket per checkpoint, the one at its split pointer rather than the one that overflowed.
+			// a split that fails is tried again the next time the table overflows, the batch itself is already written
+			std::string_view split_table;
 
-				default:
-					return false;
+			for (std::size_t i = 0; i < partitions.size(); ++i)
+			{
+				const std::string_view table = order[partitions[i].first].second->table;
+
+				if (not overflowed[i] or table == split_table)
+					continue;
+
+				split_table = table;
+				split(table, layout(table));
 			}
 		}
 
-		cache.entries.clear();
+		// writes whatever is still dirty and lets the engine start its own background work, like compaction
+		if (not engine.flush())
+			return false;
 
-		auto&& hash_data = MILI::serialize(hash_map);
-		auto&& hash_size = MILI::serialize(hash_map.size());
+		// the filters now cover everything the legacy hash file did
+		if (legacy_hashes)
+		{
+			unlink((database_path + name + ".hash").c_str());
 
-		FILE* hash_file = fopen((database_path + name + ".hash").c_str(), "wb");
+			std::unique_lock lock{filters_mutex};
+			legacy_hashes.reset();
+		}
 
-		if (not hash_file)
-			return false;
+		for (auto& stripe : stripes)
+		{
+			std::unique_lock stripe_lock{stripe.mutex};
+			stripe.frozen.clear();
+		}
+
+		has_frozen = false;
+
+		return wal.drop_sealed();
+	}
+
+	void set_flush_policy(details::FlushPolicy flush_policy) noexcept
+	{
+		{
+			std::lock_guard lock{flusher_mutex};
+
+			policy = flush_policy;
+			entry_threshold = policy.entries;
+			byte_threshold = policy.dirty_bytes;
+		}
+
+		flusher_wake.notify_one();
+	}
+
+	// the I/O threads of the vault, completions of submitted jobs run when the event loop polls it
+	[[nodiscard]]
+	details::IoService& io_service() noexcept
+	{
+		return io;
+	}
 
-		fwrite(hash_size.data(), hash_size.size(), 1, hash_file);
-		fwrite(hash_data.data(), hash_data.size(), 1, hash_file);
+	[[nodiscard]]
+	details::BufferPoolStats buffer_pool_stats() const noexcept
+	{
+		return engine.stats();
+	}
 
-		fclose(hash_file);
+	void set_memory_budget(std::size_t bytes) noexcept
+	{
+		engine.set_memory_budget(bytes);
+	}
 
-		bucket = std::nullopt;
+	// tables split a bucket at the next checkpoint once the fragment of one of theirs grows past bytes
+	void set_split_threshold(std::size_t bytes) noexcept
+	{
+		split_bytes = bytes;
+	}
 
-		return false;
+	// compresses the blocks of the table's fragments as they are rewritten, a point read then inflates only the block
+	// it needs. The choice isn't persisted, fragments already written keep their codec until they are compacted
+	void set_compression(std::string_view table_name, Compression codec)
+	{
+		engine.set_compression(table_name, codec);
 	}
 
 	~Vault() noexcept
 	{
-		flush();
+		{
+			std::lock_guard lock{flusher_mutex};
+			stopping = true;
+		}
+
+		flusher_wake.notify_one();
+		flusher.join();
 
-		// TODO: Use MILI::is_a concept
-		// TODO: this should be done as part of the flush operation
-		// serialize the hash map and write it to a file
-		auto&& hash_data = MILI::serialize(hash_map);
-		auto&& hash_size = MILI::serialize(hash_map.size());
+		checkpoint();
 	}
 
 };
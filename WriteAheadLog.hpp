@@ -0,0 +1,390 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <ranges>
+#include <utility>
+#include <mutex>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Serializer.hpp"
+#include "Checksum.hpp"
+#include "Metrics.hpp"
+
+namespace MILI::Database::details
+{
+
+// Append-only log of table mutations.
+// Every record is framed as [u32 payload size][u32 crc32c of payload][payload], the payload being
+// [u8 operation][u16 table size][table][u16 key size][key][u16 value size][value]. Mutations whose table, key or value
+// don't fit behind a u16 are refused, which keeps them out of the fragments and runs that share the framing.
+// Records are buffered and written + fsynced together once group_size of them are pending or commit() is called.
+// A group that fails to write is cut off the file again and retried whole. A failed fsync can't be retried, the kernel may
+// already have dropped the pages it couldn't write, so it breaks the log: from then on nothing is appended or committed.
+// Appending is safe from any thread, whoever commits writes out every record appended by the others in the meantime.
+// A checkpoint seals the log into <path>.sealed and keeps logging into a fresh one, the sealed segment is dropped
+// once its records have reached the fragments.
+template <typename Key, typename Value, typename Serializer, typename Operation>
+class WriteAheadLog
+{
+public:
+
+	constexpr static std::size_t default_group_size = 256;
+
+	explicit WriteAheadLog(std::string log_path, std::size_t group = default_group_size) noexcept
+		: path{std::move(log_path)}, sealed_path{path + ".sealed"}, group_size{group}
+	{}
+
+	WriteAheadLog(const WriteAheadLog&) = delete;
+	WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+	// reads back every intact record, the sealed segment first since it is older
+	// a torn record at the tail from a crash mid-write is cut off
+	template <typename F>
+	std::size_t replay(F&& apply) noexcept
+	{
+		std::size_t records = 0;
+
+		if (int sealed = open(sealed_path.c_str(), O_RDWR); sealed >= 0)
+		{
+			replay_file(sealed, apply, records);
+			close(sealed);
+		}
+
+		if (not open_log())
+			return records;
+
+		durable_size = replay_file(fd, apply, records);
+
+		return records;
+	}
+
+	// false if the record doesn't fit, nothing is logged then and the caller must not apply the mutation
+	[[nodiscard]]
+	bool append(std::string_view table, const Key& key, const Value& value, Operation operation)
+	{
+		std::unique_lock lock{mutex};
+
+		if (broken)
+			return false;
+
+		const std::size_t frame_begin = pending.size();
+		pending.resize(frame_begin + frame_size);
+
+		put(MILI::serialize(static_cast<std::uint8_t>(operation)));
+
+		bool fits = table.size() <= MILI::max_sized_bytes;
+
+		if (fits)
+		{
+			put_sized(std::span{reinterpret_cast<const std::byte*>(table.data()), table.size()});
+			fits = MILI::serialize_sized_into<Serializer>(pending, key) and MILI::serialize_sized_into<Serializer>(pending, value);
+		}
+
+		if (not fits)
+		{
+			pending.resize(frame_begin);
+			metrics::wal_rejected.add();
+			return false;
+		}
+
+		std::span<const std::byte> payload{pending.data() + frame_begin + frame_size, pending.size() - frame_begin - frame_size};
+		const auto payload_size = MILI::serialize(static_cast<std::uint32_t>(payload.size()));
+		const auto checksum = MILI::serialize(MILI::crc32c(payload));
+
+		std::copy(payload_size.begin(), payload_size.end(), pending.begin() + frame_begin);
+		std::copy(checksum.begin(), checksum.end(), pending.begin() + frame_begin + sizeof(std::uint32_t));
+
+		if (++pending_records >= group_size)
+		{
+			lock.unlock();
+			commit();
+		}
+
+		return true;
+	}
+
+	// writes and fsyncs every pending record as a single group
+	bool commit() noexcept
+	{
+		// one writer at a time, records appended while it syncs form the next group
+		std::lock_guard io_lock{io_mutex};
+		return write_pending();
+	}
+
+	// moves every record logged so far into the sealed segment and starts a new log, nothing may be appended concurrently
+	bool seal() noexcept
+	{
+		std::lock_guard io_lock{io_mutex};
+
+		if (not write_pending())
+			return false;
+
+		if (access(sealed_path.c_str(), F_OK) == 0)
+		{
+			// a checkpoint was interrupted, its sealed records are not in the fragments yet so the new ones are added to them
+			std::vector<std::byte> log(durable_size);
+			const int sealed = open(sealed_path.c_str(), O_WRONLY | O_APPEND);
+
+			if (sealed < 0)
+				return false;
+
+			const bool ret = pread(fd, log.data(), log.size(), 0) == static_cast<ssize_t>(log.size())
+				and write_all(sealed, log) and fdatasync(sealed) == 0;
+
+			close(sealed);
+
+			if (not ret or ftruncate(fd, 0) != 0 or fdatasync(fd) != 0)
+				return false;
+		}
+
+		else
+		{
+			// without a log file nothing was appended since the last seal, there is nothing to move
+			if (rename(path.c_str(), sealed_path.c_str()) != 0 and errno != ENOENT)
+				return false;
+
+			if (fd >= 0)
+				close(fd);
+
+			fd = -1;
+		}
+
+		std::lock_guard lock{mutex};
+		durable_size = 0;
+
+		return true;
+	}
+
+	// called once every sealed record has reached the fragments
+	bool drop_sealed() noexcept
+	{
+		return unlink(sealed_path.c_str()) == 0 or errno == ENOENT;
+	}
+
+	[[nodiscard]]
+	std::size_t size() const noexcept
+	{
+		std::lock_guard lock{mutex};
+		return durable_size + pending.size();
+	}
+
+	~WriteAheadLog() noexcept
+	{
+		if (fd < 0)
+			return;
+
+		commit();
+		close(fd);
+	}
+
+private:
+
+	constexpr static std::size_t frame_size = 2 * sizeof(std::uint32_t);
+
+	// writes all of data, a write interrupted by a signal is resumed
+	static bool write_all(int file, std::span<const std::byte> data) noexcept
+	{
+		std::size_t written = 0;
+
+		while (written < data.size())
+		{
+			const ssize_t count = write(file, data.data() + written, data.size() - written);
+
+			if (count < 0 and errno == EINTR)
+				continue;
+
+			if (count <= 0)
+				return false;
+
+			written += count;
+		}
+
+		return true;
+	}
+
+	// expects io_mutex to be held
+	bool write_pending() noexcept
+	{
+		std::vector<std::byte> group;
+
+		{
+			std::lock_guard lock{mutex};
+
+			if (broken)
+				return false;
+
+			if (pending.empty())
+				return true;
+
+			group.swap(pending);
+			pending.swap(spare);
+			pending_records = 0;
+		}
+
+		metrics::Timer timer{metrics::wal_commits};
+
+		// the log is appended to, so whatever a failed write left past the durable records has to go before a retry
+		const bool written = open_log() and write_all(fd, group);
+
+		if (not written and fd >= 0 and ftruncate(fd, durable_size) != 0)
+		{
+			std::lock_guard lock{mutex};
+			broken = true;
+			return false;
+		}
+
+		const bool synced = written and fdatasync(fd) == 0;
+
+		std::lock_guard lock{mutex};
+
+		if (written and not synced)
+		{
+			broken = true;
+			return false;
+		}
+
+		if (not written)
+		{
+			// keep the records for the next attempt, in front of the ones appended meanwhile
+			group.insert(group.end(), pending.begin(), pending.end());
+			pending.swap(group);
+			return false;
+		}
+
+		metrics::wal_bytes.add(group.size());
+
+		durable_size += group.size();
+		group.clear();
+		spare.swap(group);
+
+		return true;
+	}
+
+	// returns the size of the intact part of the file
+	template <typename F>
+	static std::size_t replay_file(int file, F& apply, std::size_t& records) noexcept
+	{
+		struct stat info{};
+		if (fstat(file, &info) != 0)
+			return 0;
+
+		std::vector<std::byte> log(info.st_size);
+
+		if (pread(file, log.data(), log.size(), 0) != static_cast<ssize_t>(log.size()))
+			return 0;
+
+		std::size_t offset = 0;
+
+		while (offset + frame_size <= log.size())
+		{
+			const auto payload_size = read_integral<std::uint32_t>(log, offset);
+			const auto checksum = read_integral<std::uint32_t>(log, offset + sizeof(std::uint32_t));
+
+			if (offset + frame_size + payload_size > log.size())
+				break;
+
+			std::span<const std::byte> payload{log.data() + offset + frame_size, payload_size};
+
+			if (MILI::crc32c(payload) != checksum or not decode(payload, apply))
+				break;
+
+			offset += frame_size + payload_size;
+			++records;
+		}
+
+		if (offset != log.size())
+			ftruncate(file, offset);
+
+		return offset;
+	}
+
+	bool open_log() noexcept
+	{
+		if (fd < 0)
+			fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+
+		return fd >= 0;
+	}
+
+	void put(const std::ranges::range auto& bytes)
+	{
+		pending.insert(pending.end(), bytes.begin(), bytes.end());
+	}
+
+	void put_sized(std::span<const std::byte> bytes)
+	{
+		put(MILI::serialize(static_cast<std::uint16_t>(bytes.size())));
+		put(bytes);
+	}
+
+	template <std::integral T>
+	[[nodiscard]]
+	static T read_integral(std::span<const std::byte> buffer, std::size_t offset) noexcept
+	{
+		return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{buffer.data() + offset, sizeof(T)});
+	}
+
+	template <typename F>
+	static bool decode(std::span<const std::byte> payload, F& apply) noexcept
+	{
+		std::size_t offset = 0;
+
+		auto take_sized = [&](std::span<const std::byte>& out) -> bool
+		{
+			if (offset + sizeof(std::uint16_t) > payload.size())
+				return false;
+
+			const auto size = read_integral<std::uint16_t>(payload, offset);
+			offset += sizeof(std::uint16_t);
+
+			if (offset + size > payload.size())
+				return false;
+
+			out = payload.subspan(offset, size);
+			offset += size;
+
+			return true;
+		};
+
+		if (payload.empty())
+			return false;
+
+		const auto operation = static_cast<Operation>(read_integral<std::uint8_t>(payload, 0));
+		offset = sizeof(std::uint8_t);
+
+		std::span<const std::byte> table, key, value;
+
+		if (not take_sized(table) or not take_sized(key) or not take_sized(value))
+			return false;
+
+		apply(std::string_view{reinterpret_cast<const char*>(table.data()), table.size()},
+			  Serializer::template deserialize<Key>(key),
+			  Serializer::template deserialize<Value>(value),
+			  operation);
+
+		return true;
+	}
+
+	std::string path;
+	std::string sealed_path;
+	std::size_t group_size;
+	int fd = -1;
+
+	mutable std::mutex mutex; // guards pending, pending_records, durable_size and broken
+	std::mutex io_mutex;      // serializes writes to the file
+
+	std::vector<std::byte> pending;
+	std::vector<std::byte> spare; // the buffer of the previous group, reused to avoid reallocating
+	std::size_t pending_records = 0;
+	std::size_t durable_size = 0;
+	bool broken = false; // an fsync failed, the file can't be trusted to hold what was written before it
+};
+
+}
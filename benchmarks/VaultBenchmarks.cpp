@@ -0,0 +1,492 @@
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "Serializer.hpp"
+#include "Vault.hpp"
+
+// Every benchmark works on its own tables of one database, which is recreated each run so results only depend on the build.
+// JSON results can be compared across releases with google benchmark's tools/compare.py
+
+using BenchVault = MILI::Database::Vault<int, double>;
+
+constexpr std::string_view database_name = "VaultBenchmarks";
+constexpr std::size_t bucket_count = 128;
+
+BenchVault& vault()
+{
+	static BenchVault& instance = []() -> BenchVault&
+	{
+		namespace fs = std::filesystem;
+
+		std::error_code error;
+		for (const auto& entry : fs::directory_iterator{MILI::Database::database_path, error})
+			if (entry.path().filename().string().starts_with(database_name))
+				fs::remove_all(entry.path(), error);
+
+		auto created = BenchVault::construct(database_name);
+		BenchVault& vault = created ? created->get() : BenchVault::get_instance(database_name)->get();
+
+		// checkpoints only run when a benchmark asks for one, so a background flush never lands inside a measurement
+		vault.set_flush_policy(MILI::Database::details::FlushPolicy{std::chrono::hours{24}, std::numeric_limits<std::size_t>::max(), std::numeric_limits<std::size_t>::max()});
+
+		return vault;
+	}();
+
+	return instance;
+}
+
+// fills a table with the keys [0, keys) once and writes them to the fragments
+auto populated(const std::string& table_name, int keys)
+{
+	static std::set<std::string> filled;
+
+	auto table = vault().table(table_name);
+
+	if (filled.insert(table_name).second)
+	{
+		for (int key = 0; key < keys; ++key)
+			benchmark::DoNotOptimize(table.insert(key, key));
+
+		vault().checkpoint();
+	}
+
+	return table;
+}
+
+std::string table_name(std::string_view benchmark, const auto& ... args)
+{
+	std::string name{benchmark};
+	((name += "_" + std::to_string(args)), ...);
+
+	return name;
+}
+
+// the first hit_percent of the keys are updated again, so they are served by the write cache instead of the fragments
+void warm(auto& table, int keys, int hit_percent)
+{
+	for (int key = 0; key < keys * hit_percent / 100; ++key)
+		benchmark::DoNotOptimize(table.update(key, key + 1));
+}
+
+
+// point operations, Args: keys in the table, share of the keys in the write cache
+
+void BM_Read(benchmark::State& state)
+{
+	const int keys = static_cast<int>(state.range(0));
+	const int hit_percent = static_cast<int>(state.range(1));
+
+	auto table = populated(table_name("read", keys, hit_percent), keys);
+	warm(table, keys, hit_percent);
+
+	std::mt19937 random{42};
+	std::uniform_int_distribution<int> key{0, keys - 1};
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(table.read(key(random)));
+
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Read)->ArgsProduct({{1 << 10, 1 << 14, 1 << 17}, {0, 50, 100}});
+
+void BM_Update(benchmark::State& state)
+{
+	const int keys = static_cast<int>(state.range(0));
+	const int hit_percent = static_cast<int>(state.range(1));
+
+	auto table = populated(table_name("update", keys, hit_percent), keys);
+	warm(table, keys, hit_percent);
+
+	std::mt19937 random{42};
+	std::uniform_int_distribution<int> key{0, keys - 1};
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(table.update(key(random), 0.5));
+
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Update)->ArgsProduct({{1 << 10, 1 << 14, 1 << 17}, {0, 50, 100}});
+
+// Args: keys already in the table, every iteration inserts a key that is not
+void BM_Insert(benchmark::State& state)
+{
+	const int keys = static_cast<int>(state.range(0));
+
+	auto table = populated(table_name("insert", keys), keys);
+
+	static std::map<int, int> next_keys;
+	int& next = next_keys.try_emplace(keys, keys).first->second;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(table.insert(next++, 0.5));
+
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Insert)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17);
+
+// Args: keys in the table, once all of them are removed they are inserted and written again off the clock
+void BM_Remove(benchmark::State& state)
+{
+	const int keys = static_cast<int>(state.range(0));
+
+	auto table = populated(table_name("remove", keys), keys);
+
+	static std::map<int, int> next_keys;
+	int& next = next_keys.try_emplace(keys, 0).first->second;
+
+	for (auto _ : state)
+	{
+		if (next == keys)
+		{
+			state.PauseTiming();
+
+			for (int key = 0; key < keys; ++key)
+				benchmark::DoNotOptimize(table.insert(key, key));
+
+			vault().checkpoint();
+			next = 0;
+
+			state.ResumeTiming();
+		}
+
+		benchmark::DoNotOptimize(table.remove(next++));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Remove)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 17);
+
+// Args: keys in the table, keys per batch
+void BM_MultiRead(benchmark::State& state)
+{
+	const int keys = static_cast<int>(state.range(0));
+	const int batch_size = static_cast<int>(state.range(1));
+
+	auto table = populated(table_name("multi_read", keys), keys);
+
+	std::mt19937 random{42};
+	std::uniform_int_distribution<int> key{0, keys - 1};
+	std::vector<int> batch(batch_size);
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		std::ranges::generate(batch, [&] { return key(random); });
+		state.ResumeTiming();
+
+		benchmark::DoNotOptimize(table.multi_read(batch));
+	}
+
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(BM_MultiRead)->ArgsProduct({{1 << 14, 1 << 17}, {16, 1024}});
+
+
+// checkpoint latency, Args: entries per bucket, changed entries per bucket
+void BM_Flush(benchmark::State& state)
+{
+	const int fill = static_cast<int>(state.range(0));
+	const int changed = static_cast<int>(state.range(1));
+	const int keys = fill * static_cast<int>(bucket_count);
+
+	auto table = populated(table_name("flush", fill, changed), keys);
+	double value = 0;
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+
+		value += 1;
+		for (int key = 0; key < changed * static_cast<int>(bucket_count); ++key)
+			benchmark::DoNotOptimize(table.update(key, value));
+
+		state.ResumeTiming();
+
+		benchmark::DoNotOptimize(vault().checkpoint());
+	}
+
+	state.counters["buckets"] = bucket_count;
+}
+BENCHMARK(BM_Flush)->ArgsProduct({{16, 256, 4096}, {1, 16}})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// decoding a fragment that is not resident in the buffer pool, which is what the pool does on a miss.
+// Args: entries in the fragment
+void BM_ColdLoad(benchmark::State& state)
+{
+	using Serializer = MILI::Database::details::DefaultSerializer<int, double>;
+
+	const int entries = static_cast<int>(state.range(0));
+	const std::string directory = std::string{MILI::Database::database_path} + std::string{database_name} + "/cold_load";
+	const std::string path = directory + "/fragment" + std::to_string(entries);
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	MILI::Database::details::FragmentWriter<int, double, Serializer> writer;
+	for (int key = 0; key < entries; ++key)
+		writer.add(key, key);
+
+	if (not writer.finish(path))
+	{
+		state.SkipWithError("could not write the fragment");
+		return;
+	}
+
+	for (auto _ : state)
+	{
+		MILI::Database::details::MappedBucket<int, double, Serializer> fragment{path};
+		std::map<int, double> data;
+
+		for (auto position = fragment.begin(); position < fragment.end(); position = fragment.next(position))
+			data.emplace_hint(data.end(), fragment.key_at(position), Serializer::template deserialize<double>(fragment.value_at(position)));
+
+		benchmark::DoNotOptimize(data);
+	}
+
+	state.SetItemsProcessed(state.iterations() * entries);
+	unlink(path.c_str());
+}
+BENCHMARK(BM_ColdLoad)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536);
+
+// a point read from a freshly mapped fragment of string records, which inflates only the block holding the key when
+// the fragment is compressed. Args: codec (0 none, 1 lz4, 2 zstd)
+void BM_FragmentRead(benchmark::State& state)
+{
+	using Serializer = MILI::Database::details::DefaultSerializer<int, std::string>;
+
+	constexpr int entries = 1 << 16;
+	const auto codec = static_cast<MILI::Database::Compression>(state.range(0));
+	const std::string directory = std::string{MILI::Database::database_path} + std::string{database_name} + "/fragment_read";
+	const std::string path = directory + "/fragment" + std::to_string(state.range(0));
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	MILI::Database::details::FragmentWriter<int, std::string, Serializer> writer{0, codec};
+	for (int key = 0; key < entries; ++key)
+		writer.add(key, "customer " + std::to_string(key % 1000) + " of region " + std::to_string(key % 16) + ", status active");
+
+	if (not writer.finish(path))
+	{
+		state.SkipWithError("could not write the fragment");
+		return;
+	}
+
+	std::mt19937 generator{42};
+	std::uniform_int_distribution<int> keys{0, entries - 1};
+
+	for (auto _ : state)
+	{
+		MILI::Database::details::MappedBucket<int, std::string, Serializer> fragment{path};
+		benchmark::DoNotOptimize(fragment.read(keys(generator)));
+	}
+
+	state.counters["fragment_bytes"] = static_cast<double>(std::filesystem::file_size(path, error));
+	unlink(path.c_str());
+}
+BENCHMARK(BM_FragmentRead)->Arg(0)->Arg(1)->Arg(2);
+
+
+// serializer throughput for every kind of type it handles
+
+struct Point
+{
+	int x;
+	int y;
+};
+
+struct Record
+{
+	std::int64_t id;
+	std::string name;
+	std::vector<double> scores;
+	bool active;
+};
+
+template <typename T>
+T sample()
+{
+	if constexpr (std::same_as<T, std::string>)
+		return std::string(64, 'v');
+
+	else if constexpr (std::same_as<T, std::vector<int>>)
+		return std::vector<int>(256, 7);
+
+	else if constexpr (std::same_as<T, Record>)
+		return Record{42, "some name", std::vector<double>(16, 1.5), true};
+
+	else if constexpr (std::same_as<T, Point>)
+		return Point{1, -2};
+
+	else
+		return T{7};
+}
+
+template <typename T>
+void BM_Serialize(benchmark::State& state)
+{
+	const T data = sample<T>();
+	std::vector<std::byte> sink;
+
+	for (auto _ : state)
+	{
+		sink.clear();
+		MILI::serialize_into(sink, data);
+		benchmark::DoNotOptimize(sink.data());
+	}
+
+	state.SetBytesProcessed(state.iterations() * sink.size());
+}
+BENCHMARK_TEMPLATE(BM_Serialize, int);
+BENCHMARK_TEMPLATE(BM_Serialize, double);
+BENCHMARK_TEMPLATE(BM_Serialize, std::string);
+BENCHMARK_TEMPLATE(BM_Serialize, std::vector<int>);
+BENCHMARK_TEMPLATE(BM_Serialize, Point);
+BENCHMARK_TEMPLATE(BM_Serialize, Record);
+
+template <typename T>
+void BM_Deserialize(benchmark::State& state)
+{
+	std::vector<std::byte> serialized;
+	MILI::serialize_into(serialized, sample<T>());
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(MILI::deserialize<T>(std::span<const std::byte>{serialized}));
+
+	state.SetBytesProcessed(state.iterations() * serialized.size());
+}
+BENCHMARK_TEMPLATE(BM_Deserialize, int);
+BENCHMARK_TEMPLATE(BM_Deserialize, double);
+BENCHMARK_TEMPLATE(BM_Deserialize, std::string);
+BENCHMARK_TEMPLATE(BM_Deserialize, std::vector<int>);
+BENCHMARK_TEMPLATE(BM_Deserialize, Point);
+BENCHMARK_TEMPLATE(BM_Deserialize, Record);
+
+
+// YCSB core workloads over a zipfian key popularity.
+// A: 50% reads 50% updates, B: 95% reads, C: reads only, D: 95% reads of the latest inserts, E: 95% short scans, F: read-modify-write
+
+// picks items in [0, items) so that item i is drawn with probability proportional to 1 / (i + 1)^theta, like YCSB's generator
+class Zipfian
+{
+public:
+
+	explicit Zipfian(std::uint64_t item_count, double zipfian_theta = 0.99) : items{item_count}, theta{zipfian_theta}
+	{
+		for (std::uint64_t i = 1; i <= items; ++i)
+			zeta_n += 1.0 / std::pow(static_cast<double>(i), theta);
+
+		const double zeta_2 = 1.0 + 1.0 / std::pow(2.0, theta);
+
+		alpha = 1.0 / (1.0 - theta);
+		eta = (1.0 - std::pow(2.0 / static_cast<double>(items), 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+	}
+
+	std::uint64_t operator()(std::mt19937_64& random)
+	{
+		const double u = std::uniform_real_distribution<double>{0.0, 1.0}(random);
+		const double uz = u * zeta_n;
+
+		if (uz < 1.0)
+			return 0;
+
+		if (uz < 1.0 + std::pow(0.5, theta))
+			return 1;
+
+		return std::min<std::uint64_t>(items - 1, static_cast<std::uint64_t>(static_cast<double>(items) * std::pow(eta * u - eta + 1.0, alpha)));
+	}
+
+private:
+
+	std::uint64_t items;
+	double theta;
+	double zeta_n = 0;
+	double alpha;
+	double eta;
+};
+
+enum class Workload : int
+{
+	A, B, C, D, E, F
+};
+
+// Args: workload, keys loaded before the run
+void BM_Ycsb(benchmark::State& state)
+{
+	const auto workload = static_cast<Workload>(state.range(0));
+	const int keys = static_cast<int>(state.range(1));
+	const int read_percent = workload == Workload::A or workload == Workload::F ? 50 : workload == Workload::C ? 100 : 95;
+
+	static std::map<int, Zipfian> distributions;
+	static std::map<int, std::atomic<int>> inserted;
+
+	// the first thread loads the table, the others wait for it at the start of the loop
+	if (state.thread_index() == 0)
+	{
+		populated(table_name("ycsb", keys), keys);
+		distributions.try_emplace(keys, keys);
+		inserted.try_emplace(keys, keys);
+	}
+
+	auto table = vault().table(table_name("ycsb", keys));
+	std::mt19937_64 random{static_cast<std::uint64_t>(state.thread_index()) + 1};
+	std::uniform_int_distribution<int> percent{0, 99};
+	std::uniform_int_distribution<int> scan_length{1, 100};
+
+	for (auto _ : state)
+	{
+		auto& latest = inserted.at(keys);
+		const int key = static_cast<int>(distributions.at(keys)(random));
+
+		if (percent(random) >= read_percent)
+		{
+			if (workload == Workload::D or workload == Workload::E)
+				benchmark::DoNotOptimize(table.insert(latest.fetch_add(1), 1.0));
+
+			else if (workload == Workload::F)
+				benchmark::DoNotOptimize(table.update(key, table.read(key).value_or(0) + 1));
+
+			else
+				benchmark::DoNotOptimize(table.update(key, 1.0));
+		}
+
+		// D reads the records inserted last, the most popular keys are the newest ones
+		else if (workload == Workload::D)
+			benchmark::DoNotOptimize(table.read(latest.load() - 1 - key));
+
+		else if (workload == Workload::E)
+		{
+			for (const auto& entry : table.scan(key, key + scan_length(random)))
+				benchmark::DoNotOptimize(entry);
+		}
+
+		else
+			benchmark::DoNotOptimize(table.read(key));
+	}
+
+	state.SetItemsProcessed(state.iterations());
+	state.SetLabel(std::string{"workload "} + "ABCDEF"[state.range(0)]);
+}
+BENCHMARK(BM_Ycsb)->ArgsProduct({{0, 1, 2, 3, 4, 5}, {1 << 17}})->Threads(1)->Threads(4)->UseRealTime();
+
+
+int main(int argc, char** argv)
+{
+	benchmark::Initialize(&argc, argv);
+
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+
+	vault();
+
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+}
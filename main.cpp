@@ -1,5 +1,8 @@
 #include <iostream>
 #include <queue>
+#include <deque>
+#include <functional>
+#include <unordered_map>
 #include <algorithm>
 #include <ranges>
 #include <vector>
@@ -7,6 +10,8 @@
 #include <memory_resource>
 
 #include "Vault.hpp"
+#include "Protocol.hpp"
+#include "Metrics.hpp"
 
 #include "nlohmann/json.hpp"
 #include "mongoose.h"
@@ -14,35 +19,12 @@
 
 using namespace std::literals;
 
+// aggregates like this serialize field by field out of the box, e.g. Vault<std::string, Person>
 struct Person
 {
 	std::string name = "some name";
 };
 
-
-std::vector<std::byte> serialize(Person& p)
-{
-	std::vector<std::byte> buffer;
-
-	auto&& serialized_size = MILI::serialize(p.name.size());
-	auto&& serialized_name = MILI::serialize(p.name);
-	auto&& serialized_data = ranges::views::concat(serialized_size, serialized_name);
-	buffer.insert(buffer.end(), serialized_data.begin(), serialized_data.end());
-
-	return buffer;
-}
-
-Person deserialize(const std::vector<std::byte>& buffer)
-{
-	std::span<const std::byte, sizeof(std::size_t)> size_span{buffer.data(), sizeof(std::size_t)};
-	const auto size = MILI::deserialize<std::size_t>(size_span);
-
-	std::span<const char> name_span{reinterpret_cast<const char*>(buffer.data()) + sizeof(std::size_t), size};
-	std::string name{name_span.begin(), name_span.end()};
-
-	return Person{name};
-}
-
 // TODO: accept all buffer types?
 // TODO: Add support for custom serializer passed as a serializer object
 // TODO: Chunked reader
@@ -84,6 +66,13 @@ struct Operation
 };
 
 
+// a WebSocket message, either way
+struct Frame
+{
+	std::vector<std::byte> data;
+	int op = WEBSOCKET_OP_BINARY;
+};
+
 auto main() -> int
 {
 	MILI::Database::Vault<int, double>::construct("vault.db");
@@ -93,84 +82,151 @@ auto main() -> int
 
 	Server server{"http://0.0.0.0:8080"};
 
-	auto cb = [&](mg_connection* c, int ev, void* ev_data)
+	// a single JSON operation, answered with a JSON document
+	auto execute_json = [&vault](const std::vector<std::byte>& frame)
 	{
-		if (ev == MG_EV_HTTP_MSG)
+		const std::string_view text{reinterpret_cast<const char*>(frame.data()), frame.size()};
+		const nlohmann::json json = nlohmann::json::parse(text, nullptr, false);
+
+		nlohmann::json response{{"error", "Invalid JSON"}};
+
+		if (not json.is_discarded())
 		{
-			mg_http_message* hm = (mg_http_message*) ev_data;
+			Operation<int, double> operation;
+			operation.from_json(json);
 
-			if (mg_http_match_uri(hm, "/ws"))
+			response = nlohmann::json{{"operation", operation.operation}, {"table", operation.table}, {"result", false}};
+
+			if (operation.operation == "insert")
 			{
-				mg_ws_upgrade(c, hm, nullptr);
-				c->data[0] = 'W';
+				response["result"] = vault.table(operation.table).insert(operation.key, operation.value);
 			}
-		}
-
-		else if (ev == MG_EV_WS_MSG)
-		{
-			mg_ws_message* msg = (mg_ws_message*) ev_data;
-			std::string_view msg_sv = {reinterpret_cast<const char*>(msg->data.ptr), msg->data.len};
-			nlohmann::json json = nlohmann::json::parse(msg_sv);
 
-			if (json.is_discarded())
+			else if (operation.operation == "update")
 			{
-				nlohmann::json invalid_json{{"error", "Invalid JSON"}};
-				std::string&& response = invalid_json.dump();
-				mg_ws_send(c, response.data(), response.size(), WEBSOCKET_OP_TEXT);
+				response["result"] = vault.table(operation.table).update(operation.key, operation.value);
 			}
 
-			else
+			else if (operation.operation == "remove")
 			{
-				Operation<int, double> operation;
-				operation.from_json(json);
+				response["result"] = vault.table(operation.table).remove(operation.key);
+			}
 
-				nlohmann::json response{{"operation", operation.operation}, {"table", operation.table}, {"result", false}};
+			else if (operation.operation == "read")
+			{
+				auto value = vault.table(operation.table).read(operation.key);
 
-				if (operation.operation == "insert")
+				if (value.has_value())
 				{
-					response["result"] = vault.table(operation.table).insert(operation.key, operation.value);
+					response["result"] = true;
+					response["value"] = value.value();
 				}
+			}
+		}
 
-				else if (operation.operation == "update")
-				{
-					response["result"] = vault.table(operation.table).update(operation.key, operation.value);
-				}
+		const std::string dumped = response.dump();
+		const auto* data = reinterpret_cast<const std::byte*>(dumped.data());
+
+		return Frame{{data, data + dumped.size()}, WEBSOCKET_OP_TEXT};
+	};
+
+	// every message runs on the vault's I/O threads, since any of them may have to load a bucket from disk.
+	// they run one at a time per connection so a client sees its answers in order, the ones waiting behind the running one
+	// are kept here by connection id
+	std::unordered_map<unsigned long, std::deque<Frame>> batches;
+
+	std::function<void(mg_mgr*, unsigned long)> run_batch = [&](mg_mgr* manager, unsigned long id)
+	{
+		auto& queued = batches[id];
+
+		vault.io_service().submit([&vault, &execute_json, frame = std::move(queued.front())]
+		{
+			MILI::Database::metrics::Timer timer{MILI::Database::metrics::websocket_messages};
 
-				else if (operation.operation == "remove")
+			// binary frames carry a batch of operations, answered with a single frame (see Protocol.hpp)
+			if (frame.op == WEBSOCKET_OP_BINARY)
+				return Frame{MILI::Database::Protocol::execute(vault, frame.data), WEBSOCKET_OP_BINARY};
+
+			return execute_json(frame.data);
+		},
+		[&, manager, id](Frame response)
+		{
+			// the client may have gone away while its batch ran
+			for (mg_connection* c = manager->conns; c; c = c->next)
+			{
+				if (c->id == id)
 				{
-					response["result"] = vault.table(operation.table).remove(operation.key);
+					mg_ws_send(c, response.data.data(), response.data.size(), response.op);
+					MILI::Database::metrics::websocket_bytes_sent.add(response.data.size());
+					break;
 				}
+			}
 
-				else if (operation.operation == "read")
-				{
-					auto value = vault.table(operation.table).read(operation.key);
+			auto itr = batches.find(id);
 
-					if (value.has_value())
-					{
-						response["result"] = true;
-						response["value"] = value.value();
-					}
-				}
+			if (itr == batches.end())
+				return;
+
+			itr->second.pop_front();
+
+			if (itr->second.empty())
+				batches.erase(itr);
+			else
+				run_batch(manager, id);
+		});
+	};
+
+	auto cb = [&](mg_connection* c, int ev, void* ev_data)
+	{
+		if (ev == MG_EV_CLOSE)
+		{
+			// a running batch finds its queue gone once it completes
+			batches.erase(c->id);
+		}
+
+		else if (ev == MG_EV_HTTP_MSG)
+		{
+			mg_http_message* hm = (mg_http_message*) ev_data;
 
-				std::string&& resp_str = response.dump();
-				mg_ws_send(c, resp_str.data(), resp_str.size(), WEBSOCKET_OP_TEXT);
+			if (mg_http_match_uri(hm, "/ws"))
+			{
+				mg_ws_upgrade(c, hm, nullptr);
+				c->data[0] = 'W';
 			}
 
+			// Prometheus scrapes
+			else if (mg_http_match_uri(hm, "/metrics"))
+			{
+				const std::string metrics = MILI::Database::metrics::render();
+				mg_http_reply(c, 200, "Content-Type: text/plain; version=0.0.4\r\n", "%s", metrics.c_str());
+			}
+		}
+
+		else if (ev == MG_EV_WS_MSG)
+		{
+			mg_ws_message* msg = (mg_ws_message*) ev_data;
+			MILI::Database::metrics::websocket_bytes_received.add(msg->data.len);
+
+			const auto* data = reinterpret_cast<const std::byte*>(msg->data.ptr);
+			const int op = (msg->flags & 15) == WEBSOCKET_OP_BINARY ? WEBSOCKET_OP_BINARY : WEBSOCKET_OP_TEXT;
+
+			auto& queued = batches[c->id];
+			queued.push_back(Frame{{data, data + msg->data.len}, op});
+
+			if (queued.size() == 1)
+				run_batch(c->mgr, c->id);
 		}
 
 	};
 
 	server.listen(cb);
 
+	// the vault's own flusher thread commits and checkpoints in the background.
+	// finished batches are answered from here, the loop wakes up often while any are running
 	while(true)
 	{
-		server.poll_events(std::chrono::milliseconds(100));
-
-		// flush the database every 5 seconds
-		if (std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() % 5 == 0)
-		{
-			vault.flush();
-		}
+		server.poll_events(vault.io_service().pending() ? std::chrono::milliseconds(1) : std::chrono::milliseconds(100));
+		vault.io_service().poll();
 	}
 
 }
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "BloomFilter.hpp"
+#include "TestFiles.hpp"
+
+namespace
+{
+	using MILI::Database::Testing::temp_path;
+
+	using MILI::Database::details::BloomFilter;
+	using MILI::Database::details::MembershipFilter;
+
+	std::vector<std::size_t> hashes(std::size_t count, std::uint64_t seed)
+	{
+		std::mt19937_64 random{seed};
+		std::vector<std::size_t> ret(count);
+
+		for (auto& hash : ret)
+			hash = random();
+
+		return ret;
+	}
+
+	template <typename Filter>
+	double false_positive_rate(const Filter& filter, std::uint64_t seed)
+	{
+		const auto absent = hashes(100000, seed);
+		const auto positives = std::ranges::count_if(absent, [&](std::size_t hash) { return filter.contains(hash); });
+
+		return static_cast<double>(positives) / static_cast<double>(absent.size());
+	}
+}
+
+TEST(BloomFilterTests, SerializedFilterKeepsItsKeys)
+{
+	BloomFilter filter{10000};
+	const auto inserted = hashes(10000, 1);
+
+	for (const auto hash : inserted)
+		filter.insert(hash);
+
+	auto serialized = filter.serialize();
+
+	const auto copy = BloomFilter::deserialize(serialized);
+	const auto view = BloomFilter::view(serialized);
+
+	for (const auto hash : inserted)
+	{
+		ASSERT_TRUE(copy.contains(hash));
+		ASSERT_TRUE(view.contains(hash));
+	}
+
+	EXPECT_LT(false_positive_rate(copy, 2), 0.02);
+}
+
+TEST(MembershipFilterTests, PersistedFilterLoadsBack)
+{
+	const auto path = temp_path("BloomFilterTests", "reload");
+	const auto inserted = hashes(5000, 3);
+
+	{
+		MembershipFilter filter;
+		EXPECT_FALSE(filter.is_dirty());
+
+		for (const auto hash : inserted)
+			filter.insert(hash);
+
+		EXPECT_TRUE(filter.is_dirty());
+		ASSERT_TRUE(filter.persist(path));
+		EXPECT_FALSE(filter.is_dirty());
+	}
+
+	const auto loaded = MembershipFilter::load(path);
+
+	EXPECT_FALSE(loaded.is_dirty());
+
+	for (const auto hash : inserted)
+		ASSERT_TRUE(loaded.contains(hash));
+
+	EXPECT_LT(false_positive_rate(loaded, 4), 0.02);
+}
+
+TEST(MembershipFilterTests, LaterInsertsReachTheFileInPlace)
+{
+	const auto path = temp_path("BloomFilterTests", "incremental");
+	const auto first = hashes(1000, 5);
+	const auto second = hashes(1000, 6);
+
+	{
+		MembershipFilter filter;
+
+		for (const auto hash : first)
+			filter.insert(hash);
+
+		ASSERT_TRUE(filter.persist(path));
+	}
+
+	const auto size = std::filesystem::file_size(path);
+
+	{
+		// the loaded layers live in a private mapping, inserts only reach the file through persist
+		auto loaded = MembershipFilter::load(path);
+
+		for (const auto hash : second)
+			loaded.insert(hash);
+
+		EXPECT_TRUE(loaded.is_dirty());
+		ASSERT_TRUE(loaded.persist(path));
+	}
+
+	// the dirty blocks were written over the ones they replace
+	EXPECT_EQ(std::filesystem::file_size(path), size);
+
+	const auto reloaded = MembershipFilter::load(path);
+
+	for (const auto hash : first)
+		ASSERT_TRUE(reloaded.contains(hash));
+
+	for (const auto hash : second)
+		ASSERT_TRUE(reloaded.contains(hash));
+}
+
+TEST(MembershipFilterTests, FullLayerGrowsANewOne)
+{
+	const auto path = temp_path("BloomFilterTests", "layers");
+	const auto inserted = hashes(MembershipFilter::initial_capacity + 10000, 7);
+
+	MembershipFilter filter;
+
+	for (const auto hash : inserted)
+		filter.insert(hash);
+
+	const auto one_layer = MembershipFilter{}.memory_usage();
+	EXPECT_GT(filter.memory_usage(), 2 * one_layer);
+
+	ASSERT_TRUE(filter.persist(path));
+
+	const auto loaded = MembershipFilter::load(path);
+	EXPECT_EQ(loaded.memory_usage(), filter.memory_usage());
+
+	for (const auto hash : inserted)
+		ASSERT_TRUE(loaded.contains(hash));
+
+	// the layers together stay near the target rate
+	EXPECT_LT(false_positive_rate(loaded, 8), 2 * MembershipFilter::false_positive_rate);
+}
+
+TEST(MembershipFilterTests, DamagedFileKeepsEveryKeyReadable)
+{
+	const auto path = temp_path("BloomFilterTests", "damaged");
+	const auto keys = hashes(1000, 10);
+
+	{
+		MembershipFilter filter;
+
+		for (const auto hash : keys)
+			filter.insert(hash);
+
+		ASSERT_TRUE(filter.persist(path));
+	}
+
+	std::filesystem::resize_file(path, 6);
+
+	auto loaded = MembershipFilter::load(path);
+
+	// an empty filter would turn the reads of every key written before into misses
+	EXPECT_TRUE(std::ranges::all_of(keys, [&](std::size_t hash) { return loaded.contains(hash); }));
+	EXPECT_EQ(false_positive_rate(loaded, 9), 1.0);
+
+	// nor is the damaged file replaced by one holding only the keys inserted since
+	loaded.insert(42);
+	EXPECT_FALSE(loaded.is_dirty());
+	ASSERT_TRUE(loaded.persist(path));
+	EXPECT_EQ(std::filesystem::file_size(path), 6u);
+
+	const auto reloaded = MembershipFilter::load(path);
+	EXPECT_TRUE(std::ranges::all_of(keys, [&](std::size_t hash) { return reloaded.contains(hash); }));
+}
+
+TEST(MembershipFilterTests, MissingFileStartsAnEmptyFilter)
+{
+	const auto path = temp_path("BloomFilterTests", "missing");
+	const auto loaded = MembershipFilter::load(path);
+
+	EXPECT_FALSE(loaded.is_dirty());
+	EXPECT_LT(false_positive_rate(loaded, 11), 0.01);
+}
@@ -0,0 +1,174 @@
+#include <map>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <memory_resource>
+
+#include <gtest/gtest.h>
+
+#include "FlatMap.hpp"
+
+namespace
+{
+	using Map = MILI::Database::details::FlatMap<int, std::string>;
+	using Change = std::pair<const int*, const std::string*>;
+
+	// a null value erases the key
+	struct Changes
+	{
+		std::vector<std::pair<int, std::optional<std::string>>> owned;
+
+		std::vector<Change> view() const
+		{
+			std::vector<Change> ret;
+
+			for (const auto& [key, value] : owned)
+				ret.emplace_back(&key, value ? &*value : nullptr);
+
+			return ret;
+		}
+	};
+
+	template <typename M>
+	std::vector<std::pair<int, std::string>> entries(const M& map)
+	{
+		return {map.begin(), map.end()};
+	}
+}
+
+TEST(FlatMapTests, MergeIntoEmpty)
+{
+	Map map;
+	const Changes changes{{{1, "one"}, {2, std::nullopt}, {3, "three"}}};
+
+	map.merge(changes.view());
+
+	const std::vector<std::pair<int, std::string>> expected{{1, "one"}, {3, "three"}};
+	EXPECT_EQ(entries(map), expected);
+}
+
+TEST(FlatMapTests, MergeInsertsUpdatesAndErases)
+{
+	Map map;
+
+	for (int key = 0; key < 10; key += 2)
+		map.insert_or_assign(key, std::to_string(key));
+
+	// in front of, between and after the entries, over existing ones, and erasing present and missing keys
+	const Changes changes{{{-1, "new"}, {0, std::nullopt}, {3, "new"}, {4, "updated"}, {5, std::nullopt}, {8, std::nullopt}, {11, "new"}}};
+
+	map.merge(changes.view());
+
+	const std::vector<std::pair<int, std::string>> expected{{-1, "new"}, {2, "2"}, {3, "new"}, {4, "updated"}, {6, "6"}, {11, "new"}};
+	EXPECT_EQ(entries(map), expected);
+}
+
+TEST(FlatMapTests, MergeOfNothingChangesNothing)
+{
+	Map map;
+	map.insert_or_assign(1, "one");
+
+	map.merge({});
+	map.merge(Changes{{{2, std::nullopt}}}.view());
+
+	const std::vector<std::pair<int, std::string>> expected{{1, "one"}};
+	EXPECT_EQ(entries(map), expected);
+}
+
+TEST(FlatMapTests, MergeErasesEverything)
+{
+	Map map;
+	Changes changes;
+
+	for (int key = 0; key < 100; ++key)
+	{
+		map.insert_or_assign(key, std::to_string(key));
+		changes.owned.emplace_back(key, std::nullopt);
+	}
+
+	map.merge(changes.view());
+
+	EXPECT_EQ(map.size(), 0u);
+	EXPECT_EQ(map.begin(), map.end());
+}
+
+TEST(FlatMapTests, MergeMatchesAnOrderedMap)
+{
+	std::mt19937 random{7};
+
+	std::pmr::monotonic_buffer_resource arena;
+	std::pmr::unsynchronized_pool_resource pool{&arena};
+
+	MILI::Database::details::ArenaFlatMap<int, std::string> map{&pool};
+	std::map<int, std::string> expected;
+
+	for (int round = 0; round < 500; ++round)
+	{
+		std::map<int, std::optional<std::string>> batch;
+
+		for (int i = random() % 40; i > 0; --i)
+		{
+			const int key = static_cast<int>(random() % 300);
+
+			if (random() % 3 == 0)
+				batch.insert_or_assign(key, std::nullopt);
+			else
+				batch.insert_or_assign(key, std::to_string(random()));
+		}
+
+		Changes changes{{batch.begin(), batch.end()}};
+
+		for (const auto& [key, value] : batch)
+		{
+			if (value)
+				expected.insert_or_assign(key, *value);
+			else
+				expected.erase(key);
+		}
+
+		map.merge(changes.view());
+
+		ASSERT_EQ(entries(map), (std::vector<std::pair<int, std::string>>{expected.begin(), expected.end()}));
+	}
+}
+
+TEST(FlatMapTests, EraseIfKeepsTheOrder)
+{
+	Map map;
+
+	for (int key = 0; key < 20; ++key)
+		map.insert_or_assign(key, std::to_string(key));
+
+	EXPECT_EQ(map.erase_if([](const auto& entry) { return entry.first % 3 == 0; }), 7u);
+
+	int previous = -1;
+
+	for (const auto& [key, value] : map)
+	{
+		EXPECT_NE(key % 3, 0);
+		EXPECT_LT(previous, key);
+		EXPECT_EQ(value, std::to_string(key));
+		previous = key;
+	}
+
+	EXPECT_EQ(map.find(3), map.end());
+	EXPECT_NE(map.find(4), map.end());
+}
+
+TEST(FlatMapTests, EmplaceHintAppendsInOrder)
+{
+	Map map;
+
+	for (int key = 0; key < 10; ++key)
+		map.emplace_hint(map.end(), key, std::to_string(key));
+
+	// a hint that doesn't fit falls back to a sorted insert
+	map.emplace_hint(map.end(), 5, "five");
+	map.emplace_hint(map.end(), -1, "minus one");
+
+	EXPECT_EQ(map.size(), 11u);
+	EXPECT_EQ(map.begin()->first, -1);
+	EXPECT_EQ(map.find(5)->second, "five");
+}
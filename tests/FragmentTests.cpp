@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Vault.hpp"
+#include "Fragment.hpp"
+#include "TestFiles.hpp"
+
+namespace
+{
+	using MILI::Database::Testing::temp_path;
+	using MILI::Database::Testing::flip_byte;
+
+	using Serializer = MILI::Database::details::DefaultSerializer<int, std::string>;
+	using Writer = MILI::Database::details::FragmentWriter<int, std::string, Serializer>;
+	using Delta = MILI::Database::details::DeltaWriter<int, std::string, Serializer>;
+	using Mapped = MILI::Database::details::MappedBucket<int, std::string, Serializer>;
+
+	std::string value_of(int key)
+	{
+		return "value of " + std::to_string(key);
+	}
+
+	// keys 0 to count - 1, enough of them spread over several blocks
+	bool write(const std::string& path, int count, std::uint32_t generation = 0)
+	{
+		Writer writer{generation};
+
+		for (int key = 0; key < count; ++key)
+			writer.add(key, value_of(key));
+
+		return writer.finish(path);
+	}
+
+	// the codec every block of a fragment was stored with, read straight from its index
+	std::vector<MILI::Database::Compression> block_codecs(const std::string& path)
+	{
+		std::ifstream file{path, std::ios::binary};
+		const std::vector<char> chars{std::istreambuf_iterator<char>{file}, {}};
+		const std::span<const std::byte> bytes{reinterpret_cast<const std::byte*>(chars.data()), chars.size()};
+
+		auto integral_at = [&]<std::integral T>(std::size_t offset)
+		{
+			return MILI::deserialize<T>(std::span<const std::byte, sizeof(T)>{bytes.data() + offset, sizeof(T)});
+		};
+
+		const std::size_t trailer = bytes.size() - MILI::Database::details::fragment_trailer_size;
+		const auto blocks = integral_at.template operator()<std::uint32_t>(trailer + 2 * sizeof(std::uint64_t));
+
+		std::vector<MILI::Database::Compression> ret;
+
+		// [u32 offset][u32 size][u32 crc32c][u32 entries][u32 records size][u8 codec][u16 key size][first key]
+		for (std::size_t offset = integral_at.template operator()<std::uint64_t>(trailer); ret.size() < blocks;)
+		{
+			ret.push_back(static_cast<MILI::Database::Compression>(integral_at.template operator()<std::uint8_t>(offset + 20)));
+			offset += 23 + integral_at.template operator()<std::uint16_t>(offset + 21);
+		}
+
+		return ret;
+	}
+
+	// writes the same records once with codec and once without, returns the sizes of both files
+	std::pair<std::size_t, std::size_t> write_compressed(const std::string& path, MILI::Database::Compression codec, const std::vector<std::string>& values)
+	{
+		Writer compressed{0, codec};
+		Writer plain{0};
+
+		for (int key = 0; key < static_cast<int>(values.size()); ++key)
+		{
+			compressed.add(key, values[key]);
+			plain.add(key, values[key]);
+		}
+
+		EXPECT_TRUE(compressed.finish(path));
+		EXPECT_TRUE(plain.finish(path + ".plain"));
+
+		return {std::filesystem::file_size(path), std::filesystem::file_size(path + ".plain")};
+	}
+
+	class CompressionTests : public ::testing::TestWithParam<MILI::Database::Compression>
+	{
+	protected:
+
+		void SetUp() override
+		{
+			if ((GetParam() == MILI::Database::Compression::Lz4 and not MILI_HAS_LZ4) or (GetParam() == MILI::Database::Compression::Zstd and not MILI_HAS_ZSTD))
+				GTEST_SKIP() << "the codec wasn't available at build time";
+		}
+	};
+
+	std::vector<std::pair<int, std::string>> contents(const Mapped& fragment)
+	{
+		std::vector<std::pair<int, std::string>> ret;
+
+		for (auto position = fragment.begin(); position < fragment.end(); position = fragment.next(position))
+			ret.emplace_back(fragment.key_at(position), Serializer::deserialize<std::string>(fragment.value_at(position)));
+
+		return ret;
+	}
+
+}
+
+TEST(FragmentTests, CurrentVersionRoundTrips)
+{
+	const auto path = temp_path("FragmentTests", "current", {".delta"});
+	ASSERT_TRUE(write(path, 2000, 4));
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.valid());
+	ASSERT_TRUE(fragment.verify());
+	EXPECT_EQ(fragment.size(), 2000u);
+	EXPECT_EQ(fragment.get_generation(), 4u);
+	EXPECT_TRUE(fragment.takes_delta());
+
+	std::vector<std::pair<int, std::string>> expected;
+
+	for (int key = 0; key < 2000; ++key)
+		expected.emplace_back(key, value_of(key));
+
+	EXPECT_EQ(contents(fragment), expected);
+
+	for (int key : {0, 1, 999, 1999})
+		EXPECT_EQ(fragment.read(key), value_of(key));
+
+	EXPECT_FALSE(fragment.read(-1));
+	EXPECT_FALSE(fragment.read(2000));
+}
+
+TEST(FragmentTests, StringKeysAreFoundByTheirBytes)
+{
+	using StringSerializer = MILI::Database::details::DefaultSerializer<std::string, int>;
+
+	const auto path = temp_path("FragmentTests", "string_keys", {".delta"});
+
+	// sorted as strings, so "key 10" comes right after "key 1" and shares its bytes
+	std::vector<std::string> keys{""};
+
+	for (int key = 0; key < 2000; ++key)
+		keys.push_back("key " + std::to_string(key));
+
+	std::ranges::sort(keys);
+
+	{
+		MILI::Database::details::FragmentWriter<std::string, int, StringSerializer> writer;
+
+		for (const auto& key : keys)
+			writer.add(key, static_cast<int>(key.size()));
+
+		ASSERT_TRUE(writer.finish(path));
+	}
+
+	const MILI::Database::details::MappedBucket<std::string, int, StringSerializer> fragment{path};
+	ASSERT_TRUE(fragment.valid());
+
+	for (const auto& key : keys)
+		EXPECT_EQ(fragment.read(key), static_cast<int>(key.size()));
+
+	for (const std::string absent : {"a", "key", "key 10 ", "key 2000", "zzz"})
+		EXPECT_FALSE(fragment.read(absent));
+}
+
+TEST(FragmentTests, VersionTwoStaysReadable)
+{
+	const auto path = temp_path("FragmentTests", "version2", {".delta"});
+
+	// a version 2 fragment of two blocks, built by hand from the layout in Fragment.hpp
+	std::vector<std::byte> file(MILI::Database::details::fragment_header_size);
+	std::vector<std::byte> index;
+	std::uint64_t entries = 0;
+
+	for (const auto& block : {std::vector<int>{1, 2, 3}, std::vector<int>{10, 20}})
+	{
+		const std::size_t offset = file.size();
+
+		for (int key : block)
+		{
+			ASSERT_TRUE(MILI::serialize_sized_into<Serializer>(file, key));
+			ASSERT_TRUE(MILI::serialize_sized_into<Serializer>(file, value_of(key)));
+			++entries;
+		}
+
+		const std::span<const std::byte> records{file.data() + offset, file.size() - offset};
+		const auto first_key = Serializer::serialize(block.front());
+
+		const auto entry = MILI::serialize(static_cast<std::uint32_t>(offset), static_cast<std::uint32_t>(records.size()), MILI::crc32c(records),
+			static_cast<std::uint32_t>(block.size()), static_cast<std::uint16_t>(first_key.size()));
+
+		index.insert(index.end(), entry.begin(), entry.end());
+		index.insert(index.end(), first_key.begin(), first_key.end());
+	}
+
+	MILI::Database::details::Header header;
+	header.size = static_cast<std::uint32_t>(file.size() - MILI::Database::details::fragment_header_size);
+	header.version = 2;
+
+	const auto serialized_header = header.serialize();
+	std::copy(serialized_header.begin(), serialized_header.end(), file.begin());
+
+	const auto index_offset = static_cast<std::uint64_t>(file.size());
+	file.insert(file.end(), index.begin(), index.end());
+
+	const auto trailer = MILI::serialize(index_offset, entries, std::uint32_t{2}, MILI::crc32c(index));
+	file.insert(file.end(), trailer.begin(), trailer.end());
+
+	ASSERT_TRUE(MILI::Database::details::commit_file(path, file));
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.valid());
+	ASSERT_TRUE(fragment.verify());
+	EXPECT_EQ(fragment.size(), 5u);
+
+	const std::vector<std::pair<int, std::string>> expected{{1, value_of(1)}, {2, value_of(2)}, {3, value_of(3)}, {10, value_of(10)}, {20, value_of(20)}};
+	EXPECT_EQ(contents(fragment), expected);
+
+	EXPECT_EQ(fragment.read(20), value_of(20));
+	EXPECT_FALSE(fragment.read(5));
+}
+
+TEST(FragmentTests, DamagedBlockReadsAsMissingAndIsCounted)
+{
+	const auto path = temp_path("FragmentTests", "damaged", {".delta"});
+	ASSERT_TRUE(write(path, 2000));
+
+	// a byte in the middle of the first block's records
+	flip_byte(path, MILI::Database::details::fragment_header_size + 10);
+
+	const Mapped fragment{path};
+
+	// the index is intact, so the fragment opens, but it must never be loaded into a bucket
+	ASSERT_TRUE(fragment.valid());
+	EXPECT_EQ(fragment.damaged(), 0u);
+
+	EXPECT_FALSE(fragment.read(0));
+	EXPECT_FALSE(fragment.read(1));
+	EXPECT_EQ(fragment.damaged(), 1u);
+
+	// records of the blocks that are intact are still served
+	EXPECT_EQ(fragment.read(1999), value_of(1999));
+
+	EXPECT_FALSE(fragment.verify());
+	EXPECT_EQ(fragment.damaged(), 1u);
+}
+
+TEST(FragmentTests, DamagedIndexIsRefused)
+{
+	const auto path = temp_path("FragmentTests", "damaged_index", {".delta"});
+	ASSERT_TRUE(write(path, 2000));
+
+	// the last byte of the index, right in front of the trailer
+	flip_byte(path, std::filesystem::file_size(path) - MILI::Database::details::fragment_trailer_size - 1);
+
+	const Mapped fragment{path};
+
+	EXPECT_FALSE(fragment.valid());
+}
+
+TEST(FragmentTests, DamagedTrailerIsRefused)
+{
+	const auto path = temp_path("FragmentTests", "damaged_trailer", {".delta"});
+	ASSERT_TRUE(write(path, 2000));
+
+	// the low byte of the entry count, which the buckets loading the fragment reserve for
+	flip_byte(path, std::filesystem::file_size(path) - MILI::Database::details::fragment_trailer_size + sizeof(std::uint64_t));
+
+	const Mapped fragment{path};
+
+	EXPECT_FALSE(fragment.valid());
+}
+
+TEST(FragmentTests, OlderTrailersMustAgreeWithTheIndex)
+{
+	namespace details = MILI::Database::details;
+
+	const auto path = temp_path("FragmentTests", "older_trailer", {".delta"});
+	ASSERT_TRUE(write(path, 2000));
+
+	std::vector<std::byte> file(std::filesystem::file_size(path));
+	std::ifstream{path, std::ios::binary}.read(reinterpret_cast<char*>(file.data()), static_cast<std::streamsize>(file.size()));
+
+	const std::size_t trailer = file.size() - details::fragment_trailer_size;
+	const std::size_t index_offset = MILI::deserialize<std::uint64_t>(std::span<const std::byte, sizeof(std::uint64_t)>{file.data() + trailer, sizeof(std::uint64_t)});
+
+	// rewritten as version 3, whose checksum only covers the index, with the trailer field at offset set to value
+	auto open_as_version_3 = [&](std::size_t offset, const std::ranges::range auto& value)
+	{
+		auto older = file;
+
+		std::array<std::byte, details::fragment_header_size> raw_header{};
+		std::copy_n(older.begin(), raw_header.size(), raw_header.begin());
+
+		details::Header header;
+		ASSERT_TRUE(header.construct(raw_header));
+		header.version = 3;
+
+		const auto serialized_header = header.serialize();
+		std::copy(serialized_header.begin(), serialized_header.end(), older.begin());
+		std::copy(value.begin(), value.end(), older.begin() + trailer + offset);
+
+		const auto crc = MILI::serialize(MILI::crc32c(std::span<const std::byte>{older.data() + index_offset, trailer - index_offset}));
+		std::copy(crc.begin(), crc.end(), older.end() - sizeof(std::uint32_t));
+
+		ASSERT_TRUE(details::commit_file(path, older));
+	};
+
+	open_as_version_3(sizeof(std::uint64_t), MILI::serialize(std::uint64_t{2000}));
+	EXPECT_TRUE(Mapped{path}.valid());
+
+	// more entries than the blocks hold
+	open_as_version_3(sizeof(std::uint64_t), MILI::serialize(std::uint64_t{1} << 40));
+	EXPECT_FALSE(Mapped{path}.valid());
+
+	// more blocks than the index has room for
+	open_as_version_3(2 * sizeof(std::uint64_t), MILI::serialize(std::numeric_limits<std::uint32_t>::max()));
+	EXPECT_FALSE(Mapped{path}.valid());
+}
+
+TEST(FragmentTests, DeltaShadowsTheFragment)
+{
+	const auto path = temp_path("FragmentTests", "delta", {".delta"});
+	ASSERT_TRUE(write(path, 100, 3));
+
+	const std::string updated = "updated";
+	Delta delta;
+	delta.add(1, &updated);
+	delta.add(2, nullptr);
+	delta.add(500, &updated);
+
+	ASSERT_TRUE(delta.append(path, 3, 0));
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.valid());
+	EXPECT_EQ(fragment.changes().size(), 3u);
+	EXPECT_EQ(fragment.delta_bytes(), std::filesystem::file_size(path + ".delta"));
+
+	EXPECT_EQ(fragment.read(0), value_of(0));
+	EXPECT_EQ(fragment.read(1), updated);
+	EXPECT_FALSE(fragment.read(2));
+	EXPECT_EQ(fragment.read(500), updated);
+}
+
+TEST(FragmentTests, DeltaOfAnotherGenerationIsIgnored)
+{
+	const auto path = temp_path("FragmentTests", "stale_delta", {".delta"});
+	ASSERT_TRUE(write(path, 100, 3));
+
+	const std::string updated = "updated";
+	Delta delta;
+	delta.add(1, &updated);
+
+	// left behind by the fragment this one replaced
+	ASSERT_TRUE(delta.append(path, 2, 0));
+
+	const Mapped fragment{path};
+
+	EXPECT_TRUE(fragment.changes().empty());
+	EXPECT_EQ(fragment.read(1), value_of(1));
+}
+
+TEST(FragmentTests, DeltaStopsAtTheFirstDamagedRecord)
+{
+	const auto path = temp_path("FragmentTests", "damaged_delta", {".delta"});
+	ASSERT_TRUE(write(path, 100));
+
+	const std::string first = "first";
+	const std::string second = "second";
+
+	Delta delta;
+	delta.add(1, &first);
+	ASSERT_TRUE(delta.append(path, 0, 0));
+
+	const auto intact = std::filesystem::file_size(path + ".delta");
+
+	Delta more;
+	more.add(2, &second);
+	ASSERT_TRUE(more.append(path, 0, intact));
+
+	flip_byte(path + ".delta", std::filesystem::file_size(path + ".delta") - 1);
+
+	const Mapped fragment{path};
+
+	EXPECT_EQ(fragment.read(1), first);
+	EXPECT_EQ(fragment.read(2), value_of(2));
+
+	// the next flush appends over the damaged record
+	EXPECT_EQ(fragment.delta_bytes(), intact);
+}
+
+TEST_P(CompressionTests, CompressedBlocksRoundTrip)
+{
+	const auto path = temp_path("FragmentTests", "compressed", {".delta"});
+
+	std::vector<std::string> values;
+
+	for (int key = 0; key < 2000; ++key)
+		values.push_back(value_of(key) + std::string(200, 'x'));
+
+	const auto [compressed, plain] = write_compressed(path, GetParam(), values);
+	EXPECT_LT(compressed, plain / 2);
+
+	const auto codecs = block_codecs(path);
+	ASSERT_GT(codecs.size(), 1u);
+	EXPECT_TRUE(std::ranges::all_of(codecs, [&](auto codec) { return codec == GetParam(); }));
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.valid());
+	ASSERT_TRUE(fragment.verify());
+	EXPECT_EQ(fragment.size(), values.size());
+
+	// a point read only inflates the block it needs
+	EXPECT_EQ(fragment.read(1234), values[1234]);
+	EXPECT_FALSE(fragment.read(2000));
+
+	const auto entries = contents(fragment);
+	ASSERT_EQ(entries.size(), values.size());
+
+	for (int key = 0; key < 2000; ++key)
+		EXPECT_EQ(entries[key], std::make_pair(key, values[key]));
+}
+
+TEST_P(CompressionTests, IncompressibleBlocksAreStoredRaw)
+{
+	const auto path = temp_path("FragmentTests", "incompressible", {".delta"});
+
+	std::mt19937 random{25};
+	std::vector<std::string> values;
+
+	for (int key = 0; key < 500; ++key)
+	{
+		std::string value(200, '\0');
+
+		for (auto& c : value)
+			c = static_cast<char>(random());
+
+		values.push_back(std::move(value));
+	}
+
+	const auto [compressed, plain] = write_compressed(path, GetParam(), values);
+	EXPECT_EQ(compressed, plain);
+
+	const auto codecs = block_codecs(path);
+	ASSERT_GT(codecs.size(), 1u);
+	EXPECT_TRUE(std::ranges::all_of(codecs, [](auto codec) { return codec == MILI::Database::Compression::None; }));
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.verify());
+	EXPECT_EQ(fragment.read(0), values[0]);
+	EXPECT_EQ(fragment.read(499), values[499]);
+}
+
+TEST_P(CompressionTests, DamagedCompressedBlockReadsAsMissing)
+{
+	const auto path = temp_path("FragmentTests", "damaged_compressed", {".delta"});
+
+	std::vector<std::string> values;
+
+	for (int key = 0; key < 2000; ++key)
+		values.push_back(value_of(key) + std::string(200, 'x'));
+
+	write_compressed(path, GetParam(), values);
+	flip_byte(path, MILI::Database::details::fragment_header_size + 10);
+
+	const Mapped fragment{path};
+
+	ASSERT_TRUE(fragment.valid());
+	EXPECT_FALSE(fragment.read(0));
+	EXPECT_EQ(fragment.damaged(), 1u);
+	EXPECT_EQ(fragment.read(1999), values[1999]);
+}
+
+INSTANTIATE_TEST_SUITE_P(Codecs, CompressionTests, ::testing::Values(MILI::Database::Compression::Lz4, MILI::Database::Compression::Zstd),
+	[](const auto& info) { return info.param == MILI::Database::Compression::Lz4 ? "Lz4" : "Zstd"; });
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "Metrics.hpp"
+
+namespace
+{
+	namespace metrics = MILI::Database::metrics;
+
+	using Histogram = metrics::Histogram;
+
+	// values below sub_count have a bucket each, every power of two above is split into sub_count buckets
+	static_assert(Histogram::index(0) == 0);
+	static_assert(Histogram::index(Histogram::sub_count - 1) == Histogram::sub_count - 1);
+	static_assert(Histogram::index(Histogram::sub_count) == Histogram::sub_count);
+	static_assert(Histogram::index(2 * Histogram::sub_count) == 2 * Histogram::sub_count);
+	static_assert(Histogram::index(2 * Histogram::sub_count + 1) == 2 * Histogram::sub_count);
+	static_assert(Histogram::index(std::uint64_t{1} << (Histogram::max_exponent + 1)) == Histogram::bucket_count - 1);
+	static_assert(Histogram::index(UINT64_MAX) == Histogram::bucket_count - 1);
+
+	static_assert(Histogram::lower_bound(Histogram::sub_count - 1) == Histogram::sub_count - 1);
+	static_assert(Histogram::lower_bound(Histogram::index(1000)) <= 1000 and 1000 < Histogram::lower_bound(Histogram::index(1000) + 1));
+
+	// the metrics register themselves for good, so they live as long as the registry does
+	metrics::Counter things_a{"test_things_total", "Things counted by the tests", "kind=\"a\""};
+	metrics::Counter things_b{"test_things_total", "Things counted by the tests", "kind=\"b\""};
+	metrics::Histogram latencies{"test_latency_seconds", "Latencies recorded by the tests"};
+	metrics::Histogram quantiles{"test_quantile_seconds", "Latencies the quantile test records"};
+	metrics::Histogram unused{"test_unused_seconds", "A histogram nothing is recorded in"};
+}
+
+TEST(MetricsTests, EveryValueFallsInsideItsBucket)
+{
+	for (std::uint64_t value = 0; value < 1 << 20; value += 1 + value / 64)
+	{
+		const std::size_t bucket = Histogram::index(value);
+
+		ASSERT_LE(Histogram::lower_bound(bucket), value);
+		ASSERT_LT(value, Histogram::lower_bound(bucket + 1));
+
+		// the width of a bucket stays within 1 / sub_count of the values in it
+		ASSERT_LE(Histogram::lower_bound(bucket + 1) - Histogram::lower_bound(bucket), std::max<std::uint64_t>(1, value / Histogram::sub_count));
+	}
+}
+
+TEST(MetricsTests, QuantilesStayWithinTheBucketError)
+{
+	EXPECT_EQ(unused.quantile(0.5), std::chrono::nanoseconds{0});
+
+	for (int micros = 1; micros <= 1000; ++micros)
+		quantiles.record(std::chrono::microseconds{micros});
+
+	for (double q : {0.0, 0.5, 0.9, 0.99, 1.0})
+	{
+		const double exact = 1000.0 * (1.0 + std::floor(q * 999.0));
+		const auto reported = static_cast<double>(quantiles.quantile(q).count());
+
+		EXPECT_GE(reported, exact) << "q " << q;
+		EXPECT_LE(reported, exact * (1.0 + 1.0 / Histogram::sub_count)) << "q " << q;
+	}
+
+	EXPECT_EQ(quantiles.sum(), std::chrono::nanoseconds{500500 * 1000});
+}
+
+TEST(MetricsTests, RenderWritesThePrometheusTextFormat)
+{
+	things_a.add(3);
+	things_b.add();
+
+	latencies.record(std::chrono::microseconds{2});
+	latencies.record(std::chrono::seconds{1});
+
+	const std::string text = metrics::render();
+
+	// a family shares its HELP and TYPE lines
+	const std::string family = "# HELP test_things_total Things counted by the tests\n# TYPE test_things_total counter\n"
+		"test_things_total{kind=\"a\"} 3\ntest_things_total{kind=\"b\"} 1\n";
+	EXPECT_NE(text.find(family), std::string::npos) << text;
+
+	EXPECT_NE(text.find("# TYPE test_latency_seconds histogram\n"), std::string::npos);
+
+	// 2 microseconds are under the 2^11 ns bound, a second only makes it into the bucket at 2^30 ns
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"1.024e-06\"} 0\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"2.048e-06\"} 1\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"0.536870912\"} 1\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"1.07374182\"} 2\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 2\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_sum 1.000002\n"), std::string::npos);
+	EXPECT_NE(text.find("test_latency_seconds_count 2\n"), std::string::npos);
+
+	// the store's own metrics are there too, labelled by operation
+	EXPECT_NE(text.find("vault_table_operation_seconds_count{operation=\"read\"} "), std::string::npos);
+}
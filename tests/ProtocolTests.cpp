@@ -0,0 +1,123 @@
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Protocol.hpp"
+
+namespace
+{
+	namespace Protocol = MILI::Database::Protocol;
+
+	// keys and values are both strings here, which the default serializer can't tell apart
+	struct StringSerializer
+	{
+		static std::vector<std::byte> serialize(const std::string& text)
+		{
+			const auto* data = reinterpret_cast<const std::byte*>(text.data());
+			return {data, data + text.size()};
+		}
+
+		template <typename T>
+		static T deserialize(std::span<const std::byte> bytes)
+		{
+			return {reinterpret_cast<const char*>(bytes.data()), bytes.size()};
+		}
+	};
+
+	using Codec = Protocol::Codec<std::string, std::string, StringSerializer>;
+	using Response = Protocol::Response<std::string, std::string>;
+
+	std::vector<Response> round_trip(const std::vector<Response>& responses, Protocol::Status status = Protocol::Status::Ok)
+	{
+		const auto frame = Codec::encode(std::span<const Response>{responses}, status);
+		const auto decoded = Codec::decode_responses(frame);
+
+		EXPECT_TRUE(decoded);
+
+		if (not decoded)
+			return {};
+
+		EXPECT_EQ(decoded->first, status);
+		return decoded->second;
+	}
+}
+
+TEST(ProtocolTests, EmptyValueIsNotAMissingOne)
+{
+	const auto decoded = round_trip({
+		Response{1, Protocol::Status::Ok, std::string{}, std::nullopt},
+		Response{2, Protocol::Status::Failed, std::nullopt, std::nullopt},
+		Response{3, Protocol::Status::Ok, "value", std::nullopt}});
+
+	ASSERT_EQ(decoded.size(), 3u);
+
+	EXPECT_EQ(decoded[0].id, 1u);
+	EXPECT_EQ(decoded[0].value, std::string{});
+	EXPECT_FALSE(decoded[0].key);
+
+	EXPECT_EQ(decoded[1].status, Protocol::Status::Failed);
+	EXPECT_FALSE(decoded[1].value);
+
+	EXPECT_EQ(decoded[2].value, "value");
+}
+
+TEST(ProtocolTests, EmptyKeyRowIsNotTheEndOfAScan)
+{
+	const auto decoded = round_trip({
+		Response{7, Protocol::Status::Ok, std::string{}, std::string{}},
+		Response{7, Protocol::Status::Ok, "b", "a"},
+		Response{7, Protocol::Status::Truncated, std::nullopt, std::nullopt}});
+
+	ASSERT_EQ(decoded.size(), 3u);
+
+	// the row with the empty key carries it, only the last response ends the scan
+	EXPECT_EQ(decoded[0].key, std::string{});
+	EXPECT_EQ(decoded[0].value, std::string{});
+	EXPECT_EQ(decoded[1].key, "a");
+	EXPECT_FALSE(decoded[2].key);
+	EXPECT_EQ(decoded[2].status, Protocol::Status::Truncated);
+}
+
+TEST(ProtocolTests, RequestsRoundTrip)
+{
+	const std::vector<Protocol::Request<std::string, std::string>> requests{
+		{1, Protocol::Opcode::Insert, "table", "key", "", {}, 0},
+		{2, Protocol::Opcode::Read, "table", "", {}, {}, 0},
+		{3, Protocol::Opcode::Scan, "table", "a", {}, "z", 10}};
+
+	const auto decoded = Codec::decode_requests(Codec::encode(std::span{requests}));
+	ASSERT_TRUE(decoded);
+	ASSERT_EQ(decoded->size(), 3u);
+
+	EXPECT_EQ((*decoded)[0].opcode, Protocol::Opcode::Insert);
+	EXPECT_EQ((*decoded)[0].key, "key");
+	EXPECT_EQ((*decoded)[0].value, "");
+
+	EXPECT_EQ((*decoded)[1].opcode, Protocol::Opcode::Read);
+	EXPECT_EQ((*decoded)[1].key, "");
+
+	EXPECT_EQ((*decoded)[2].high, "z");
+	EXPECT_EQ((*decoded)[2].limit, 10u);
+}
+
+TEST(ProtocolTests, DamagedFramesAreRefused)
+{
+	const std::vector<Response> responses{Response{1, Protocol::Status::Ok, "value", "key"}};
+	auto frame = Codec::encode(std::span<const Response>{responses});
+
+	// a presence flag that is neither set nor clear
+	auto bad_flag = frame;
+	bad_flag[1 + 1 + 4 + 4 + 1] = std::byte{2};
+	EXPECT_FALSE(Codec::decode_responses(bad_flag));
+
+	// cut short in the middle of the value
+	frame.pop_back();
+	EXPECT_FALSE(Codec::decode_responses(frame));
+
+	// a frame of another version
+	frame[0] = std::byte{1};
+	EXPECT_FALSE(Codec::decode_responses(frame));
+}
@@ -225,3 +225,156 @@ TYPED_TEST_P(PrimitiveRangeSuite, RangeTests)
 
 REGISTER_TYPED_TEST_SUITE_P(PrimitiveRangeSuite, RangeTests);
 INSTANTIATE_TYPED_TEST_SUITE_P(PrimitiveRangeTests, PrimitiveRangeSuite, typename typelist_from_tuple<decltype(range_test_data)>::type);
+
+
+TEST(BulkSerializerTests, ContiguousRangeRoundTrip)
+{
+	std::vector<double> data(1024);
+
+	for (auto& e : data)
+		e = std::rand() / 100000.0;
+
+	auto serialized = MILI::serialize(data);
+
+	EXPECT_EQ(serialized.size(), data.size() * sizeof(double));
+	EXPECT_EQ(serialized.capacity(), serialized.size());
+	EXPECT_EQ(MILI::deserialize_range<double>(serialized), data);
+}
+
+TEST(BulkSerializerTests, SerializeInto)
+{
+	std::vector<int> data{1, 2, 3, 4};
+	std::set<int> ordered{1, 2, 3, 4};
+	std::array<std::byte, 16> buffer{};
+	std::array<std::byte, 15> small{};
+
+	auto written = MILI::serialize_into(data, buffer);
+	ASSERT_TRUE(written.has_value());
+	EXPECT_EQ(*written, buffer.size());
+	EXPECT_TRUE(std::ranges::equal(buffer, MILI::serialize(data)));
+
+	EXPECT_EQ(MILI::serialize_into(ordered, buffer), std::optional<std::size_t>{buffer.size()});
+	EXPECT_TRUE(std::ranges::equal(buffer, MILI::serialize(data)));
+
+	EXPECT_FALSE(MILI::serialize_into(data, small).has_value());
+	EXPECT_FALSE(MILI::serialize_into(ordered, small).has_value());
+
+	EXPECT_EQ(MILI::serialize_into(42, buffer), std::optional<std::size_t>{sizeof(int)});
+	EXPECT_EQ(MILI::deserialize<int>(std::span<const std::byte>{buffer.data(), sizeof(int)}), 42);
+}
+
+TEST(BulkSerializerTests, FixedSizeSpan)
+{
+	std::array<std::uint64_t, 4> data{1, 2, 3, ~0ull};
+	auto serialized = MILI::serialize(std::span<std::uint64_t, 4>{data});
+
+	EXPECT_EQ((MILI::deserialize<std::uint64_t, 4>(std::span<const std::byte, sizeof(serialized)>{serialized})), data);
+}
+
+
+struct Point
+{
+	int x;
+	int y;
+};
+
+struct Padded
+{
+	char c;
+	double d;
+};
+
+struct Record
+{
+	std::uint64_t id;
+	std::string name;
+	std::vector<double> scores;
+	std::array<Point, 2> corners;
+	std::vector<std::string> tags;
+	bool active;
+};
+
+static_assert(MILI::details::count_fields<Record>() == 6);
+static_assert(MILI::details::fixed_size<Point>() == sizeof(Point));
+static_assert(MILI::details::fixed_size<Padded>() == sizeof(char) + sizeof(double));
+static_assert(MILI::details::fixed_size<Record>() == MILI::details::variable_size);
+
+TEST(AggregateSerializerTests, FixedSizeAggregates)
+{
+	auto point = MILI::serialize(Point{1, -2});
+	static_assert(std::same_as<decltype(point), std::array<std::byte, sizeof(Point)>>);
+
+	auto deserialized_point = MILI::deserialize<Point>(point);
+	EXPECT_EQ(deserialized_point.x, 1);
+	EXPECT_EQ(deserialized_point.y, -2);
+
+	// padding is not serialized
+	auto padded = MILI::serialize(Padded{'c', 3.0});
+	EXPECT_EQ(padded.size(), sizeof(char) + sizeof(double));
+
+	auto deserialized_padded = MILI::deserialize<Padded>(padded);
+	EXPECT_EQ(deserialized_padded.c, 'c');
+	EXPECT_EQ(deserialized_padded.d, 3.0);
+}
+
+TEST(AggregateSerializerTests, VariableSizeAggregates)
+{
+	Record record{42, "name", {1.0, 2.0}, {Point{1, 2}, Point{3, 4}}, {"a", "bc"}, true};
+
+	auto serialized = MILI::serialize(record);
+	EXPECT_EQ(serialized.size(), MILI::serialized_size(record));
+	EXPECT_EQ(serialized.size(), 8 + (4 + 4) + (4 + 16) + 16 + (4 + 4 + 1 + 4 + 2) + 1);
+
+	auto deserialized = MILI::deserialize<Record>(std::span<const std::byte>{serialized});
+	EXPECT_EQ(deserialized.id, record.id);
+	EXPECT_EQ(deserialized.name, record.name);
+	EXPECT_EQ(deserialized.scores, record.scores);
+	EXPECT_EQ(deserialized.corners[1].y, 4);
+	EXPECT_EQ(deserialized.tags, record.tags);
+	EXPECT_TRUE(deserialized.active);
+
+	std::vector<std::byte> sink;
+	MILI::serialize_into(sink, record);
+	EXPECT_EQ(sink, serialized);
+
+	// a truncated buffer leaves the fields it doesn't reach defaulted
+	auto truncated = MILI::deserialize<Record>(std::span<const std::byte>{serialized.data(), 12});
+	EXPECT_EQ(truncated.id, record.id);
+	EXPECT_TRUE(truncated.name.empty());
+}
+
+TEST(AggregateSerializerTests, StringsAndVectors)
+{
+	std::string string{"some string"};
+	auto serialized_string = MILI::serialize(string);
+	EXPECT_EQ(serialized_string.size(), string.size());
+	EXPECT_EQ(MILI::deserialize<std::string>(std::span<const std::byte>{serialized_string}), string);
+
+	std::vector<std::string> strings{"a", "bc", ""};
+	auto serialized_strings = MILI::serialize(strings);
+	EXPECT_EQ(serialized_strings.size(), 3 * sizeof(std::uint32_t) + 3);
+	EXPECT_EQ(MILI::deserialize<std::vector<std::string>>(std::span<const std::byte>{serialized_strings}), strings);
+
+	std::vector<int> ints{1, 2, 3};
+	auto serialized_ints = MILI::serialize(ints);
+	EXPECT_EQ(MILI::deserialize<std::vector<int>>(std::span<const std::byte>{serialized_ints}), ints);
+}
+
+TEST(AggregateSerializerTests, SizedDataMustFitItsPrefix)
+{
+	struct Serializer
+	{
+		static auto serialize(const std::string& data)
+		{
+			return MILI::serialize(data);
+		}
+	};
+
+	std::vector<std::byte> sink;
+	EXPECT_TRUE(MILI::serialize_sized_into<Serializer>(sink, std::string(MILI::max_sized_bytes, 'a')));
+	EXPECT_EQ(sink.size(), sizeof(std::uint16_t) + MILI::max_sized_bytes);
+
+	// anything larger would have its size cut down to 16 bits, it is refused without touching the sink
+	EXPECT_FALSE(MILI::serialize_sized_into<Serializer>(sink, std::string(MILI::max_sized_bytes + 1, 'b')));
+	EXPECT_EQ(sink.size(), sizeof(std::uint16_t) + MILI::max_sized_bytes);
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "LsmEngine.hpp"
+#include "TestFiles.hpp"
+
+namespace
+{
+	using MILI::Database::Testing::temp_path;
+	using MILI::Database::Testing::flip_byte;
+
+	using Serializer = MILI::Database::details::DefaultSerializer<int, std::string>;
+	using Run = MILI::Database::details::SortedRun<int, std::string, Serializer>;
+
+	std::string value_of(int key)
+	{
+		return "value of " + std::to_string(key);
+	}
+
+	// keys 0 to count - 1, every third one a tombstone, spilled to the file several times along the way
+	bool write(const std::string& path, int count)
+	{
+		Run::Writer writer{path, static_cast<std::size_t>(count)};
+
+		for (int key = 0; key < count; ++key)
+			writer.add(key, key % 3 == 0 ? std::nullopt : std::optional{value_of(key) + std::string(100, 'x')});
+
+		return writer.finish();
+	}
+
+	using Engine = MILI::Database::details::LsmEngine<int, std::string, Serializer>;
+
+	// the directory of the table's tree, emptied so a run starts clean. The table's own is made by the checkpoint
+	std::string tree_directory(std::string_view table)
+	{
+		const auto table_directory = std::string{MILI::Database::database_path} + "SortedRunTests/" + std::string{table};
+
+		std::filesystem::remove_all(table_directory);
+		std::filesystem::create_directories(table_directory);
+
+		return table_directory + "/lsm0";
+	}
+
+	// the sequences of the runs in the directory
+	std::vector<std::uint64_t> run_sequences(const std::string& directory)
+	{
+		std::vector<std::uint64_t> ret;
+
+		for (const auto& entry : std::filesystem::directory_iterator{directory})
+			if (entry.path().extension() == ".run")
+				ret.push_back(std::stoull(entry.path().stem().string()));
+
+		std::ranges::sort(ret);
+		return ret;
+	}
+
+	// one memtable of keys first to first + count - 1 written out as a level 0 run
+	void flush_keys(Engine& engine, std::string_view table, int first, int count, const std::string& suffix = {})
+	{
+		auto* tree = engine.get_bucket(table, 0);
+
+		for (int key = first; key < first + count; ++key)
+			ASSERT_TRUE(tree->insert(key, value_of(key) + suffix));
+
+		ASSERT_TRUE(engine.flush());
+	}
+}
+
+TEST(SortedRunTests, RecordsRoundTrip)
+{
+	const auto path = temp_path("SortedRunTests", "round_trip");
+	ASSERT_TRUE(write(path, 10000));
+
+	// the run outgrows the spill size, so it was written in pieces
+	EXPECT_GT(std::filesystem::file_size(path), Run::Writer::spill_bytes);
+	EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+
+	const auto run = Run::open(path, 1);
+	ASSERT_TRUE(run);
+	EXPECT_EQ(run->size(), 10000u);
+
+	for (int key = 0; key < 10000; ++key)
+	{
+		const auto found = run->find(key);
+		ASSERT_TRUE(found);
+
+		if (key % 3 == 0)
+			EXPECT_FALSE(*found);
+		else
+			EXPECT_EQ(*found, value_of(key) + std::string(100, 'x'));
+	}
+
+	EXPECT_FALSE(run->find(10000));
+	EXPECT_EQ(run->lower_bound(5000), 5000u);
+	EXPECT_EQ(run->upper_bound(5000), 5001u);
+}
+
+TEST(SortedRunTests, UnfinishedWriterLeavesNothingBehind)
+{
+	const auto path = temp_path("SortedRunTests", "unfinished");
+
+	{
+		Run::Writer writer{path, 10};
+		writer.add(1, value_of(1));
+	}
+
+	EXPECT_FALSE(std::filesystem::exists(path));
+	EXPECT_FALSE(std::filesystem::exists(path + ".tmp"));
+}
+
+TEST(SortedRunTests, DamagedBlockReadsAsMissing)
+{
+	const auto path = temp_path("SortedRunTests", "damaged");
+	ASSERT_TRUE(write(path, 1000));
+
+	// a byte of the first record, which sits in the first block
+	flip_byte(path, 10);
+
+	const auto run = Run::open(path, 1);
+	ASSERT_TRUE(run);
+
+	EXPECT_FALSE(run->readable(0));
+	EXPECT_FALSE(run->readable(Run::block_records - 1));
+	EXPECT_FALSE(run->find(1));
+
+	// the other blocks are served as they are
+	EXPECT_TRUE(run->readable(Run::block_records));
+	EXPECT_EQ(run->find(998), value_of(998) + std::string(100, 'x'));
+}
+
+TEST(SortedRunTests, DamagedIndexIsRefused)
+{
+	const auto path = temp_path("SortedRunTests", "damaged_index");
+	ASSERT_TRUE(write(path, 1000));
+
+	flip_byte(path, std::filesystem::file_size(path) - Run::trailer_size - 1);
+
+	EXPECT_FALSE(Run::open(path, 1));
+}
+
+TEST(SortedRunTests, LegacyRunsStayReadable)
+{
+	const auto path = temp_path("SortedRunTests", "legacy");
+
+	// [magic "MILR"][u32 count][records][u32 offset per record][bloom filter][u64 index offset][u64 bloom offset]
+	std::vector<std::byte> file;
+	const std::array<char, 4> magic{'M', 'I', 'L', 'R'};
+	const auto header = MILI::serialize(magic, std::uint32_t{3});
+	file.insert(file.end(), header.begin(), header.end());
+
+	std::vector<std::uint32_t> offsets;
+	MILI::Database::details::BloomFilter filter{3};
+
+	for (int key : {1, 2, 3})
+	{
+		offsets.push_back(static_cast<std::uint32_t>(file.size()));
+		filter.insert(std::hash<int>{}(key));
+
+		MILI::serialize_into(file, static_cast<std::uint8_t>(key != 2));
+		ASSERT_TRUE(MILI::serialize_sized_into<Serializer>(file, key));
+
+		if (key != 2)
+			ASSERT_TRUE(MILI::serialize_sized_into<Serializer>(file, value_of(key)));
+		else
+			MILI::serialize_into(file, std::uint16_t{});
+	}
+
+	const auto index_offset = static_cast<std::uint64_t>(file.size());
+	const auto index = MILI::serialize(offsets);
+	file.insert(file.end(), index.begin(), index.end());
+
+	const auto bloom_offset = static_cast<std::uint64_t>(file.size());
+	const auto bloom = filter.serialize();
+	file.insert(file.end(), bloom.begin(), bloom.end());
+
+	const auto trailer = MILI::serialize(index_offset, bloom_offset);
+	file.insert(file.end(), trailer.begin(), trailer.end());
+
+	ASSERT_TRUE(MILI::Database::details::commit_file(path, file));
+
+	const auto run = Run::open(path, 1);
+	ASSERT_TRUE(run);
+
+	EXPECT_EQ(run->size(), 3u);
+	EXPECT_EQ(run->find(1), value_of(1));
+	EXPECT_EQ(run->find(2), std::optional<std::optional<std::string>>{std::in_place}); // a tombstone
+	EXPECT_EQ(run->find(3), value_of(3));
+}
+
+TEST(LsmEngineTests, ReadsGoThroughTheMemtableAndTheRuns)
+{
+	const auto directory = tree_directory("reads");
+	Engine engine{"SortedRunTests"};
+	engine.construct();
+
+	flush_keys(engine, "reads", 0, 100);
+
+	auto* tree = engine.get_bucket("reads", 0);
+	ASSERT_TRUE(tree->update(10, "newer"));
+	ASSERT_TRUE(tree->remove(20));
+
+	const auto before = engine.stats();
+
+	// the memtable shadows the run, what it doesn't hold comes from the run
+	EXPECT_EQ(engine.read("reads", 0, 10), "newer");
+	EXPECT_FALSE(engine.read("reads", 0, 20));
+	EXPECT_EQ(engine.read("reads", 0, 30), value_of(30));
+	EXPECT_FALSE(engine.read("reads", 0, 100));
+
+	const auto after = engine.stats();
+	EXPECT_EQ(after.hits - before.hits, 2u);
+	EXPECT_EQ(after.misses - before.misses, 2u);
+
+	std::vector<std::optional<std::string>> batch;
+	engine.read_batch("reads", 0, [&](auto&& read)
+	{
+		for (int key : {10, 20, 30})
+			batch.push_back(read(key));
+	});
+
+	EXPECT_EQ(batch, (std::vector<std::optional<std::string>>{"newer", std::nullopt, value_of(30)}));
+	EXPECT_EQ(engine.stats().hits - after.hits, 2u);
+}
+
+TEST(LsmEngineTests, CompactionMergesLevelZero)
+{
+	const auto directory = tree_directory("compaction");
+	Engine engine{"SortedRunTests"};
+	engine.construct();
+
+	// every memtable overwrites the keys of the one before, the last one removes some
+	for (int round = 0; round + 1 < 4; ++round)
+		flush_keys(engine, "compaction", 0, 1000, std::to_string(round));
+
+	auto* tree = engine.get_bucket("compaction", 0);
+
+	for (int key = 0; key < 1000; key += 2)
+		ASSERT_TRUE(tree->remove(key));
+
+	ASSERT_TRUE(engine.flush());
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+
+	while (run_sequences(directory).size() > 1 and std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+	ASSERT_EQ(run_sequences(directory).size(), 1u);
+
+	for (int key = 0; key < 1000; ++key)
+	{
+		if (key % 2 == 0)
+			EXPECT_FALSE(engine.read("compaction", 0, key));
+		else
+			EXPECT_EQ(engine.read("compaction", 0, key), value_of(key) + "2");
+	}
+}
+
+TEST(LsmEngineTests, DamagedInputStallsCompaction)
+{
+	const auto directory = tree_directory("damaged_input");
+
+	{
+		Engine engine{"SortedRunTests"};
+		engine.construct();
+
+		for (int round = 0; round < 3; ++round)
+			flush_keys(engine, "damaged_input", round * 1000, 1000);
+	}
+
+	// a byte of the first record of the oldest run, which the merge reaches first
+	flip_byte(directory + "/0.run", 10);
+
+	Engine engine{"SortedRunTests"};
+	flush_keys(engine, "damaged_input", 3000, 1000);
+
+	// the fourth run makes level 0 full, the merge fails on the damaged block and must not be retried in a loop
+	std::this_thread::sleep_for(std::chrono::milliseconds{200});
+	flush_keys(engine, "damaged_input", 4000, 1000);
+
+	const auto sequences = run_sequences(directory);
+
+	// 0 to 3 and the flush above, which comes after at most one failed merge
+	ASSERT_EQ(sequences.size(), 5u);
+	EXPECT_LE(sequences.back(), 5u);
+
+	// the inputs stayed in place, everything outside the damaged block is still served
+	EXPECT_EQ(engine.read("damaged_input", 0, 999), value_of(999));
+	EXPECT_EQ(engine.read("damaged_input", 0, 3500), value_of(3500));
+	EXPECT_EQ(engine.read("damaged_input", 0, 4999), value_of(4999));
+}
@@ -0,0 +1,149 @@
+#include <array>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "TableLayout.hpp"
+#include "TestFiles.hpp"
+
+namespace
+{
+	using MILI::Database::details::TableLayout;
+	using MILI::Database::Testing::temp_path;
+}
+
+TEST(TableLayoutTests, FirstSplitDividesBucketZero)
+{
+	TableLayout layout{4};
+
+	EXPECT_EQ(layout.bucket_count(), 4u);
+	EXPECT_EQ(layout.next_split(), std::make_pair(std::size_t{0}, std::size_t{4}));
+
+	for (std::size_t hash = 0; hash < 64; ++hash)
+	{
+		EXPECT_EQ(layout.bucket(hash), hash % 4);
+		EXPECT_EQ(layout.moves(hash), hash % 8 == 4);
+	}
+
+	layout.grow();
+
+	EXPECT_EQ(layout.bucket_count(), 5u);
+	EXPECT_EQ(layout.last_split(), std::make_pair(std::size_t{0}, std::size_t{4}));
+	EXPECT_EQ(layout.next_split(), std::make_pair(std::size_t{1}, std::size_t{5}));
+
+	// bucket 0 answers to the doubled address space now, the others don't until they are split
+	EXPECT_EQ(layout.bucket(4), 4u);
+	EXPECT_EQ(layout.bucket(8), 0u);
+	EXPECT_EQ(layout.bucket(12), 4u);
+	EXPECT_EQ(layout.bucket(5), 1u);
+	EXPECT_EQ(layout.bucket(13), 1u);
+}
+
+TEST(TableLayoutTests, RoundEndsWithTheAddressSpaceDoubled)
+{
+	TableLayout layout{3};
+
+	for (int split = 0; split < 3; ++split)
+		layout.grow();
+
+	EXPECT_EQ(layout.bucket_count(), 6u);
+	EXPECT_EQ(layout.next_split(), std::make_pair(std::size_t{0}, std::size_t{6}));
+	EXPECT_EQ(layout.last_split(), std::make_pair(std::size_t{2}, std::size_t{5}));
+
+	for (std::size_t hash = 0; hash < 64; ++hash)
+		EXPECT_EQ(layout.bucket(hash), hash % 6);
+}
+
+TEST(TableLayoutTests, SplitsOnlyMoveTheKeysTheyAnnounce)
+{
+	std::mt19937_64 random{21};
+	TableLayout layout{5};
+
+	std::vector<std::size_t> hashes(2000);
+
+	for (auto& hash : hashes)
+		hash = random();
+
+	for (int split = 0; split < 40; ++split)
+	{
+		const auto [from, to] = layout.next_split();
+
+		std::vector<std::size_t> before;
+		std::vector<bool> moves;
+
+		for (const auto hash : hashes)
+		{
+			before.push_back(layout.bucket(hash));
+			moves.push_back(layout.moves(hash));
+		}
+
+		layout.grow();
+
+		for (std::size_t i = 0; i < hashes.size(); ++i)
+		{
+			const std::size_t after = layout.bucket(hashes[i]);
+
+			ASSERT_LT(after, layout.bucket_count());
+
+			// a key never leaves the group of its root, which picks its stripe
+			ASSERT_EQ(layout.root(after), layout.root(hashes[i]));
+
+			if (moves[i])
+			{
+				ASSERT_EQ(before[i], from);
+				ASSERT_EQ(after, to);
+			}
+			else
+				ASSERT_EQ(after, before[i]);
+		}
+	}
+}
+
+TEST(TableLayoutTests, PersistedLayoutLoadsBack)
+{
+	const auto path = temp_path("TableLayoutTests", "round_trip");
+
+	TableLayout layout{8};
+	layout.grow();
+	layout.grow();
+	layout.cleaning = true;
+
+	EXPECT_FALSE(layout.is_persisted());
+	ASSERT_TRUE(layout.persist(path));
+	EXPECT_TRUE(layout.is_persisted());
+
+	const auto loaded = TableLayout::load(path, 64);
+
+	EXPECT_TRUE(loaded.is_persisted());
+	EXPECT_EQ(loaded.initial_buckets(), 8u);
+	EXPECT_EQ(loaded.bucket_count(), 10u);
+	EXPECT_TRUE(loaded.cleaning);
+
+	// a split announces the bucket it creates before it is made
+	ASSERT_TRUE(layout.persist_split(path));
+	EXPECT_EQ(TableLayout::load(path, 64).bucket_count(), 11u);
+	EXPECT_EQ(layout.bucket_count(), 10u);
+}
+
+TEST(TableLayoutTests, MissingOrDamagedLayoutFallsBackToTheDefault)
+{
+	const auto path = temp_path("TableLayoutTests", "missing");
+
+	const auto missing = TableLayout::load(path, 64);
+
+	EXPECT_FALSE(missing.is_persisted());
+	EXPECT_EQ(missing.initial_buckets(), 64u);
+	EXPECT_EQ(missing.bucket_count(), 64u);
+
+	const std::array<std::byte, 4> garbage{std::byte{'M'}, std::byte{'I'}, std::byte{'L'}, std::byte{'X'}};
+	ASSERT_TRUE(MILI::Database::details::commit_file(path, garbage));
+
+	const auto damaged = TableLayout::load(path, 16);
+
+	EXPECT_FALSE(damaged.is_persisted());
+	EXPECT_EQ(damaged.bucket_count(), 16u);
+}
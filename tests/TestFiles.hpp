@@ -0,0 +1,45 @@
+#pragma once
+
+#include <filesystem>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+// Files the storage tests write and damage, shared by every test that works below the Vault.
+namespace MILI::Database::Testing
+{
+
+// a path under <temp>/<suite>, the file and its companions named path + suffix are removed so a run starts clean
+inline std::string temp_path(std::string_view suite, std::string_view name, std::initializer_list<std::string_view> suffixes = {})
+{
+	const auto directory = std::filesystem::temp_directory_path() / suite;
+	std::filesystem::create_directories(directory);
+
+	const auto path = (directory / name).string();
+	std::filesystem::remove(path);
+
+	for (const auto suffix : suffixes)
+		std::filesystem::remove(path + std::string{suffix});
+
+	return path;
+}
+
+// inverts every bit of the byte at offset, the way a bad sector or a torn write would damage it
+inline void flip_byte(const std::string& path, off_t offset)
+{
+	const int fd = open(path.c_str(), O_RDWR);
+	ASSERT_GE(fd, 0);
+
+	std::byte byte{};
+	ASSERT_EQ(pread(fd, &byte, 1, offset), 1);
+	byte = ~byte;
+	ASSERT_EQ(pwrite(fd, &byte, 1, offset), 1);
+
+	close(fd);
+}
+
+}
@@ -0,0 +1,796 @@
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Vault.hpp"
+#include "Protocol.hpp"
+
+// Every test works on its own table of one database, which is recreated once per run.
+
+using TestVault = MILI::Database::Vault<int, std::string>;
+
+constexpr std::string_view database_name = "VaultTests";
+
+TestVault& vault()
+{
+	static TestVault& instance = []() -> TestVault&
+	{
+		// the log sits next to the database directory, a run that crashed would have it replayed into this one
+		const auto path = std::string{MILI::Database::database_path} + std::string{database_name};
+
+		std::error_code error;
+		std::filesystem::remove_all(path, error);
+		std::filesystem::remove(path + ".wal", error);
+		std::filesystem::remove(path + ".wal.sealed", error);
+
+		auto created = TestVault::construct(database_name);
+		return created ? created->get() : TestVault::get_instance(database_name)->get();
+	}();
+
+	return instance;
+}
+
+std::string value_of(int key)
+{
+	return "value of " + std::to_string(key);
+}
+
+namespace
+{
+	using TestCache = MILI::Database::Cache<int, std::string>;
+
+	TestCache::Entry cache_entry(std::string table, int key, TestCache::Operation operation = TestCache::Operation::Insert)
+	{
+		return TestCache::Entry{std::move(table), key, operation == TestCache::Operation::Remove ? std::string{} : value_of(key), operation};
+	}
+}
+
+TEST(VaultCacheTests, RemovalsStayIndexedAsTombstones)
+{
+	TestCache cache;
+
+	cache.push(cache_entry("users", 1));
+	cache.push(cache_entry("users", 2, TestCache::Operation::Remove));
+
+	// a removal shadows the stored row, so it has to be found like any other entry
+	const auto* removed = cache.find("users", 2);
+	ASSERT_NE(removed, nullptr);
+	EXPECT_EQ(removed->operation, TestCache::Operation::Remove);
+
+	ASSERT_NE(cache.find("users", 1), nullptr);
+	EXPECT_EQ(cache.find("users", 1)->value, value_of(1));
+	EXPECT_EQ(cache.find("users", 3), nullptr);
+
+	// the same key in another table is another entry
+	EXPECT_EQ(cache.find("orders", 1), nullptr);
+	cache.push(cache_entry("orders", 1, TestCache::Operation::Update));
+	EXPECT_EQ(cache.find("orders", 1)->operation, TestCache::Operation::Update);
+	EXPECT_EQ(cache.find("users", 1)->operation, TestCache::Operation::Insert);
+}
+
+TEST(VaultCacheTests, IndexGrowsWithItsEntries)
+{
+	TestCache cache;
+
+	// keys a power of two apart land on the same slot of a small index, every growth has to move them apart again
+	for (int key = 0; key < 10000; ++key)
+		cache.push(cache_entry(key % 2 ? "odd" : "even", key * 1024));
+
+	EXPECT_EQ(cache.size(), 10000u);
+
+	for (int key = 0; key < 10000; ++key)
+	{
+		const auto* entry = cache.find(key % 2 ? "odd" : "even", key * 1024);
+		ASSERT_NE(entry, nullptr);
+		ASSERT_EQ(entry->key, key * 1024);
+		ASSERT_EQ(entry->value, value_of(key * 1024));
+	}
+
+	EXPECT_EQ(cache.find("odd", 0), nullptr);
+	EXPECT_EQ(cache.find("even", 1024), nullptr);
+}
+
+TEST(VaultCacheTests, ClearedIndexTakesEntriesAgain)
+{
+	TestCache cache;
+
+	for (int key = 0; key < 1000; ++key)
+		cache.push(cache_entry("users", key));
+
+	cache.clear();
+
+	EXPECT_EQ(cache.size(), 0u);
+	EXPECT_EQ(cache.find("users", 0), nullptr);
+
+	// the slots are kept, entries pushed after the clear must not be shadowed by stale ones
+	for (int key = 500; key < 1500; ++key)
+		cache.push(cache_entry("users", key, TestCache::Operation::Update));
+
+	for (int key = 0; key < 500; ++key)
+		ASSERT_EQ(cache.find("users", key), nullptr);
+
+	for (int key = 500; key < 1500; ++key)
+	{
+		const auto* entry = cache.find("users", key);
+		ASSERT_NE(entry, nullptr);
+		ASSERT_EQ(entry->operation, TestCache::Operation::Update);
+	}
+}
+
+TEST(VaultScanTests, KeepNewestLeavesRowsInPlaceIntact)
+{
+	// no duplicates, every row is already where it belongs
+	std::vector<std::pair<int, std::optional<std::string>>> rows{{1, value_of(1)}, {2, value_of(2)}, {3, std::nullopt}};
+	MILI::Database::details::keep_newest(rows);
+
+	const std::vector<std::pair<int, std::optional<std::string>>> expected{{1, value_of(1)}, {2, value_of(2)}, {3, std::nullopt}};
+	EXPECT_EQ(rows, expected);
+}
+
+TEST(VaultScanTests, KeepNewestKeepsTheLastRowOfEveryKey)
+{
+	std::vector<std::pair<int, std::optional<std::string>>> rows{{2, "old"}, {1, value_of(1)}, {2, std::nullopt}, {3, "old"}, {2, "new"}, {3, "new"}};
+	MILI::Database::details::keep_newest(rows);
+
+	const std::vector<std::pair<int, std::optional<std::string>>> expected{{1, value_of(1)}, {2, "new"}, {3, "new"}};
+	EXPECT_EQ(rows, expected);
+}
+
+TEST(VaultScanTests, CachedRowsKeepTheirValues)
+{
+	auto table = vault().table("scan_cached", 4);
+
+	for (int key = 0; key < 100; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	// rows served by the write cache go through the scan's dedup pass, which must not move a row onto itself
+	int count = 0;
+
+	for (const auto& [key, value] : table.scan(0, 99))
+	{
+		EXPECT_EQ(key, count);
+		EXPECT_EQ(value, value_of(key));
+		++count;
+	}
+
+	EXPECT_EQ(count, 100);
+}
+
+TEST(VaultScanTests, NewestCachedRowWins)
+{
+	auto table = vault().table("scan_newest", 4);
+
+	for (int key = 0; key < 50; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	for (int key = 0; key < 50; key += 2)
+		ASSERT_TRUE(table.update(key, value_of(key) + " updated"));
+
+	for (int key = 1; key < 50; key += 4)
+		ASSERT_TRUE(table.remove(key));
+
+	std::vector<std::pair<int, std::string>> rows;
+
+	for (const auto& row : table.scan(0, 49))
+		rows.push_back(row);
+
+	std::vector<std::pair<int, std::string>> expected;
+
+	for (int key = 0; key < 50; ++key)
+		if (key % 4 != 1)
+			expected.emplace_back(key, key % 2 == 0 ? value_of(key) + " updated" : value_of(key));
+
+	EXPECT_EQ(rows, expected);
+}
+
+TEST(VaultRecordTests, OversizedValuesAreRefused)
+{
+	auto table = vault().table("oversized", 4);
+
+	const std::string largest(MILI::max_sized_bytes, 'a');
+	const std::string oversized(MILI::max_sized_bytes + 1, 'b');
+
+	EXPECT_TRUE(table.insert(1, largest));
+	EXPECT_FALSE(table.insert(2, oversized));
+	EXPECT_FALSE(table.update(1, oversized));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	// the refused mutations never reached the cache, the log or the fragment
+	EXPECT_EQ(table.read(1), largest);
+	EXPECT_FALSE(table.read(2));
+	EXPECT_TRUE(table.insert(2, "fits"));
+}
+
+TEST(VaultBatchTests, ReadsMixHitsAndMisses)
+{
+	auto table = vault().table("batch_reads", 16);
+
+	// the keys spread over every bucket and so over several stripes, half of them are checkpointed and half only cached
+	for (int key = 0; key < 200; key += 2)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	for (int key = 200; key < 400; key += 2)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(table.remove(10));
+
+	const std::vector<int> keys{0, 1, 398, 10, 199, 0, 250, 251, -1};
+	const auto values = table.multi_read(keys);
+
+	ASSERT_EQ(values.size(), keys.size());
+
+	for (std::size_t i = 0; i < keys.size(); ++i)
+		EXPECT_EQ(values[i], table.read(keys[i])) << "key " << keys[i];
+
+	EXPECT_EQ(values[0], value_of(0));
+	EXPECT_EQ(values[5], value_of(0));
+	EXPECT_FALSE(values[1]);
+	EXPECT_FALSE(values[3]);
+}
+
+TEST(VaultBatchTests, WritesApplyRepeatedKeysInOrder)
+{
+	auto table = vault().table("batch_writes", 16);
+
+	for (int key = 0; key < 100; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	// an existing key, two inserts of a new one and a new key in another bucket
+	const std::vector<std::pair<int, std::string>> inserts{{5, "again"}, {100, "first"}, {100, "second"}, {117, "other"}};
+	EXPECT_EQ(table.multi_insert(inserts), (std::vector<bool>{false, true, false, true}));
+
+	const std::vector<std::pair<int, std::string>> updates{{1, "one"}, {1, "uno"}, {1000, "missing"}, {100, "third"}, {63, "sixty three"}};
+	EXPECT_EQ(table.multi_update(updates), (std::vector<bool>{true, true, false, true, true}));
+
+	const std::vector<int> removals{2, 2, 1000, 117, 64};
+	EXPECT_EQ(table.multi_remove(removals), (std::vector<bool>{true, false, false, true, true}));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	EXPECT_EQ(table.read(5), value_of(5));
+	EXPECT_EQ(table.read(100), "third");
+	EXPECT_EQ(table.read(1), "uno");
+	EXPECT_EQ(table.read(63), "sixty three");
+	EXPECT_FALSE(table.read(1000));
+
+	for (int key : {2, 117, 64})
+		EXPECT_FALSE(table.read(key));
+}
+
+TEST(VaultBatchTests, OversizedRecordsFailAlone)
+{
+	auto table = vault().table("batch_oversized", 4);
+	const std::string oversized(MILI::max_sized_bytes + 1, 'x');
+
+	const std::vector<std::pair<int, std::string>> inserts{{1, value_of(1)}, {2, oversized}, {3, value_of(3)}};
+	EXPECT_EQ(table.multi_insert(inserts), (std::vector<bool>{true, false, true}));
+
+	const std::vector<std::pair<int, std::string>> updates{{1, oversized}, {3, "three"}};
+	EXPECT_EQ(table.multi_update(updates), (std::vector<bool>{false, true}));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	const std::vector<int> keys{1, 2, 3};
+	EXPECT_EQ(table.multi_read(keys), (std::vector<std::optional<std::string>>{value_of(1), std::nullopt, "three"}));
+}
+
+namespace
+{
+	// readers check that every key reads as absent or as one of the values its writer gives it
+	bool plausible(int key, const std::optional<std::string>& value)
+	{
+		return not value or *value == value_of(key) or *value == value_of(key) + " updated";
+	}
+
+	// each writer inserts and then updates its own range of keys
+	template <typename Table>
+	void write_range(Table& table, int first, int count, std::atomic<int>& failures)
+	{
+		for (int key = first; key < first + count; ++key)
+			if (not table.insert(key, value_of(key)))
+				++failures;
+
+		for (int key = first; key < first + count; ++key)
+			if (not table.update(key, value_of(key) + " updated"))
+				++failures;
+	}
+}
+
+TEST(VaultConcurrencyTests, ReadersRunAlongsideWriters)
+{
+	auto table = vault().table("concurrent", 16);
+
+	constexpr int writers = 4;
+	constexpr int keys_per_writer = 2000;
+
+	std::atomic<int> failures = 0;
+	std::atomic<int> implausible = 0;
+	std::atomic<bool> writing = true;
+	std::vector<std::thread> threads;
+
+	for (int writer = 0; writer < writers; ++writer)
+		threads.emplace_back([&, writer] { write_range(table, writer * keys_per_writer, keys_per_writer, failures); });
+
+	for (int reader = 0; reader < 4; ++reader)
+	{
+		threads.emplace_back([&, reader]
+		{
+			for (int key = reader; writing; key = (key + 7) % (writers * keys_per_writer))
+				if (not plausible(key, table.read(key)))
+					++implausible;
+		});
+	}
+
+	for (int writer = 0; writer < writers; ++writer)
+		threads[writer].join();
+
+	writing = false;
+
+	for (auto& thread : threads)
+		if (thread.joinable())
+			thread.join();
+
+	EXPECT_EQ(failures, 0);
+	EXPECT_EQ(implausible, 0);
+
+	for (int key = 0; key < writers * keys_per_writer; ++key)
+		ASSERT_EQ(table.read(key), value_of(key) + " updated");
+}
+
+TEST(VaultConcurrencyTests, WritesRunAlongsideCheckpoints)
+{
+	auto table = vault().table("concurrent_checkpoints", 16);
+
+	constexpr int writers = 4;
+	constexpr int keys_per_writer = 2000;
+
+	std::atomic<int> failures = 0;
+	std::atomic<int> implausible = 0;
+	std::atomic<int> checkpoints = 0;
+	std::atomic<bool> writing = true;
+	std::vector<std::thread> threads;
+
+	for (int writer = 0; writer < writers; ++writer)
+		threads.emplace_back([&, writer] { write_range(table, writer * keys_per_writer, keys_per_writer, failures); });
+
+	// the checkpoints freeze and write the cache while the writers keep filling it and the reader reads through both
+	threads.emplace_back([&]
+	{
+		do
+		{
+			if (vault().checkpoint())
+				++checkpoints;
+		}
+		while (writing);
+	});
+
+	threads.emplace_back([&]
+	{
+		for (int key = 0; writing; key = (key + 13) % (writers * keys_per_writer))
+			if (not plausible(key, table.read(key)))
+				++implausible;
+	});
+
+	for (int writer = 0; writer < writers; ++writer)
+		threads[writer].join();
+
+	writing = false;
+
+	for (auto& thread : threads)
+		if (thread.joinable())
+			thread.join();
+
+	EXPECT_EQ(failures, 0);
+	EXPECT_EQ(implausible, 0);
+	EXPECT_GT(checkpoints, 0);
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	for (int key = 0; key < writers * keys_per_writer; ++key)
+		ASSERT_EQ(table.read(key), value_of(key) + " updated");
+}
+
+TEST(VaultLegacyTests, HashFileSeedsTheFiltersUntilTheyAreWritten)
+{
+	// a second database needs a vault type of its own, every type keeps a single instance
+	using LegacyVault = MILI::Database::Vault<long, std::string>;
+	using Serializer = MILI::Database::details::DefaultSerializer<long, std::string>;
+
+	constexpr std::string_view legacy_name = "VaultLegacyTests";
+	const auto database = std::string{MILI::Database::database_path} + std::string{legacy_name};
+	const auto table_directory = database + "/users";
+
+	std::error_code error;
+	std::filesystem::remove_all(database, error);
+	std::filesystem::remove(database + ".wal", error);
+	std::filesystem::remove(database + ".wal.sealed", error);
+	std::filesystem::create_directories(table_directory);
+
+	// a table of one bucket written before the per-table filters: its fragment and the database wide [u64 count][hashes] file
+	ASSERT_TRUE(MILI::Database::details::TableLayout{1}.persist(table_directory + "/layout"));
+
+	MILI::Database::details::FragmentWriter<long, std::string, Serializer> writer;
+	const auto count = MILI::serialize(std::size_t{100});
+	std::vector<std::byte> hashes{count.begin(), count.end()};
+
+	for (long key = 0; key < 100; ++key)
+	{
+		writer.add(key, value_of(static_cast<int>(key)));
+
+		const auto hash = MILI::serialize(std::hash<long>{}(key));
+		hashes.insert(hashes.end(), hash.begin(), hash.end());
+	}
+
+	ASSERT_TRUE(writer.finish(table_directory + "/fragment0"));
+	ASSERT_TRUE(MILI::Database::details::commit_file(database + ".hash", hashes));
+
+	auto created = LegacyVault::construct(legacy_name);
+	LegacyVault& legacy = created ? created->get() : LegacyVault::get_instance(legacy_name)->get();
+	auto table = legacy.table("users");
+
+	// the table has no filter file yet, the hash file stands in for it
+	EXPECT_FALSE(std::filesystem::exists(table_directory + "/membership"));
+
+	for (long key = 0; key < 100; ++key)
+		ASSERT_EQ(table.read(key), value_of(static_cast<int>(key)));
+
+	EXPECT_FALSE(table.read(100));
+	EXPECT_TRUE(std::filesystem::exists(database + ".hash"));
+
+	// the checkpoint gives the table a filter of its own, after which the hash file has nothing left to cover
+	ASSERT_TRUE(legacy.checkpoint());
+
+	EXPECT_FALSE(std::filesystem::exists(database + ".hash"));
+
+	const auto filter = MILI::Database::details::MembershipFilter::load(table_directory + "/membership");
+
+	for (long key = 0; key < 100; ++key)
+		ASSERT_TRUE(filter.contains(std::hash<long>{}(key)));
+
+	EXPECT_EQ(table.read(42), value_of(42));
+}
+
+TEST(VaultEvictionTests, EvictedBucketsKeepTheirChanges)
+{
+	auto table = vault().table("evicted", 16);
+
+	// the pool can only hold a bucket or two, checkpoint workers evict the buckets the others just changed
+	vault().set_memory_budget(1);
+
+	for (int round = 0; round < 3; ++round)
+	{
+		for (int key = 0; key < 2000; ++key)
+			ASSERT_TRUE(round == 0 ? table.insert(key, value_of(key + round)) : table.update(key, value_of(key + round)));
+
+		ASSERT_TRUE(vault().checkpoint());
+	}
+
+	EXPECT_GT(vault().buffer_pool_stats().evictions, 0u);
+
+	for (int key = 0; key < 2000; ++key)
+		EXPECT_EQ(table.read(key), value_of(key + 2));
+
+	vault().set_memory_budget(64 * 1024 * 1024);
+}
+
+TEST(VaultEvictionTests, ColdReadsFollowTheLatestFragment)
+{
+	auto table = vault().table("cold_reads", 16);
+
+	for (int key = 0; key < 1000; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+	vault().set_memory_budget(1);
+
+	// the buckets leave the pool while their fragments are mapped for the reads in between
+	for (int round = 1; round <= 3; ++round)
+	{
+		for (int key = 0; key < 1000; ++key)
+			ASSERT_EQ(table.read(key), value_of(key + round - 1));
+
+		for (int key = 0; key < 1000; ++key)
+			ASSERT_TRUE(table.update(key, value_of(key + round)));
+
+		ASSERT_TRUE(vault().checkpoint());
+	}
+
+	for (int key = 0; key < 1000; ++key)
+		EXPECT_EQ(table.read(key), value_of(key + 3));
+
+	vault().set_memory_budget(64 * 1024 * 1024);
+}
+
+TEST(VaultEvictionTests, ReloadedBucketsApplyTheirDelta)
+{
+	auto table = vault().table("reloaded", 4);
+
+	for (int key = 0; key < 400; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	// small changes go to the deltas of the fragments
+	for (int key = 0; key < 400; key += 10)
+		ASSERT_TRUE(table.update(key, value_of(key) + " updated"));
+
+	for (int key = 5; key < 400; key += 10)
+		ASSERT_TRUE(table.remove(key));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	// loading a bucket of another table pushes the buckets out, they are loaded back from fragment and delta for the next change
+	vault().set_memory_budget(1);
+
+	ASSERT_TRUE(vault().table("reloaded_evictor", 1).insert(0, value_of(0)));
+	ASSERT_TRUE(vault().checkpoint());
+
+	const auto misses = vault().buffer_pool_stats().misses;
+
+	for (int key = 1; key < 400; key += 10)
+		ASSERT_TRUE(table.update(key, value_of(key) + " again"));
+
+	ASSERT_TRUE(vault().checkpoint());
+	vault().set_memory_budget(64 * 1024 * 1024);
+
+	EXPECT_GE(vault().buffer_pool_stats().misses - misses, 4u);
+
+	for (int key = 0; key < 400; ++key)
+	{
+		if (key % 10 == 5)
+			EXPECT_FALSE(table.read(key));
+		else if (key % 10 == 0)
+			EXPECT_EQ(table.read(key), value_of(key) + " updated");
+		else if (key % 10 == 1)
+			EXPECT_EQ(table.read(key), value_of(key) + " again");
+		else
+			EXPECT_EQ(table.read(key), value_of(key));
+	}
+}
+
+TEST(VaultProtocolTests, ScansAreCappedAndPaged)
+{
+	namespace Protocol = MILI::Database::Protocol;
+	using Codec = Protocol::Codec<int, std::string, TestVault::serializer_type>;
+
+	auto table = vault().table("protocol_scan", 4);
+	const int rows = static_cast<int>(Protocol::max_scan_rows) + 10;
+
+	for (int key = 0; key < rows; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	auto scan = [](int low, std::uint32_t limit)
+	{
+		const Protocol::Request<int, std::string> request{1, Protocol::Opcode::Scan, "protocol_scan", low, {}, std::numeric_limits<int>::max(), limit};
+		const auto frame = Codec::encode(std::span{&request, 1});
+
+		auto responses = Codec::decode_responses(Protocol::execute(vault(), frame));
+		EXPECT_TRUE(responses);
+
+		return responses ? responses->second : std::vector<Protocol::Response<int, std::string>>{};
+	};
+
+	// a limit of 0 doesn't mean the whole table
+	const auto first = scan(0, 0);
+	ASSERT_EQ(first.size(), Protocol::max_scan_rows + 1);
+	EXPECT_EQ(first.back().status, Protocol::Status::Truncated);
+	EXPECT_FALSE(first.back().key);
+
+	// and neither does a limit above the cap
+	EXPECT_EQ(scan(0, Protocol::max_scan_rows * 2).size(), Protocol::max_scan_rows + 1);
+
+	// the rest of the range comes with the next page
+	const int last = *first[first.size() - 2].key;
+	EXPECT_EQ(last, static_cast<int>(Protocol::max_scan_rows) - 1);
+
+	const auto second = scan(last + 1, 0);
+	ASSERT_EQ(second.size(), 11u);
+	EXPECT_EQ(second.front().key, last + 1);
+	EXPECT_EQ(second.front().value, value_of(last + 1));
+	EXPECT_EQ(second.back().status, Protocol::Status::Ok);
+}
+
+TEST(VaultTableTests, ReadingATableDoesNotCreateIt)
+{
+	const auto directory = std::string{MILI::Database::database_path} + std::string{database_name} + "/never_written";
+	auto table = vault().table("never_written");
+
+	EXPECT_FALSE(table.read(1));
+	const std::vector<int> keys{1, 2, 3};
+	EXPECT_TRUE(std::ranges::all_of(table.multi_read(keys), [](const auto& value) { return not value; }));
+	EXPECT_EQ(table.scan(0, 100).next(), std::nullopt);
+
+	ASSERT_TRUE(vault().checkpoint());
+	EXPECT_FALSE(std::filesystem::exists(directory));
+
+	// the first write that is checkpointed creates it
+	ASSERT_TRUE(table.insert(1, value_of(1)));
+	ASSERT_TRUE(vault().checkpoint());
+
+	EXPECT_TRUE(std::filesystem::exists(directory + "/layout"));
+	EXPECT_EQ(table.read(1), value_of(1));
+}
+
+namespace
+{
+	// tables of these tests split after a few KB, the other tests keep the default threshold
+	struct SmallSplits
+	{
+		SmallSplits()
+		{
+			vault().set_split_threshold(4096);
+		}
+
+		~SmallSplits()
+		{
+			vault().set_split_threshold(16 * 1024 * 1024);
+		}
+	};
+}
+
+TEST(VaultSplitTests, ReadsAndScansSpanSplitBuckets)
+{
+	SmallSplits small_splits;
+	auto table = vault().table("split_scan", 4);
+
+	for (int round = 0; round < 5; ++round)
+	{
+		for (int key = round * 1000; key < (round + 1) * 1000; ++key)
+			ASSERT_TRUE(table.insert(key, value_of(key)));
+
+		ASSERT_TRUE(vault().checkpoint());
+	}
+
+	EXPECT_GT(table.bucket_count(), 4u);
+
+	for (int key = 0; key < 5000; ++key)
+		ASSERT_EQ(table.read(key), value_of(key));
+
+	int count = 0;
+
+	for (const auto& [key, value] : table.scan(0, 4999))
+	{
+		ASSERT_EQ(key, count);
+		ASSERT_EQ(value, value_of(key));
+		++count;
+	}
+
+	EXPECT_EQ(count, 5000);
+
+	for (int key = 0; key < 5000; key += 2)
+		ASSERT_TRUE(table.remove(key));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	count = 0;
+
+	for (const auto& [key, value] : table.scan(0, 4999))
+	{
+		ASSERT_EQ(key % 2, 1);
+		++count;
+	}
+
+	EXPECT_EQ(count, 2500);
+}
+
+TEST(VaultSnapshotTests, SnapshotSeesTheTableAsItWas)
+{
+	auto table = vault().table("snapshot_isolation", 4);
+
+	for (int key = 0; key < 100; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	// changes still in the cache when the snapshot is taken are part of it
+	for (int key = 0; key < 50; ++key)
+		ASSERT_TRUE(table.update(key, "before"));
+
+	{
+		auto snapshot = vault().snapshot();
+
+		for (int key = 0; key < 100; key += 3)
+			ASSERT_TRUE(table.update(key, "after"));
+
+		ASSERT_TRUE(vault().checkpoint());
+
+		for (int key = 1; key < 100; key += 3)
+			ASSERT_TRUE(table.remove(key));
+
+		for (int key = 100; key < 120; ++key)
+			ASSERT_TRUE(table.insert(key, value_of(key)));
+
+		ASSERT_TRUE(vault().checkpoint());
+
+		auto expected = [](int key) { return key < 50 ? std::string{"before"} : value_of(key); };
+
+		for (int key = 0; key < 120; ++key)
+		{
+			if (key >= 100)
+				EXPECT_FALSE(snapshot.read("snapshot_isolation", key));
+			else
+				EXPECT_EQ(snapshot.read("snapshot_isolation", key), expected(key));
+		}
+
+		int count = 0;
+
+		for (const auto& [key, value] : snapshot.scan("snapshot_isolation", 0, 200))
+		{
+			ASSERT_EQ(key, count);
+			ASSERT_EQ(value, expected(key));
+			++count;
+		}
+
+		EXPECT_EQ(count, 100);
+
+		// a moved snapshot still reads as of the time the original was taken
+		auto moved = std::move(snapshot);
+		EXPECT_EQ(moved.read("snapshot_isolation", 3), "before");
+	}
+
+	EXPECT_EQ(table.read(3), "after");
+	EXPECT_FALSE(table.read(4));
+
+	// a snapshot taken now sees the changes
+	auto later = vault().snapshot();
+	EXPECT_EQ(later.read("snapshot_isolation", 3), "after");
+	EXPECT_EQ(later.read("snapshot_isolation", 110), value_of(110));
+}
+
+TEST(VaultSnapshotTests, SnapshotOutlivesSplits)
+{
+	SmallSplits small_splits;
+	auto table = vault().table("snapshot_split", 2);
+
+	for (int key = 0; key < 500; ++key)
+		ASSERT_TRUE(table.insert(key, value_of(key)));
+
+	ASSERT_TRUE(vault().checkpoint());
+
+	const auto buckets = table.bucket_count();
+	auto snapshot = vault().snapshot();
+
+	// the table keeps growing while the snapshot is live, the entries it sees move to other buckets
+	for (int round = 0; round < 4; ++round)
+	{
+		for (int key = 0; key < 500; key += 4)
+			ASSERT_TRUE(table.update(key, "changed"));
+
+		for (int key = 500 + round * 500; key < 1000 + round * 500; ++key)
+			ASSERT_TRUE(table.insert(key, value_of(key)));
+
+		ASSERT_TRUE(vault().checkpoint());
+	}
+
+	EXPECT_GT(table.bucket_count(), buckets);
+
+	int count = 0;
+
+	for (const auto& [key, value] : snapshot.scan("snapshot_split", 0, 10000))
+	{
+		ASSERT_EQ(key, count);
+		ASSERT_EQ(value, value_of(key));
+		++count;
+	}
+
+	EXPECT_EQ(count, 500);
+	EXPECT_EQ(snapshot.read("snapshot_split", 0), value_of(0));
+	EXPECT_FALSE(snapshot.read("snapshot_split", 600));
+
+	EXPECT_EQ(table.read(0), "changed");
+	EXPECT_EQ(table.read(600), value_of(600));
+}
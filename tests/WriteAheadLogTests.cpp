@@ -0,0 +1,190 @@
+#include <filesystem>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Vault.hpp"
+#include "WriteAheadLog.hpp"
+#include "TestFiles.hpp"
+
+namespace
+{
+	using MILI::Database::Testing::temp_path;
+	using MILI::Database::Testing::flip_byte;
+
+	enum class Operation : std::uint8_t
+	{
+		Insert,
+		Remove
+	};
+
+	using Serializer = MILI::Database::details::DefaultSerializer<int, std::string>;
+	using Log = MILI::Database::details::WriteAheadLog<int, std::string, Serializer, Operation>;
+	using Record = std::tuple<std::string, int, std::string, Operation>;
+
+	std::vector<Record> replayed(Log& log)
+	{
+		std::vector<Record> ret;
+
+		log.replay([&](std::string_view table, int key, std::string value, Operation operation)
+		{
+			ret.emplace_back(std::string{table}, key, std::move(value), operation);
+		});
+
+		return ret;
+	}
+}
+
+TEST(WriteAheadLogTests, CommittedRecordsReplayInOrder)
+{
+	const auto path = temp_path("WriteAheadLogTests", "committed", {".sealed"});
+
+	{
+		Log log{path};
+		replayed(log);
+
+		ASSERT_TRUE(log.append("users", 1, "one", Operation::Insert));
+		ASSERT_TRUE(log.append("users", 2, "two", Operation::Insert));
+		ASSERT_TRUE(log.append("orders", 1, "", Operation::Remove));
+		ASSERT_TRUE(log.commit());
+	}
+
+	Log log{path};
+	const std::vector<Record> expected{{"users", 1, "one", Operation::Insert}, {"users", 2, "two", Operation::Insert}, {"orders", 1, "", Operation::Remove}};
+
+	EXPECT_EQ(replayed(log), expected);
+}
+
+TEST(WriteAheadLogTests, TornTailIsCutOff)
+{
+	const auto path = temp_path("WriteAheadLogTests", "torn", {".sealed"});
+
+	{
+		Log log{path};
+		replayed(log);
+
+		ASSERT_TRUE(log.append("users", 1, "one", Operation::Insert));
+		ASSERT_TRUE(log.append("users", 2, "two", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+	}
+
+	// a crash in the middle of the next group leaves half a record behind
+	const auto intact = std::filesystem::file_size(path);
+	std::filesystem::resize_file(path, intact + 7);
+
+	{
+		Log log{path};
+		EXPECT_EQ(replayed(log).size(), 2u);
+		EXPECT_EQ(std::filesystem::file_size(path), intact);
+
+		// records logged after the recovery follow the intact ones, not the torn bytes
+		ASSERT_TRUE(log.append("users", 3, "three", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+	}
+
+	Log log{path};
+	const auto records = replayed(log);
+
+	ASSERT_EQ(records.size(), 3u);
+	EXPECT_EQ(records.back(), (Record{"users", 3, "three", Operation::Insert}));
+}
+
+TEST(WriteAheadLogTests, CorruptRecordEndsTheReplay)
+{
+	const auto path = temp_path("WriteAheadLogTests", "corrupt", {".sealed"});
+
+	{
+		Log log{path};
+		replayed(log);
+
+		ASSERT_TRUE(log.append("users", 1, "one", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+		ASSERT_TRUE(log.append("users", 2, "two", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+	}
+
+	// flip a byte of the second record's payload
+	flip_byte(path, std::filesystem::file_size(path) - 1);
+
+	Log log{path};
+	const auto records = replayed(log);
+
+	ASSERT_EQ(records.size(), 1u);
+	EXPECT_EQ(std::get<1>(records.front()), 1);
+}
+
+TEST(WriteAheadLogTests, SealedRecordsReplayFirst)
+{
+	const auto path = temp_path("WriteAheadLogTests", "sealed", {".sealed"});
+
+	{
+		Log log{path};
+		replayed(log);
+
+		ASSERT_TRUE(log.append("users", 1, "old", Operation::Insert));
+		ASSERT_TRUE(log.seal());
+		ASSERT_TRUE(log.append("users", 1, "new", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+	}
+
+	{
+		Log log{path};
+		const auto records = replayed(log);
+
+		ASSERT_EQ(records.size(), 2u);
+		EXPECT_EQ(std::get<2>(records[0]), "old");
+		EXPECT_EQ(std::get<2>(records[1]), "new");
+
+		ASSERT_TRUE(log.drop_sealed());
+	}
+
+	Log log{path};
+	EXPECT_EQ(replayed(log).size(), 1u);
+}
+
+TEST(WriteAheadLogTests, SealingAnIdleLogSucceeds)
+{
+	const auto path = temp_path("WriteAheadLogTests", "idle", {".sealed"});
+
+	Log log{path};
+	replayed(log);
+
+	ASSERT_TRUE(log.append("users", 1, "one", Operation::Insert));
+	ASSERT_TRUE(log.seal());
+	ASSERT_TRUE(log.drop_sealed());
+
+	// checkpoints of a vault nobody wrote to in between seal a log that was never reopened
+	EXPECT_TRUE(log.seal());
+	EXPECT_TRUE(log.drop_sealed());
+
+	ASSERT_TRUE(log.append("users", 2, "two", Operation::Insert));
+	ASSERT_TRUE(log.commit());
+
+	Log reopened{path};
+	const auto records = replayed(reopened);
+
+	ASSERT_EQ(records.size(), 1u);
+	EXPECT_EQ(std::get<1>(records.front()), 2);
+}
+
+TEST(WriteAheadLogTests, OversizedRecordsAreNotLogged)
+{
+	const auto path = temp_path("WriteAheadLogTests", "oversized", {".sealed"});
+
+	{
+		Log log{path};
+		replayed(log);
+
+		EXPECT_FALSE(log.append("users", 1, std::string(MILI::max_sized_bytes + 1, 'x'), Operation::Insert));
+		ASSERT_TRUE(log.append("users", 2, "fits", Operation::Insert));
+		ASSERT_TRUE(log.commit());
+	}
+
+	Log log{path};
+	const auto records = replayed(log);
+
+	ASSERT_EQ(records.size(), 1u);
+	EXPECT_EQ(std::get<1>(records.front()), 2);
+}